@@ -0,0 +1,185 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <SDL2/SDL_stdinc.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+#include "Config.h"
+#include "Control.h"
+#include "Profiler.h"
+#include "Script.h"
+#include "ScriptAllocator.h"
+#include "Version.h"
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Runs a game from the current directory without showing anything, then
+// walks through it with a Lua file, usually a sequence of switch() calls
+// followed by a few system.update() to render some frames. Results are
+// written as JSON so that runs can be compared against each other.
+
+#define kBenchDefaultOutput "dagon-bench.json"
+
+static std::vector<float> collectDurations;
+static std::vector<float> frameDurations;
+static std::vector<float> switchDurations;
+static std::vector<float> textureLoadDurations;
+
+// Only main thread zones are collected, so no locking is needed
+void collectDuration(int zone, float duration) {
+  switch (zone) {
+    case dagon::kZoneCollect:
+      collectDurations.push_back(duration);
+      break;
+    case dagon::kZoneFrame:
+      frameDurations.push_back(duration);
+      break;
+    case dagon::kZoneSwitch:
+      switchDurations.push_back(duration);
+      break;
+    case dagon::kZoneTextureLoad:
+      textureLoadDurations.push_back(duration);
+      break;
+  }
+}
+
+float percentile(std::vector<float> durations, float percentile) {
+  if (durations.empty())
+    return 0.0f;
+  
+  size_t nth = static_cast<size_t>(percentile / 100.0f * (durations.size() - 1));
+  std::nth_element(durations.begin(), durations.begin() + nth, durations.end());
+  return durations[nth];
+}
+
+void writeDurations(FILE* file, const char* name, const std::vector<float>& durations) {
+  float max = 0.0f;
+  float total = 0.0f;
+  for (size_t i = 0; i < durations.size(); i++) {
+    max = std::max(max, durations[i]);
+    total += durations[i];
+  }
+  
+  fprintf(file, "  \"%s\": {\"count\": %lu, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, "
+          "\"max\": %.3f, \"total\": %.3f},\n", name,
+          static_cast<unsigned long>(durations.size()), percentile(durations, 50.0f),
+          percentile(durations, 95.0f), percentile(durations, 99.0f), max, total);
+}
+
+long peakResidentSize() {
+#if defined(_WIN32)
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+  
+#if defined(__APPLE__)
+  return usage.ru_maxrss / 1024; // Bytes on Mac OS X
+#else
+  return usage.ru_maxrss;
+#endif
+#endif
+}
+
+void writeReport(FILE* file, const char* walkName, Uint64 numOfAllocations) {
+  dagon::ScriptAllocator& scriptAllocator = dagon::ScriptAllocator::instance();
+  
+  fprintf(file, "{\n");
+  fprintf(file, "  \"version\": \"%s\",\n", DAGON_VERSION_STRING);
+  fprintf(file, "  \"walk\": \"%s\",\n", walkName);
+  writeDurations(file, "frame_ms", frameDurations);
+  writeDurations(file, "switch_ms", switchDurations);
+  writeDurations(file, "texture_load_ms", textureLoadDurations);
+  writeDurations(file, "collect_ms", collectDurations);
+  fprintf(file, "  \"lua_heap_kb\": %lu,\n",
+          static_cast<unsigned long>(scriptAllocator.liveBytes() / 1024));
+  fprintf(file, "  \"lua_peak_kb\": %lu,\n",
+          static_cast<unsigned long>(scriptAllocator.peakBytes() / 1024));
+  fprintf(file, "  \"lua_allocations\": %llu,\n",
+          static_cast<unsigned long long>(numOfAllocations));
+  fprintf(file, "  \"peak_rss_kb\": %ld\n", peakResidentSize());
+  fprintf(file, "}\n");
+  fclose(file);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    printf("\n"
+           "DAGON - Benchmark runner\n\n"
+           "Run in a directory containing a config.lua file.\n\n"
+           "Usage:\n"
+           "  %s walk.lua [output.json]\n",
+           argv[0]);
+    return 1;
+  }
+  
+  const char* walkName = argv[1];
+  const char* outputName = argc > 2 ? argv[2] : kBenchDefaultOutput;
+  
+  // Opened first, since the engine exits on its own once terminated
+  FILE* output = fopen(outputName, "w");
+  if (!output) {
+    fprintf(stderr, "Could not write %s\n", outputName);
+    return 1;
+  }
+  
+  // Any of these may be overridden from the environment. Without a display
+  // we fall back to SDL's offscreen driver and Mesa's software renderer.
+  SDL_setenv("ALSOFT_DRIVERS", "null", 0);
+  if (!SDL_getenv("DISPLAY") && !SDL_getenv("WAYLAND_DISPLAY")) {
+    SDL_setenv("SDL_VIDEODRIVER", "offscreen", 0);
+    SDL_setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+  }
+  
+  dagon::Config::instance().headless = true;
+  dagon::Profiler& profiler = dagon::Profiler::instance();
+  profiler.setListener(collectDuration);
+  
+  // Arguments aren't meant for the engine
+  dagon::Control& control = dagon::Control::instance();
+  control.init(1, argv);
+  
+  // Loading the game itself isn't measured
+  Uint64 numOfAllocations = dagon::ScriptAllocator::instance().numOfAllocations();
+  profiler.setEnabled(true);
+  
+  std::string command = "dofile([==[";
+  command += walkName;
+  command += "]==])";
+  dagon::Script::instance().processCommand(command.c_str());
+  
+  profiler.setEnabled(false);
+  numOfAllocations = dagon::ScriptAllocator::instance().numOfAllocations() - numOfAllocations;
+  
+  writeReport(output, walkName, numOfAllocations);
+  printf("%s\n", outputName);
+  
+  // Never returns
+  control.terminate();
+  
+  return 0;
+}
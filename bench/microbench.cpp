@@ -0,0 +1,449 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Audio.h"
+#include "Deserializer.h"
+#include "FeedManager.h"
+#include "RenderManager.h"
+#include "Serializer.h"
+#include "Texture.h"
+#include "TimerManager.h"
+#include "Version.h"
+#include "Video.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Times the engine's hot kernels in isolation and writes the results as
+// JSON, so that every optimisation can be compared against a baseline.
+// Audio and texture kernels need real files, given on the command line:
+//
+//   dagon-microbench [-o results.json] [track.ogg] [node.tex] [image.png]
+//
+// Everything else runs on synthetic data.
+
+#define kMicrobenchDefaultOutput "dagon-microbench.json"
+
+// Each measurement is repeated this many times and the median is kept
+#define kMicrobenchRepeats 5
+
+// Iterations are doubled until a batch takes at least this long (ms)
+#define kMicrobenchMinBatch 20.0
+
+typedef struct {
+  std::string name;
+  long iterations;
+  double nsPerOp;
+  double bytesPerOp; // Zero if throughput is meaningless
+} MicrobenchResult;
+
+////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////
+
+class Microbenchmarks {
+  std::vector<MicrobenchResult> _arrayOfResults;
+  
+  double _batch(const std::function<void()>& function, long iterations);
+  void _measure(const std::string& name, const std::function<void()>& function,
+                double bytesPerOp = 0.0);
+
+public:
+  void audio(const char* fileName);
+  void centerOfPolygon();
+  void convertToRGB();
+  void feedSplitting();
+  void serializer();
+  void texture(const char* fileName);
+  void timers();
+  
+  void print();
+  bool save(const char* fileName);
+};
+
+////////////////////////////////////////////////////////////
+// Implementation - Benchmarks
+////////////////////////////////////////////////////////////
+
+void Microbenchmarks::audio(const char* fileName) {
+  Audio audio;
+  AudioVoice voice;
+  alGenSources(1, &voice.source);
+  alGenBuffers(1, voice.buffers);
+  
+  // Every iteration decodes the whole file through the streaming path,
+  // the first one also tells the decoded size
+  std::string path(fileName);
+  double bytesPerFile = static_cast<double>(audio.decodeStream(path, &voice));
+  if (bytesPerFile > 0.0) {
+    _measure(std::string("audio/fillBuffer/") + fileName, [&]() {
+      audio.decodeStream(path, &voice);
+    }, bytesPerFile);
+  }
+  
+  alDeleteBuffers(1, voice.buffers);
+  alDeleteSources(1, &voice.source);
+}
+
+void Microbenchmarks::centerOfPolygon() {
+  RenderManager& renderManager = RenderManager::instance();
+  
+  int sizes[] = { 4, 32, 256 };
+  for (int i = 0; i < 3; i++) {
+    // A regular polygon, much like the spots drawn in the editor
+    std::vector<int> arrayOfCoordinates;
+    for (int j = 0; j < sizes[i]; j++) {
+      double angle = 6.283185307 * j / sizes[i];
+      arrayOfCoordinates.push_back(static_cast<int>(1024 + 512 * cos(angle)));
+      arrayOfCoordinates.push_back(static_cast<int>(1024 + 512 * sin(angle)));
+    }
+    
+    char name[64];
+    snprintf(name, sizeof(name), "render/centerOfPolygon/%d", sizes[i]);
+    _measure(name, [&]() {
+      Point center = renderManager.centerOfPolygon(arrayOfCoordinates);
+      if (center.x < 0.0f)
+        arrayOfCoordinates[0]++;
+    });
+  }
+}
+
+void Microbenchmarks::convertToRGB() {
+  Video video;
+  
+  int sizes[][2] = { { 640, 480 }, { 1280, 720 }, { 1920, 1080 } };
+  for (int i = 0; i < 3; i++) {
+    int width = sizes[i][0];
+    int height = sizes[i][1];
+    
+    // Gradients rather than zeros so that every table entry is touched
+    std::vector<uint8_t> y(width * height);
+    std::vector<uint8_t> u((width / 2) * (height / 2));
+    std::vector<uint8_t> v(u.size());
+    std::vector<uint8_t> rgb(width * height * 3);
+    for (size_t j = 0; j < y.size(); j++)
+      y[j] = static_cast<uint8_t>(j);
+    for (size_t j = 0; j < u.size(); j++) {
+      u[j] = static_cast<uint8_t>(j * 3);
+      v[j] = static_cast<uint8_t>(j * 7);
+    }
+    
+    char name[64];
+    snprintf(name, sizeof(name), "video/convertToRGB/%dx%d", width, height);
+    _measure(name, [&]() {
+      video.convertToRGB(&y[0], width, &u[0], &v[0], width / 2, &rgb[0], width, height, width);
+    }, static_cast<double>(rgb.size()));
+  }
+}
+
+void Microbenchmarks::feedSplitting() {
+  std::string text;
+  while (text.length() < 1000)
+    text += "The quick brown fox jumps over the lazy dog, again and again. ";
+  
+  int lengths[] = { 40, 200, 1000 };
+  for (int i = 0; i < 3; i++) {
+    std::string line = text.substr(0, lengths[i]);
+    std::vector<std::string> arrayOfLines;
+    
+    char name[64];
+    snprintf(name, sizeof(name), "feed/split/%d", lengths[i]);
+    _measure(name, [&]() {
+      arrayOfLines.clear();
+      FeedManager::split(line, 1280 / kDefFeedSize, &arrayOfLines);
+    }, static_cast<double>(line.length()));
+  }
+}
+
+void Microbenchmarks::serializer() {
+  lua_State* L = luaL_newstate();
+  luaL_openlibs(L);
+  
+  int sizes[] = { 100, 1000, 10000 };
+  for (int i = 0; i < 3; i++) {
+    // Tables of ten mixed fields, as games usually persist their state
+    char script[512];
+    snprintf(script, sizeof(script),
+             "dgPersistence = {} "
+             "for i = 1, %d do "
+             "  dgPersistence['object' .. i] = { name = 'Object ' .. i, x = i * 1.5, y = i, z = 0, "
+             "    isVisible = (i %% 2 == 0), state = 'idle', count = 0, flags = { 1, 2, 3 } } "
+             "end", sizes[i] / 10);
+    luaL_dostring(L, script);
+    
+    // Includes compression, which is otherwise done by a job worker
+    std::vector<uint8_t> buffer;
+    size_t size = 0;
+    std::function<void()> write = [&]() {
+      Serializer serializer(L);
+      serializer.writeScriptData();
+      serializer.compress();
+      buffer = serializer.data();
+      size = buffer.size();
+      lua_settop(L, 0);
+    };
+    
+    write();
+    
+    char name[64];
+    snprintf(name, sizeof(name), "save/write/%d", sizes[i]);
+    _measure(name, write, static_cast<double>(size));
+    
+    snprintf(name, sizeof(name), "save/read/%d", sizes[i]);
+    _measure(name, [&]() {
+      Deserializer deserializer(L, SDL_RWFromConstMem(&buffer[0], static_cast<int>(size)));
+      deserializer.readScriptData();
+    }, static_cast<double>(size));
+  }
+  
+  lua_close(L);
+}
+
+void Microbenchmarks::texture(const char* fileName) {
+  Texture texture;
+  texture.setResource(fileName);
+  texture.load();
+  if (!texture.isLoaded())
+    return;
+  
+  texture.unload();
+  _measure(std::string("texture/load/") + fileName, [&]() {
+    texture.load();
+    texture.unload();
+  });
+}
+
+static void ignoreTimer() {}
+
+void Microbenchmarks::timers() {
+  TimerManager& timerManager = TimerManager::instance();
+  
+  int sizes[] = { 100, 1000, 10000 };
+  for (int i = 0; i < 3; i++) {
+    int numOfTimers = sizes[i];
+    std::vector<int> arrayOfHandles;
+    char name[64];
+    
+    snprintf(name, sizeof(name), "timers/create/%d", numOfTimers);
+    _measure(name, [&]() {
+      for (int j = 0; j < numOfTimers; j++)
+        arrayOfHandles.push_back(timerManager.createManual(3600.0));
+      for (size_t j = 0; j < arrayOfHandles.size(); j++)
+        timerManager.destroy(arrayOfHandles[j]);
+      arrayOfHandles.clear();
+    });
+    
+    for (int j = 0; j < numOfTimers; j++)
+      arrayOfHandles.push_back(timerManager.createManual(3600.0));
+    
+    // Every timer checked once per frame, as feeds and sleeps do
+    snprintf(name, sizeof(name), "timers/check/%d", numOfTimers);
+    _measure(name, [&]() {
+      for (size_t j = 0; j < arrayOfHandles.size(); j++)
+        timerManager.checkManual(arrayOfHandles[j]);
+    });
+    
+    // Nothing is due, so this is the cost of an idle frame
+    snprintf(name, sizeof(name), "timers/process/%d", numOfTimers);
+    _measure(name, [&]() {
+      timerManager.process();
+    });
+    
+    for (size_t j = 0; j < arrayOfHandles.size(); j++)
+      timerManager.destroy(arrayOfHandles[j]);
+    arrayOfHandles.clear();
+    
+    snprintf(name, sizeof(name), "timers/fire/%d", numOfTimers);
+    _measure(name, [&]() {
+      for (int j = 0; j < numOfTimers; j++)
+        timerManager.createInternal(0.0, ignoreTimer);
+      timerManager.process();
+    });
+  }
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Results
+////////////////////////////////////////////////////////////
+
+void Microbenchmarks::print() {
+  for (size_t i = 0; i < _arrayOfResults.size(); i++) {
+    const MicrobenchResult& result = _arrayOfResults[i];
+    printf("%-40s %12.1f ns/op", result.name.c_str(), result.nsPerOp);
+    if (result.bytesPerOp > 0.0)
+      printf(" %10.1f MB/s", result.bytesPerOp / result.nsPerOp * 1000.0);
+    printf("\n");
+  }
+}
+
+bool Microbenchmarks::save(const char* fileName) {
+  FILE* file = fopen(fileName, "w");
+  if (!file)
+    return false;
+  
+  fprintf(file, "{\n");
+  fprintf(file, "  \"version\": \"%s\",\n", DAGON_VERSION_STRING);
+  fprintf(file, "  \"benchmarks\": [");
+  for (size_t i = 0; i < _arrayOfResults.size(); i++) {
+    const MicrobenchResult& result = _arrayOfResults[i];
+    fprintf(file, "%s\n    {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.3f",
+            i ? "," : "", result.name.c_str(), result.iterations, result.nsPerOp);
+    if (result.bytesPerOp > 0.0) {
+      fprintf(file, ", \"bytes_per_op\": %.0f, \"mb_per_s\": %.3f",
+              result.bytesPerOp, result.bytesPerOp / result.nsPerOp * 1000.0);
+    }
+    fprintf(file, "}");
+  }
+  fprintf(file, "\n  ]\n}\n");
+  fclose(file);
+  
+  return true;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+double Microbenchmarks::_batch(const std::function<void()>& function, long iterations) {
+  Uint64 begin = SDL_GetPerformanceCounter();
+  for (long i = 0; i < iterations; i++)
+    function();
+  Uint64 end = SDL_GetPerformanceCounter();
+  
+  return (end - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+void Microbenchmarks::_measure(const std::string& name, const std::function<void()>& function,
+                               double bytesPerOp) {
+  // The calibration doubles as a warm up
+  long iterations = 1;
+  while (_batch(function, iterations) < kMicrobenchMinBatch)
+    iterations *= 2;
+  
+  std::vector<double> arrayOfTimes;
+  for (int i = 0; i < kMicrobenchRepeats; i++)
+    arrayOfTimes.push_back(_batch(function, iterations) * 1000000.0 / iterations);
+  std::sort(arrayOfTimes.begin(), arrayOfTimes.end());
+  
+  MicrobenchResult result;
+  result.name = name;
+  result.iterations = iterations * kMicrobenchRepeats;
+  result.nsPerOp = arrayOfTimes[kMicrobenchRepeats / 2];
+  result.bytesPerOp = bytesPerOp;
+  _arrayOfResults.push_back(result);
+  
+  fprintf(stderr, "%s\n", name.c_str());
+}
+
+}
+
+////////////////////////////////////////////////////////////
+// Program
+////////////////////////////////////////////////////////////
+
+bool hasExtension(const std::string& fileName, const char* extension) {
+  size_t length = strlen(extension);
+  return fileName.length() > length &&
+    SDL_strcasecmp(fileName.c_str() + fileName.length() - length, extension) == 0;
+}
+
+int main(int argc, char *argv[]) {
+  const char* outputName = kMicrobenchDefaultOutput;
+  std::vector<const char*> arrayOfAudio;
+  std::vector<const char*> arrayOfTextures;
+  
+  for (int i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+      outputName = argv[++i];
+    }
+    else if (hasExtension(argv[i], ".ogg")) {
+      arrayOfAudio.push_back(argv[i]);
+    }
+    else {
+      arrayOfTextures.push_back(argv[i]);
+    }
+  }
+  
+  dagon::Microbenchmarks microbenchmarks;
+  microbenchmarks.convertToRGB();
+  microbenchmarks.centerOfPolygon();
+  microbenchmarks.feedSplitting();
+  microbenchmarks.serializer();
+  microbenchmarks.timers();
+  
+  if (!arrayOfAudio.empty()) {
+    // Buffers are still uploaded, but nothing is played
+    SDL_setenv("ALSOFT_DRIVERS", "null", 0);
+    ALCdevice* device = alcOpenDevice(NULL);
+    ALCcontext* context = device ? alcCreateContext(device, NULL) : NULL;
+    if (context) {
+      alcMakeContextCurrent(context);
+      for (size_t i = 0; i < arrayOfAudio.size(); i++)
+        microbenchmarks.audio(arrayOfAudio[i]);
+      alcMakeContextCurrent(NULL);
+      alcDestroyContext(context);
+    }
+    else {
+      fprintf(stderr, "Could not open an audio device, skipping audio\n");
+    }
+    if (device)
+      alcCloseDevice(device);
+  }
+  
+  if (!arrayOfTextures.empty()) {
+    // Uploads need a context, which is never shown
+    if (!SDL_getenv("DISPLAY") && !SDL_getenv("WAYLAND_DISPLAY")) {
+      SDL_setenv("SDL_VIDEODRIVER", "offscreen", 0);
+      SDL_setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+    }
+    
+    SDL_Init(SDL_INIT_VIDEO);
+    SDL_Window* window = SDL_CreateWindow("", 0, 0, 64, 64,
+                                          SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    SDL_GLContext context = window ? SDL_GL_CreateContext(window) : NULL;
+    if (context && (glewInit() == GLEW_OK)) {
+      for (size_t i = 0; i < arrayOfTextures.size(); i++)
+        microbenchmarks.texture(arrayOfTextures[i]);
+    }
+    else {
+      fprintf(stderr, "Could not create a GL context, skipping textures\n");
+    }
+    if (context)
+      SDL_GL_DeleteContext(context);
+    if (window)
+      SDL_DestroyWindow(window);
+    SDL_Quit();
+  }
+  
+  microbenchmarks.print();
+  if (!microbenchmarks.save(outputName)) {
+    fprintf(stderr, "Could not write %s\n", outputName);
+    return 1;
+  }
+  
+  return 0;
+}
@@ -0,0 +1,48 @@
+-- DAGON Room Audio Check
+
+-- Switches node -> node -> slide -> back within one room and fails if its
+-- ambience stops or fades out on the way. Run from a game directory whose
+-- audio path has the file below: dagon-bench bench/walks/room-audios.lua
+-- The process exits with 1 on failure, so it can gate a build.
+
+local file = roomAudioFile or "ambience.ogg"
+
+local function frames(count)
+  for i = 1, count do
+    system.update()
+  end
+end
+
+local function check(step, ambience)
+  -- Long enough for the fade in to complete, or a fade out to show
+  frames(120)
+
+  if ambience:isFading() or ambience:volume() < 100 then
+    print("Room audios: " .. step .. " faded the ambience out")
+    os.exit(1)
+  end
+end
+
+local room = Room("RoomAudios")
+local ambience = room:addAudio(Audio(file, {loop = true}))
+
+local first = room:addNode(Node("RoomAudiosFirst"))
+local second = room:addNode(Node("RoomAudiosSecond"))
+local slide = room:addSlide(Slide("RoomAudiosSlide"))
+
+switch(first)
+check("entering the room", ambience)
+
+switch(second)
+check("switching nodes", ambience)
+
+switch(first)
+check("switching nodes again", ambience)
+
+switch(slide)
+check("opening a slide", ambience)
+
+zoomOut()
+check("returning from a slide", ambience)
+
+print("Room audios: OK")
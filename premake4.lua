@@ -75,14 +75,13 @@ solution "Dagon"
     os.rmdir("build")
   end
  
-  -- The main Dagon project
-  project "Dagon"
-    targetname "dagon"
+  -- Settings shared by every project that builds the engine sources
+  function engine_project(objs)
     -- GLEW_STATIC only applies to Windows, but there's no harm done if defined
     -- on other systems.
     defines { "GLEW_STATIC", "OV_EXCLUDE_STATIC_CALLBACKS", "KTX_OPENGL" }
     location "build"
-    objdir "build/objs"
+    objdir(objs)
     buildoptions { "-Wall" }
      
     -- Note that we always build as a console app, even on Windows. Please use
@@ -173,3 +172,30 @@ solution "Dagon"
       else
         libdirs { "extlibs/libs-msvc/x86" }
       end
+
+    configuration {}
+  end
+ 
+  -- The main Dagon project
+  project "Dagon"
+    targetname "dagon"
+    engine_project "build/objs"
+  
+  -- Runs a scripted walk through a game without a window and reports frame,
+  -- switch and texture load times as JSON: dagon-bench walk.lua [out.json]
+  -- The walks in bench/walks check behaviour instead, exiting with 1 on failure.
+  project "Dagon-Bench"
+    targetname "dagon-bench"
+    engine_project "build/objs/bench"
+    files { "bench/main.cpp" }
+    excludes { "src/main.cpp" }
+    includedirs { "src" }
+  
+  -- Times the hot kernels on synthetic data and any media given as arguments,
+  -- writing JSON: dagon-microbench [-o out.json] [track.ogg] [node.tex]
+  project "Dagon-Microbench"
+    targetname "dagon-microbench"
+    engine_project "build/objs/microbench"
+    files { "bench/microbench.cpp" }
+    excludes { "src/main.cpp" }
+    includedirs { "src" }
@@ -15,12 +15,11 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
-#include <fstream>
-#include <cassert>
 #include <cstring>
 #include <sstream>
 
 #include "Audio.h"
+#include "AudioManager.h"
 #include "Language.h"
 #include "Log.h"
 
@@ -34,12 +33,22 @@ Audio::Audio() :
 config(Config::instance()),
 log(Log::instance())
 {
+  _cachedBuffer = 0;
   _doesAutoplay = true;
+  _isActive = false;
+  _isCached = false;
   _isLoaded = false;
   _isLoopable = false;
   _isMatched = false;
+  _isRequested = false;
+  _isStolen = false;
   _isVarying = false;
+  _resource.handle = NULL;
+  _resource.dataSize = 0;
+  _priority = kAudioPriorityEffect;
   _state = kAudioInitial;
+  _underruns = 0;
+  _voice = NULL;
   _oggCallbacks.read_func = _oggRead;
   _oggCallbacks.seek_func = _oggSeek;
   _oggCallbacks.close_func = _oggClose;
@@ -67,6 +76,10 @@ bool Audio::doesAutoplay() {
   return _doesAutoplay;
 }
   
+bool Audio::isActive() {
+  return _isActive;
+}
+
 bool Audio::isLoaded() {
   bool value = false;
   if (SDL_LockMutex(_mutex) == 0) {
@@ -93,6 +106,14 @@ bool Audio::isPlaying() {
   return value;
 }
   
+bool Audio::isRequested() {
+  return _isRequested;
+}
+
+bool Audio::isStolen() {
+  return _isStolen;
+}
+
 bool Audio::isVarying() {
   return _isVarying;
 }
@@ -102,23 +123,49 @@ bool Audio::isVarying() {
 ////////////////////////////////////////////////////////////
 
 double Audio::cursor() {
+  if (_isCached) {
+    ALfloat offset = 0.0f;
+    alGetSourcef(_alSource, AL_SEC_OFFSET, &offset);
+    return offset;
+  }
+  
   return ov_time_tell(&_oggStream);
 }
 
+int Audio::priority() {
+  return _priority;
+}
+
 int Audio::state() {
   return _state;
 }
 
+int Audio::underruns() {
+  return _underruns;
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - Sets
 ////////////////////////////////////////////////////////////
 
+void Audio::setActive(bool active) {
+  _isActive = active;
+}
+
 void Audio::setAutoplay(bool autoplay) {
   _doesAutoplay = autoplay;
 }
   
 void Audio::setLoopable(bool loopable) {
   _isLoopable = loopable;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_isLoaded && _isCached)
+      alSourcei(_alSource, AL_LOOPING, loopable ? AL_TRUE : AL_FALSE);
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
 }
 
 void Audio::setPosition(unsigned int face, Point origin) {
@@ -153,7 +200,8 @@ void Audio::setPosition(unsigned int face, Point origin) {
           break;
         }
         default: {
-          assert(false);
+          log.error(kModAudio, "%s: %d", kString16013, face);
+          break;
         }
       }
   
@@ -165,8 +213,35 @@ void Audio::setPosition(unsigned int face, Point origin) {
   }
 }
 
+void Audio::setPriority(int priority) {
+  _priority = priority;
+}
+
+void Audio::setRequested(bool requested) {
+  _isRequested = requested;
+}
+
 void Audio::setResource(std::string fileName) {
-  _resource.name = fileName;
+  if (SDL_LockMutex(_mutex) == 0) {
+    _resource.name = fileName;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+void Audio::setResourcePath() {
+  std::string path = config.path(kPathResources, "", kObjectAudio);
+  if (SDL_LockMutex(_mutex) == 0) {
+    _resource.path = path;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+void Audio::setStolen(bool stolen) {
+  _isStolen = stolen;
 }
   
 void Audio::setVarying(bool varying) {
@@ -178,54 +253,115 @@ void Audio::setVarying(bool varying) {
 ////////////////////////////////////////////////////////////
 
 void Audio::load() {
+  if (this->isLoaded())
+    return;
+  
+  AudioManager& audioManager = AudioManager::instance();
+  // May be reloaded by the manager's thread, so the path was resolved
+  // when requested
+  std::string fileToLoad;
+  std::string pathToLoad;
+  if (SDL_LockMutex(_mutex) == 0) {
+    fileToLoad = _randomizeFile(_resource.name);
+    pathToLoad = _resource.path + fileToLoad;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  
+  // The manager is always queried before locking the audio, in the same
+  // order as its thread does, so that both can never wait on each other
+  ALuint cachedBuffer = audioManager.acquireBuffer(pathToLoad);
+  AudioVoice* voice = audioManager.acquireVoice(this);
+  if (!voice) {
+    log.warning(kModAudio, "%s: %s", kString16011, fileToLoad.c_str());
+    if (cachedBuffer)
+      audioManager.releaseBuffer(cachedBuffer);
+    return;
+  }
+  
+  bool hasDecodedBuffer = false;
+  bool hasVoice = false;
+  
   if (SDL_LockMutex(_mutex) == 0) {
     if (!_isLoaded) {
-      std::string fileToLoad = _randomizeFile(_resource.name);
-      std::ifstream file(config.path(kPathResources,
-                                     fileToLoad, kObjectAudio).c_str(),
-                         std::ifstream::binary | std::ifstream::ate);
-      if (file.good()) {
-        _resource.dataSize = file.tellg();
-        _resource.data = new char[_resource.dataSize];
-        file.seekg(file.beg);
-        file.read(_resource.data, _resource.dataSize);
-        _resource.dataRead = 0;
-        
-        if (ov_open_callbacks(this, &_oggStream, NULL, 0, _oggCallbacks) < 0) {
-          log.error(kModAudio, "%s", kString16010);
-        }
-        
-        // We no longer require the file handle
-        file.close();
-        
-        // Get file info
-        vorbis_info* info = ov_info(&_oggStream, -1);
-        _channels = info->channels;
-        _rate = (ALsizei)info->rate;
-        
-        if (_channels == 1) {
-          _alFormat = AL_FORMAT_MONO16;
+      // Short clips already decoded skip the file entirely
+      _isCached = (cachedBuffer != 0);
+      
+      FILE* file = NULL;
+      if (!_isCached) {
+        file = fopen(pathToLoad.c_str(), "rb");
+      }
+      
+      if (_isCached || file) {
+        if (!_isCached) {
+          fseek(file, 0, SEEK_END);
+          _resource.dataSize = ftell(file);
+          fseek(file, 0, SEEK_SET);
+          _resource.handle = file;
           
-        } else if (_channels == 2 ) {
-          _alFormat = AL_FORMAT_STEREO16;
-        } else {
-          // Invalid number of channels
-          log.error(kModAudio, "%s: %s", kString16009, fileToLoad.c_str());
+          // Only the first pages are read here, the rest is streamed
+          if (ov_open_callbacks(this, &_oggStream, NULL, 0, _oggCallbacks) < 0) {
+            log.error(kModAudio, "%s: %s", kString16010, fileToLoad.c_str());
+            
+            // Vorbisfile leaves the file open when failing
+            fclose(file);
+            _resource.handle = NULL;
+            SDL_UnlockMutex(_mutex);
+            audioManager.releaseVoice(voice);
+            return;
+          }
+          
+          // Get file info
+          vorbis_info* info = ov_info(&_oggStream, -1);
+          _channels = info->channels;
+          _rate = (ALsizei)info->rate;
+          
+          if (_channels == 1) {
+            _alFormat = AL_FORMAT_MONO16;
+            
+          } else if (_channels == 2 ) {
+            _alFormat = AL_FORMAT_STEREO16;
+          } else {
+            // Invalid number of channels
+            log.error(kModAudio, "%s: %s", kString16009, fileToLoad.c_str());
+          }
+          
+          cachedBuffer = _decodeToBuffer();
+          if (cachedBuffer) {
+            // The decoder and file are no longer needed
+            ov_clear(&_oggStream);
+            _isCached = true;
+            hasDecodedBuffer = true;
+          }
         }
         
-        alGenBuffers(config.numOfAudioBuffers, _alBuffers);
-        alGenSources(1, &_alSource);
-        alSource3f(_alSource, AL_POSITION, 0.0f, 0.0f, 0.0f);
-        alSource3f(_alSource, AL_VELOCITY, 0.0f, 0.0f, 0.0f);
-        alSource3f(_alSource, AL_DIRECTION, 0.0f, 0.0f, 0.0f);
+        _voice = voice;
+        _alSource = voice->source;
+        std::memcpy(_alBuffers, voice->buffers, sizeof(_alBuffers));
         
-		int buffersRead = 0;
-        for (buffersRead = 0; buffersRead < config.numOfAudioBuffers; buffersRead++) {
-          if (_fillBuffer(&_alBuffers[buffersRead]) == kAudioStreamEOF) {
-            break;
+        if (_isCached) {
+          _cachedBuffer = cachedBuffer;
+          alSourcei(_alSource, AL_BUFFER, cachedBuffer);
+          alSourcei(_alSource, AL_LOOPING, _isLoopable ? AL_TRUE : AL_FALSE);
+        } else {
+          // Starting depth, which grows every time the source runs dry
+          _numOfBuffers = config.numOfAudioBuffers;
+          if (_numOfBuffers > kMaxAudioBuffers)
+            _numOfBuffers = kMaxAudioBuffers;
+          
+          // Playback time of a full buffer of 16-bit samples
+          _bufferDuration = static_cast<int>((static_cast<double>(config.audioBuffer) * 1000.0) /
+                                             (_rate * _channels * 2));
+          
+          int buffersRead = 0;
+          for (buffersRead = 0; buffersRead < _numOfBuffers; buffersRead++) {
+            if (_fillBuffer(&_alBuffers[buffersRead]) == kAudioStreamEOF) {
+              break;
+            }
           }
+          alSourceQueueBuffers(_alSource, buffersRead, _alBuffers);
         }
-        alSourceQueueBuffers(_alSource, buffersRead, _alBuffers);
         _verifyError("prebuffer");
         if (config.mute || this->fadeLevel() < 0.0) {
           alSourcef(_alSource, AL_GAIN, 0.0f);
@@ -234,6 +370,7 @@ void Audio::load() {
         }
         
         _isLoaded = true;
+        hasVoice = true;
         _verifyError("load");
       } else {
         log.error(kModAudio, "%s: %s", kString16008, fileToLoad.c_str());
@@ -243,6 +380,14 @@ void Audio::load() {
   } else {
     log.error(kModAudio, "%s", kString18002);
   }
+  
+  if (hasDecodedBuffer)
+    audioManager.cacheBuffer(pathToLoad, cachedBuffer);
+  else if (cachedBuffer && !hasVoice)
+    audioManager.releaseBuffer(cachedBuffer); // Already loaded, so not held after all
+  
+  if (!hasVoice)
+    audioManager.releaseVoice(voice);
 }
 
 void Audio::match(Audio* audioToMatch) {
@@ -253,8 +398,12 @@ void Audio::match(Audio* audioToMatch) {
 void Audio::play() {
   if (SDL_LockMutex(_mutex) == 0) {
     if (_isLoaded && (_state != kAudioPlaying)) {
-      if (_isMatched)
-        ov_time_seek(&_oggStream, _matchedAudio->cursor());
+      if (_isMatched) {
+        if (_isCached)
+          alSourcef(_alSource, AL_SEC_OFFSET, (ALfloat)_matchedAudio->cursor());
+        else
+          ov_time_seek(&_oggStream, _matchedAudio->cursor());
+      }
       
       if (_isVarying) {
         float p = ((rand() % 20) + 90) / 100.0f;
@@ -273,7 +422,11 @@ void Audio::play() {
 void Audio::pause() {
   if (SDL_LockMutex(_mutex) == 0) {
     if (_state == kAudioPlaying) {
-      alSourceStop(_alSource);
+      // Static buffers would otherwise restart from the beginning
+      if (_isCached)
+        alSourcePause(_alSource);
+      else
+        alSourceStop(_alSource);
       _state = kAudioPaused;
       _verifyError("pause");
     }
@@ -287,7 +440,10 @@ void Audio::stop() {
   if (SDL_LockMutex(_mutex) == 0) {
     if ((_state == kAudioPlaying) || (_state == kAudioPaused)) {
       alSourceStop(_alSource);
-      ov_raw_seek(&_oggStream, 0);
+      if (_isCached)
+        alSourceRewind(_alSource);
+      else
+        ov_raw_seek(&_oggStream, 0);
       _state = kAudioStopped;
       _verifyError("stop");
     }
@@ -298,18 +454,36 @@ void Audio::stop() {
 }
 
 void Audio::unload() {
+  AudioVoice* voice = NULL;
+  ALuint cachedBuffer = 0;
+  
   if (SDL_LockMutex(_mutex) == 0) {
     if (_isLoaded) {
       if (_state == kAudioPlaying) {
-        alSourceStop(_alSource);
-        ov_raw_seek(&_oggStream, 0);
+        if (!_isCached)
+          ov_raw_seek(&_oggStream, 0);
         _state = kAudioStopped;
       }
-      _emptyBuffers();
-      alDeleteSources(1, &_alSource);
-      alDeleteBuffers(config.numOfAudioBuffers, _alBuffers);
-      ov_clear(&_oggStream);
-      delete[] _resource.data;
+      
+      // Once stopped, this detaches both the cached buffer
+      // and any queued streaming buffers
+      alSourceStop(_alSource);
+      alSourcei(_alSource, AL_BUFFER, 0);
+      
+      // Also closes the file
+      if (!_isCached)
+        ov_clear(&_oggStream);
+      
+      if (_underruns > 0) {
+        log.warning(kModAudio, "%s: %s (%d)", kString16012,
+                    _resource.name.c_str(), _underruns);
+      }
+      
+      voice = _voice;
+      _voice = NULL;
+      cachedBuffer = _cachedBuffer;
+      _cachedBuffer = 0;
+      _isCached = false;
       _isLoaded = false;
       _verifyError("unload");
     }
@@ -317,21 +491,70 @@ void Audio::unload() {
   } else {
     log.error(kModAudio, "%s", kString18002);
   }
+  
+  // Must be done without holding our lock (see load)
+  if (voice)
+    AudioManager::instance().releaseVoice(voice);
+  if (cachedBuffer)
+    AudioManager::instance().releaseBuffer(cachedBuffer);
 }
 
-void Audio::update() {
+int Audio::update() {
+  int delay = kAudioMaxDelay;
+  
   if (SDL_LockMutex(_mutex) == 0) {
     if (_state == kAudioPlaying) {
-      int processed;
-      alGetSourcei(_alSource, AL_BUFFERS_PROCESSED, &processed);
-      while (processed--) {
-        ALuint buffer;
+      if (_isCached) {
+        // Nothing to stream, just notice when the clip is over
+        ALint alState;
+        alGetSourcei(_alSource, AL_SOURCE_STATE, &alState);
+        if (alState == AL_STOPPED) {
+          alSourceRewind(_alSource);
+          _state = kAudioStopped;
+        }
+      } else {
+        ALint alState;
+        alGetSourcei(_alSource, AL_SOURCE_STATE, &alState);
+        
+        int processed;
+        alGetSourcei(_alSource, AL_BUFFERS_PROCESSED, &processed);
+        while (processed--) {
+          ALuint buffer;
+          
+          alSourceUnqueueBuffers(_alSource, 1, &buffer);
+          _fillBuffer(&buffer);
+          alSourceQueueBuffers(_alSource, 1, &buffer);
+        }
         
-        alSourceUnqueueBuffers(_alSource, 1, &buffer);
-        _fillBuffer(&buffer);
-        alSourceQueueBuffers(_alSource, 1, &buffer);
+        if ((_state == kAudioPlaying) && (alState != AL_PLAYING)) {
+          // We didn't refill in time and the source stopped by itself,
+          // so go deeper from now on and resume
+          _underruns++;
+          
+          if (_numOfBuffers < kMaxAudioBuffers) {
+            int buffersToAdd = std::min(2, kMaxAudioBuffers - _numOfBuffers);
+            int buffersRead = 0;
+            for (buffersRead = 0; buffersRead < buffersToAdd; buffersRead++) {
+              if (_fillBuffer(&_alBuffers[_numOfBuffers + buffersRead]) != kAudioStreamOK)
+                break;
+            }
+            alSourceQueueBuffers(_alSource, buffersRead, &_alBuffers[_numOfBuffers]);
+            _numOfBuffers += buffersRead;
+          }
+          
+          if (_state == kAudioPlaying)
+            alSourcePlay(_alSource);
+          _verifyError("underrun");
+        }
+        
+        // Come back halfway through the next buffer
+        delay = std::max(1, _bufferDuration / 2);
       }
       
+      // Fades advance one step per update
+      if (this->isFading())
+        delay = 1;
+      
       // Run fade operations
       this->updateFade();
       
@@ -353,12 +576,100 @@ void Audio::update() {
   } else {
     log.error(kModAudio, "%s", kString18002);
   }
+  
+  return std::min(delay, static_cast<int>(kAudioMaxDelay));
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Measurements
+////////////////////////////////////////////////////////////
+
+std::size_t Audio::decodeStream(const std::string& path, AudioVoice* voice) {
+  std::size_t size = 0;
+  if (SDL_LockMutex(_mutex) == 0) {
+    FILE* file = NULL;
+    if (!_isLoaded)
+      file = fopen(path.c_str(), "rb");
+    
+    if (file) {
+      fseek(file, 0, SEEK_END);
+      _resource.dataSize = ftell(file);
+      fseek(file, 0, SEEK_SET);
+      _resource.handle = file;
+      
+      if (ov_open_callbacks(this, &_oggStream, NULL, 0, _oggCallbacks) < 0) {
+        // Vorbisfile leaves the file open when failing
+        fclose(file);
+        _resource.handle = NULL;
+      } else {
+        vorbis_info* info = ov_info(&_oggStream, -1);
+        _channels = info->channels;
+        _rate = (ALsizei)info->rate;
+        _alFormat = (_channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+        size = static_cast<std::size_t>(ov_pcm_total(&_oggStream, -1)) * _channels * 2;
+        
+        // Borrowed only while decoding
+        _voice = voice;
+        _alSource = voice->source;
+        while (_fillBuffer(&voice->buffers[0]) == kAudioStreamOK) {}
+        _voice = NULL;
+        
+        ov_clear(&_oggStream);
+      }
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  
+  return size;
 }
 
 ////////////////////////////////////////////////////////////
 // Implementation - Private methods
 ////////////////////////////////////////////////////////////
 
+ALuint Audio::_decodeToBuffer() {
+  ogg_int64_t samples = ov_pcm_total(&_oggStream, -1);
+  if (samples <= 0)
+    return 0;
+  
+  // 16-bit samples
+  ogg_int64_t size = samples * _channels * 2;
+  if (size > config.audioCacheLimit)
+    return 0;
+  
+  std::vector<char> data(static_cast<std::size_t>(size));
+  int decoded = 0;
+  while (decoded < size) {
+    int section;
+    long result = ov_read(&_oggStream, &data[decoded], static_cast<int>(size) - decoded,
+                          0, 2, 1, &section);
+    if (result > 0) {
+      decoded += static_cast<int>(result);
+    } else if (result == 0) {
+      break;
+    } else if (result == OV_HOLE) {
+      continue;
+    } else {
+      // Leave it to the streaming path to report the error
+      ov_raw_seek(&_oggStream, 0);
+      return 0;
+    }
+  }
+  
+  ALuint buffer;
+  alGenBuffers(1, &buffer);
+  alBufferData(buffer, _alFormat, &data[0], decoded, _rate);
+  if (!_verifyError("cache")) {
+    alDeleteBuffers(1, &buffer);
+    ov_raw_seek(&_oggStream, 0);
+    return 0;
+  }
+  
+  return buffer;
+}
+
 int Audio::_fillBuffer(ALuint* buffer) {
   // This is a failsafe; if this is true, we won't attempt to stream anymore
   static bool _hasStreamingError = false;
@@ -371,8 +682,11 @@ int Audio::_fillBuffer(ALuint* buffer) {
       bufferSize = static_cast<int>(_resource.dataSize);
     }
     
-    char* data;
-    data = new char[bufferSize];
+    std::vector<char>& scratch = _voice->scratch;
+    if (static_cast<int>(scratch.size()) < bufferSize)
+      scratch.resize(bufferSize);
+    
+    char* data = &scratch[0];
     int size = 0;
     while (size < bufferSize) {
       int section;
@@ -401,29 +715,12 @@ int Audio::_fillBuffer(ALuint* buffer) {
       }
     }
     alBufferData(*buffer, _alFormat, data, size, _rate);
-    delete[] data;
     return kAudioStreamOK;
   } else {
     return kAudioGenericError;
   }
 }
 
-void Audio::_emptyBuffers() {
-  ALint alState;
-  alGetSourcei(_alSource, AL_SOURCE_STATE, &alState);
-  
-  if (alState != AL_PLAYING) {
-    int queued;
-    alGetSourcei(_alSource, AL_BUFFERS_PROCESSED, &queued);
-    
-    while (queued--) {
-      ALuint buffer;
-      alSourceUnqueueBuffers(_alSource, 1, &buffer);
-      _verifyError("unqueue");
-    }
-  }
-}
-
 std::string Audio::_randomizeFile(const std::string &fileName) {
   // Was extension specified?
   if (fileName.find(".ogg") != std::string::npos ) {
@@ -456,54 +753,24 @@ ALboolean Audio::_verifyError(const std::string &operation) {
 std::size_t Audio::_oggRead(void* ptr, std::size_t size, std::size_t nmemb,
                             void* datasource) {
   Audio* audio = static_cast<Audio*>(datasource);
-  std::size_t nSize = size * nmemb;
-  
-  if ((audio->_resource.dataRead + nSize) > audio->_resource.dataSize)
-    nSize = audio->_resource.dataSize - audio->_resource.dataRead;
-  
-  std::memcpy(ptr, audio->_resource.data + audio->_resource.dataRead, nSize);
-  audio->_resource.dataRead += nSize;
-  return nSize;
+  return fread(ptr, size, nmemb, audio->_resource.handle);
 }
 
 int Audio::_oggSeek(void* datasource, ogg_int64_t offset, int whence) {
   Audio* audio = static_cast<Audio*>(datasource);
-  
-  switch (whence) {
-    case SEEK_SET: {
-      audio->_resource.dataRead = offset;
-      break;
-    }
-    case SEEK_CUR: {
-      audio->_resource.dataRead += offset;
-      break;
-    }
-    case SEEK_END: {
-      audio->_resource.dataRead = audio->_resource.dataSize - offset;
-      break;
-    }
-    default: {
-      assert(false);
-    }
-  }
-  
-  if (audio->_resource.dataRead > audio->_resource.dataSize) {
-    audio->_resource.dataRead = 0;
-    return -1;
-  }
-  
-  return 0;
+  return fseek(audio->_resource.handle, (long)offset, whence);
 }
 
 int Audio::_oggClose(void* datasource) {
   Audio* audio = static_cast<Audio*>(datasource);
-  audio->_resource.dataRead = 0;
-  return 0;
+  int result = fclose(audio->_resource.handle);
+  audio->_resource.handle = NULL;
+  return result;
 }
 
 long Audio::_oggTell(void* datasource) {
   Audio* audio = static_cast<Audio*>(datasource);
-  return audio->_resource.dataRead;
+  return ftell(audio->_resource.handle);
 }
   
 }
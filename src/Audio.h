@@ -60,6 +60,13 @@ enum AudioBufferState {
   kAudioStreamOK = 1
 };
 
+// Higher priorities may steal the voice of lower ones
+enum AudioPriorities {
+  kAudioPriorityEffect,
+  kAudioPriorityAmbience,
+  kAudioPriorityFeed
+};
+
 enum AudioStates {
   kAudioInitial,
   kAudioPlaying,
@@ -67,11 +74,26 @@ enum AudioStates {
   kAudioStopped
 };
 
+class Audio;
+
+// Source and streaming buffers preallocated by the manager
+struct AudioVoice {
+  ALuint source;
+  ALuint buffers[kMaxAudioBuffers];
+  std::vector<char> scratch; // Reused for every decoded buffer
+  Audio* owner;
+};
+
+// Longest the streaming job may be delayed, in milliseconds, so that
+// new fades and requests are noticed even if nobody expedites it
+#define kAudioMaxDelay 50
+
+// Compressed data is read from the file in chunks as the decoder needs it
 struct Resource {
   int index;
   std::string name;
-  char* data;
-  std::size_t dataRead;
+  std::string path; // Where the name is looked for, resolved on request
+  FILE* handle;
   std::size_t dataSize;
 };
 
@@ -86,20 +108,32 @@ class Audio : public Object {
   
   // Checks
   bool doesAutoplay();
+  bool isActive();
   bool isLoaded();
   bool isLoopable();
   bool isPlaying();
+  bool isRequested();
+  bool isStolen();
   bool isVarying();
   
   // Gets
   double cursor(); // For match function
+  int priority();
   int state();
+  int underruns();
   
   // Sets
+  void setActive(bool active); // Only the manager should set this
   void setAutoplay(bool autoplay);
   void setLoopable(bool loopable);
   void setPosition(unsigned int face, Point origin);
+  void setPriority(int priority);
+  void setRequested(bool requested); // Only the manager should set this
   void setResource(std::string fileName);
+  // Resolves where the resource is looked for. Depends on the script
+  // running, so only the main thread may call it, before loading.
+  void setResourcePath();
+  void setStolen(bool stolen); // Only the manager should set this
   void setVarying(bool varying);
   
   // State changes
@@ -109,7 +143,12 @@ class Audio : public Object {
   void pause();
   void stop();
   void unload();
-  void update();
+  int update(); // Returns the milliseconds until the next update is due
+  
+  // Measurements
+  // Streams the whole file through the voice's first buffer without
+  // playing it, and returns the bytes decoded. Not for loaded audios.
+  std::size_t decodeStream(const std::string& path, AudioVoice* voice);
   
  private:
   Config& config;
@@ -122,15 +161,25 @@ class Audio : public Object {
   Resource _resource;
   
   bool _doesAutoplay;
+  bool _isActive;
+  bool _isCached;
   bool _isLoaded;
   bool _isLoopable;
   bool _isMatched;
+  bool _isRequested; // Retained once by the manager until it's cleared
+  bool _isStolen;
   bool _isVarying;
+  int _priority;
   int _state;
+  AudioVoice* _voice;
   
   ALuint _alBuffers[kMaxAudioBuffers];
+  int _bufferDuration;
+  int _numOfBuffers;
+  int _underruns;
 	ALenum _alFormat;
   ALuint _alSource;
+  ALuint _cachedBuffer; // Held from the manager while loaded
   int _channels;
   ALsizei _rate;
   
@@ -138,8 +187,8 @@ class Audio : public Object {
   OggVorbis_File _oggStream;
   
   // Private methods
+  ALuint _decodeToBuffer();
   int _fillBuffer(ALuint* buffer);
-  void _emptyBuffers();
   std::string _randomizeFile(const std::string &fileName);
   ALboolean _verifyError(const std::string &operation);
   
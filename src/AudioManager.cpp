@@ -17,9 +17,13 @@
 
 #include <SDL2/SDL_timer.h>
 
+#include <algorithm>
+
 #include "AudioManager.h"
 #include "Config.h"
+#include "JobManager.h"
 #include "Log.h"
+#include "Profiler.h"
 
 namespace dagon {
 
@@ -29,10 +33,20 @@ namespace dagon {
 
 AudioManager::AudioManager()  :
 config(Config::instance()),
+jobManager(JobManager::instance()),
 log(Log::instance())
 {
   _isInitialized = false;
   _isRunning = false;
+  
+  for (int i = 0; i < kMaxNumberOfAudios; i++)
+    _voices[i].owner = NULL;
+  
+  _cachedBytes = 0;
+  _cacheTime = 0;
+  _delay = kAudioMaxDelay;
+  _job = 0;
+  _isWakePending = false;
   _mutex = SDL_CreateMutex();
   if (!_mutex)
     log.error(kModAudio, "%s", kString18001);
@@ -51,70 +65,210 @@ AudioManager::~AudioManager() {
 ////////////////////////////////////////////////////////////
 
 void AudioManager::clear() {
+  if (_isInitialized) {
+    if (SDL_LockMutex(_mutex) == 0) {
+      // Only our own reference is released, so audios held by others,
+      // like those of the room, carry on untouched
+      std::vector<Audio*>::iterator it = _arrayOfActiveAudios.begin();
+      while (it != _arrayOfActiveAudios.end()) {
+        if ((*it)->isRequested()) {
+          (*it)->setRequested(false);
+          (*it)->release();
+        }
+        
+        ++it;
+      }
+      
+      // Stolen ones are given up unless still held
+      std::size_t i = 0;
+      while (i < _arrayOfStolenAudios.size()) {
+        Audio* audio = _arrayOfStolenAudios[i];
+        if (audio->isRequested()) {
+          audio->setRequested(false);
+          audio->release();
+        }
+        
+        if (audio->retainCount() == 0) {
+          audio->setStolen(false);
+          _arrayOfStolenAudios.erase(_arrayOfStolenAudios.begin() + i);
+          continue;
+        }
+        
+        ++i;
+      }
+      SDL_UnlockMutex(_mutex);
+    } else {
+      log.error(kModAudio, "%s", kString18002);
+    }
+  }
+}
+
+void AudioManager::flush() {
   if (_isInitialized) {
     if (!_arrayOfActiveAudios.empty()) {
-      std::vector<Audio*>::iterator it;
       if (SDL_LockMutex(_mutex) == 0) {
-        it = _arrayOfActiveAudios.begin();
-        while (it != _arrayOfActiveAudios.end()) {
-          (*it)->release();
+        std::size_t i = 0;
+        while (i < _arrayOfActiveAudios.size()) {
+          Audio* audio = _arrayOfActiveAudios[i];
           
-          ++it;
+          // TODO: Automatically flush stopped and non-retained audios after
+          // n update cycles
+          if (audio->state() == kAudioStopped) {
+            audio->unload();
+            audio->setActive(false);
+            
+            // Order doesn't matter, so swap with the last one and check this slot again
+            _arrayOfActiveAudios[i] = _arrayOfActiveAudios.back();
+            _arrayOfActiveAudios.pop_back();
+            continue;
+          }
+          
+          if ((audio->retainCount() == 0) && (audio->state() == kAudioPlaying))
+            audio->fadeOut();
+          
+          ++i;
         }
         SDL_UnlockMutex(_mutex);
       } else {
         log.error(kModAudio, "%s", kString18002);
       }
+      
+      // Fades may have just started
+      _wake();
     }
   }
 }
 
-void AudioManager::flush() {
-  if (_isInitialized) {
-    if (!_arrayOfActiveAudios.empty()) {
-      std::vector<Audio*>::iterator it;
-      bool done = false;
-      while (!done) {
-        if (SDL_LockMutex(_mutex) == 0) {
-          it = _arrayOfActiveAudios.begin();
-          done = true;
-          while ((it != _arrayOfActiveAudios.end())) {
-            if ((*it)->retainCount() == 0) {
-              if ((*it)->state() == kAudioStopped) { // Had to move this outside the switch
-                // TODO: Automatically flush stopped and non-retained audios after
-                // n update cycles
-                (*it)->unload();
-                _arrayOfActiveAudios.erase(it);
-                done = false;
-                break;
-              }
-              else {
-                switch ((*it)->state()) {
-                  case kAudioPlaying:
-                    (*it)->fadeOut();
-                    ++it;
-                    break;
-                  case kAudioPaused:
-                  default:
-                    ++it;
-                    break;
-                }
-              }
-            }
-            else if ((*it)->state() == kAudioStopped) {
-              (*it)->unload();
-                    _arrayOfActiveAudios.erase(it);
-                    done = false;
-                    break;
-            }
-            else ++it;
-          }
-          SDL_UnlockMutex(_mutex);
-        } else {
-          log.error(kModAudio, "%s", kString18002);
+AudioVoice* AudioManager::acquireVoice(Audio* forAudio) {
+  AudioVoice* voice = NULL;
+  
+  if (!_isInitialized)
+    return NULL;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    for (int i = 0; i < kMaxNumberOfAudios; i++) {
+      if (!_voices[i].owner) {
+        voice = &_voices[i];
+        break;
+      }
+    }
+    
+    if (!voice) {
+      // Idle voices go first, then playing ones of lower priority
+      AudioVoice* victim = NULL;
+      int lowestScore = (forAudio->priority() * 2) + 1;
+      
+      for (int i = 0; i < kMaxNumberOfAudios; i++) {
+        Audio* owner = _voices[i].owner;
+        int score = owner->priority() * 2;
+        if (owner->state() == kAudioPlaying)
+          score++;
+        
+        if (score < lowestScore) {
+          lowestScore = score;
+          victim = &_voices[i];
+        }
+      }
+      
+      if (victim) {
+        // Unloading gives the voice back to us
+        Audio* owner = victim->owner;
+        if ((owner->state() == kAudioPlaying) && !owner->isStolen()) {
+          owner->setStolen(true);
+          _arrayOfStolenAudios.push_back(owner);
+        }
+        owner->stop();
+        owner->unload();
+        voice = victim;
+        
+        // No longer active. Stolen ones keep their references until
+        // clear(), so they can play again meanwhile.
+        if (owner->isActive()) {
+          owner->setActive(false);
+          _arrayOfActiveAudios.erase(std::find(_arrayOfActiveAudios.begin(),
+                                               _arrayOfActiveAudios.end(), owner));
+        }
+        if (!owner->isStolen() && owner->isRequested()) {
+          owner->setRequested(false);
+          owner->release();
         }
       }
     }
+    
+    if (voice)
+      voice->owner = forAudio;
+    
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  
+  return voice;
+}
+
+ALuint AudioManager::acquireBuffer(const std::string &forFile) {
+  ALuint buffer = 0;
+  if (SDL_LockMutex(_mutex) == 0) {
+    std::map<std::string, ALuint>::iterator it = _cachedBuffers.find(forFile);
+    if (it != _cachedBuffers.end()) {
+      buffer = it->second;
+      AudioCachedBuffer& info = _cachedBufferInfos[buffer];
+      info.numOfUsers++;
+      info.lastUse = ++_cacheTime;
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  return buffer;
+}
+
+void AudioManager::cacheBuffer(const std::string &forFile, ALuint buffer) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    // Two audios may decode the same file at once. The earlier buffer is
+    // then only found by those holding it.
+    AudioCachedBuffer info;
+    info.file = forFile;
+    alGetBufferi(buffer, AL_SIZE, &info.size);
+    info.numOfUsers = 1;
+    info.lastUse = ++_cacheTime;
+    _cachedBuffers[forFile] = buffer;
+    _cachedBufferInfos[buffer] = info;
+    _cachedBytes += info.size;
+    
+    _evictBuffers();
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+void AudioManager::releaseBuffer(ALuint buffer) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    std::map<ALuint, AudioCachedBuffer>::iterator it = _cachedBufferInfos.find(buffer);
+    if ((it != _cachedBufferInfos.end()) && (it->second.numOfUsers > 0)) {
+      it->second.numOfUsers--;
+      _evictBuffers();
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+void AudioManager::releaseVoice(AudioVoice* voice) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    // Leave the source as if it was just generated
+    alSourcef(voice->source, AL_GAIN, 1.0f);
+    alSourcef(voice->source, AL_PITCH, 1.0f);
+    alSourcei(voice->source, AL_LOOPING, AL_FALSE);
+    alSource3f(voice->source, AL_POSITION, 0.0f, 0.0f, 0.0f);
+    alSource3f(voice->source, AL_VELOCITY, 0.0f, 0.0f, 0.0f);
+    alSource3f(voice->source, AL_DIRECTION, 0.0f, 0.0f, 0.0f);
+    voice->owner = NULL;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
   }
 }
 
@@ -200,6 +354,15 @@ void AudioManager::init() {
   alListenerfv(AL_VELOCITY, listenerVel);
   alListenerfv(AL_ORIENTATION, listenerOri);
   
+  // Allocate every voice upfront so that playing never has to
+  for (int i = 0; i < kMaxNumberOfAudios; i++) {
+    alGenSources(1, &_voices[i].source);
+    alGenBuffers(kMaxAudioBuffers, _voices[i].buffers);
+    alSource3f(_voices[i].source, AL_POSITION, 0.0f, 0.0f, 0.0f);
+    alSource3f(_voices[i].source, AL_VELOCITY, 0.0f, 0.0f, 0.0f);
+    alSource3f(_voices[i].source, AL_DIRECTION, 0.0f, 0.0f, 0.0f);
+  }
+  
   ALint error = alGetError();
   
   if (error != AL_NO_ERROR) {
@@ -213,10 +376,7 @@ void AudioManager::init() {
   _isInitialized = true;
   _isRunning = true;
   
-  _thread = SDL_CreateThread(_runThread, "AudioManager", (void*)NULL);
-  if (!_thread) {
-    log.error(kModAudio, "%s:%s", kString18003, SDL_GetError());
-  }
+  _job = jobManager.submit(_runJob, NULL, kJobPriorityHigh);
 }
 
 void AudioManager::registerAudio(Audio* target) {
@@ -224,26 +384,38 @@ void AudioManager::registerAudio(Audio* target) {
 }
 
 void AudioManager::requestAudio(Audio* target) {
-  if (_arrayOfActiveAudios.size() >= kMaxNumberOfAudios) 
-	  return;
-  
   if (!target->isLoaded()) {
+    target->setResourcePath();
     target->load();
+    
+    // Out of voices
+    if (!target->isLoaded())
+      return;
   }
-  target->retain();
 
-  bool isActive = false;
-  isActive = std::find(_arrayOfActiveAudios.begin(), _arrayOfActiveAudios.end(),
-                       target) != _arrayOfActiveAudios.end();
   // If the audio is not active, then it's added to
-  // that vector
-  if (!isActive) {
-    if (SDL_LockMutex(_mutex) == 0) {
+  // that vector. We hold one reference until the next clear(),
+  // however many times it's requested.
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (!target->isRequested()) {
+      target->setRequested(true);
+      target->retain();
+    }
+    
+    if (!target->isActive()) {
+      target->setActive(true);
       _arrayOfActiveAudios.push_back(target);
-      SDL_UnlockMutex(_mutex);
-    } else {
-      log.error(kModAudio, "%s", kString18002);
     }
+    
+    // Requested before its voice came back
+    if (target->isStolen()) {
+      target->setStolen(false);
+      _arrayOfStolenAudios.erase(std::find(_arrayOfStolenAudios.begin(),
+                                           _arrayOfStolenAudios.end(), target));
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
   }
   
   // FIXME: Not very elegant. Must implement a state condition for
@@ -251,6 +423,8 @@ void AudioManager::requestAudio(Audio* target) {
   if (target->state() == kAudioPaused) {
     target->play();
   }
+  
+  _wake();
 }
 
 void AudioManager::setOrientation(float* orientation) {
@@ -266,9 +440,14 @@ void AudioManager::terminate() {
   // Each audio object should unregister itself if
   // destroyed
   _isRunning = false;
+  _wake();
   
-  int threadReturnValue;
-  SDL_WaitThread(_thread, &threadReturnValue);
+  // An update already in progress may still submit the job once more
+  int job;
+  do {
+    job = _job;
+    jobManager.wait(job);
+  } while (job != _job);
   
   if (!_arrayOfAudios.empty()) {
     if (SDL_LockMutex(_mutex) == 0) {
@@ -286,6 +465,22 @@ void AudioManager::terminate() {
   
   // Now we shut down OpenAL completely
   if (_isInitialized) {
+    for (int i = 0; i < kMaxNumberOfAudios; i++) {
+      alDeleteSources(1, &_voices[i].source);
+      alDeleteBuffers(kMaxAudioBuffers, _voices[i].buffers);
+    }
+    
+    // Cached buffers are no longer attached to any source
+    std::map<ALuint, AudioCachedBuffer>::iterator it = _cachedBufferInfos.begin();
+    while (it != _cachedBufferInfos.end()) {
+      ALuint buffer = it->first;
+      alDeleteBuffers(1, &buffer);
+      ++it;
+    }
+    _cachedBuffers.clear();
+    _cachedBufferInfos.clear();
+    _cachedBytes = 0;
+    
     alcMakeContextCurrent(NULL);
     alcDestroyContext(_alContext);
     alcCloseDevice(_alDevice);
@@ -295,11 +490,14 @@ void AudioManager::terminate() {
 // Asynchronous method
 bool AudioManager::update() {
   if (_isRunning) {
+    int delay = kAudioMaxDelay;
     if (!_arrayOfActiveAudios.empty()) {
       if (SDL_LockMutex(_mutex) == 0) {
         std::vector<Audio*>::iterator it = _arrayOfActiveAudios.begin();
         while (it != _arrayOfActiveAudios.end()) {
-          (*it)->update();
+          int audioDelay = (*it)->update();
+          if (audioDelay < delay)
+            delay = audioDelay;
           ++it;
         }
         SDL_UnlockMutex(_mutex);
@@ -307,6 +505,11 @@ bool AudioManager::update() {
         log.error(kModAudio, "%s", kString18002);
       }
     }
+    
+    if (!_arrayOfStolenAudios.empty())
+      _restoreStolen();
+    
+    _delay = delay;
     return true;
   }
   return false;
@@ -316,11 +519,126 @@ bool AudioManager::update() {
 // Implementation - Private methods
 ////////////////////////////////////////////////////////////
 
-int AudioManager::_runThread(void *ptr) {
-  while (AudioManager::instance().update()) {
-    SDL_Delay(1);
+// Must be called with the mutex locked. Buffers still attached to a
+// source can't be deleted, so the cache may stay over its size. Those
+// replaced by a newer one for the same file go as soon as they're free.
+void AudioManager::_evictBuffers() {
+  for (;;) {
+    std::map<ALuint, AudioCachedBuffer>::iterator oldest = _cachedBufferInfos.end();
+    std::map<ALuint, AudioCachedBuffer>::iterator it = _cachedBufferInfos.begin();
+    while (it != _cachedBufferInfos.end()) {
+      std::map<ALuint, AudioCachedBuffer>::iterator info = it++;
+      if (info->second.numOfUsers > 0)
+        continue;
+      
+      std::map<std::string, ALuint>::iterator file = _cachedBuffers.find(info->second.file);
+      if ((file == _cachedBuffers.end()) || (file->second != info->first))
+        _deleteBuffer(info);
+      else if ((oldest == _cachedBufferInfos.end()) ||
+               (info->second.lastUse < oldest->second.lastUse))
+        oldest = info;
+    }
+    
+    if ((_cachedBytes <= config.audioCacheSize) || (oldest == _cachedBufferInfos.end()))
+      break;
+    
+    _cachedBuffers.erase(oldest->second.file);
+    _deleteBuffer(oldest);
+  }
+}
+
+// Must be called with the mutex locked
+void AudioManager::_deleteBuffer(std::map<ALuint, AudioCachedBuffer>::iterator info) {
+  ALuint buffer = info->first;
+  _cachedBytes -= info->second.size;
+  _cachedBufferInfos.erase(info);
+  alDeleteBuffers(1, &buffer);
+}
+
+// Plays again the first audio whose voice was stolen, if a voice is free
+// and something still holds it
+void AudioManager::_restoreStolen() {
+  Audio* target = NULL;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    while (!target && !_arrayOfStolenAudios.empty()) {
+      bool isVoiceFree = false;
+      for (int i = 0; i < kMaxNumberOfAudios; i++) {
+        if (!_voices[i].owner) {
+          isVoiceFree = true;
+          break;
+        }
+      }
+      if (!isVoiceFree)
+        break;
+      
+      target = _arrayOfStolenAudios.front();
+      target->setStolen(false);
+      _arrayOfStolenAudios.erase(_arrayOfStolenAudios.begin());
+      if (target->retainCount() == 0)
+        target = NULL;
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  
+  if (!target)
+    return;
+  
+  // Loading may take a while, so it's done without holding our lock
+  target->load();
+  if (!target->isLoaded())
+    return;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (!target->isActive()) {
+      target->setActive(true);
+      _arrayOfActiveAudios.push_back(target);
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  
+  target->play();
+}
+
+// Expedites the streaming job if it's waiting for buffers to be due
+void AudioManager::_wake() {
+  // The job may be running, and about to submit itself again with a delay
+  // from before this. It's told under the same lock, so it's never missed.
+  if (SDL_LockMutex(_mutex) == 0) {
+    _isWakePending = true;
+    jobManager.expedite(_job);
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+void AudioManager::_runJob(void *ptr) {
+  AudioManager& audioManager = AudioManager::instance();
+  ProfilerScope scope(kZoneAudio);
+  
+  // Only wakes from now on may be missed by this update
+  if (SDL_LockMutex(audioManager._mutex) == 0) {
+    audioManager._isWakePending = false;
+    SDL_UnlockMutex(audioManager._mutex);
+  } else {
+    audioManager.log.error(kModAudio, "%s", kString18002);
+  }
+  
+  if (audioManager.update()) {
+    if (SDL_LockMutex(audioManager._mutex) == 0) {
+      int delay = audioManager._isWakePending ? 0 : audioManager._delay;
+      audioManager._job = audioManager.jobManager.submit(_runJob, NULL, kJobPriorityHigh,
+                                                         0, delay);
+      SDL_UnlockMutex(audioManager._mutex);
+    } else {
+      audioManager.log.error(kModAudio, "%s", kString18002);
+    }
   }
-  return 0;
 }
   
 }
@@ -18,6 +18,9 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <map>
+#include <string>
+
 #include "Audio.h"
 #include "Platform.h"
 
@@ -30,7 +33,6 @@
 #endif
 
 #include <SDL2/SDL_mutex.h>
-#include <SDL2/SDL_thread.h>
 
 namespace dagon {
 
@@ -41,28 +43,50 @@ namespace dagon {
 #define kMaxNumberOfAudios 32
 
 class Config;
+class JobManager;
 class Log;
 
+// Clip decoded by the cache, held by every audio it's attached to
+struct AudioCachedBuffer {
+  std::string file;
+  ALint size;
+  int numOfUsers;
+  unsigned int lastUse;
+};
+
 ////////////////////////////////////////////////////////////
 // Interface - Singleton class
 ////////////////////////////////////////////////////////////
 
 class AudioManager {
   Config& config;
+  JobManager& jobManager;
   Log& log;
   
   ALCdevice* _alDevice;
   ALCcontext* _alContext;
   SDL_mutex* _mutex;
-  SDL_Thread* _thread;
+  int _delay;
+  int _job; // Streaming job, submits itself again when buffers are due
+  bool _isWakePending; // Woken while updating, so it's due right away
   
   std::vector<Audio*> _arrayOfAudios;
   std::vector<Audio*> _arrayOfActiveAudios;
+  std::vector<Audio*> _arrayOfStolenAudios; // Were playing, while still held
+  std::map<std::string, ALuint> _cachedBuffers; // Latest for each file
+  std::map<ALuint, AudioCachedBuffer> _cachedBufferInfos;
+  int _cachedBytes;
+  unsigned int _cacheTime; // Counts uses, to tell the least recent one
+  AudioVoice _voices[kMaxNumberOfAudios];
   
   bool _isInitialized;
   bool _isRunning;
   
-  static int _runThread(void *ptr);
+  void _deleteBuffer(std::map<ALuint, AudioCachedBuffer>::iterator info);
+  void _evictBuffers();
+  void _restoreStolen();
+  void _wake();
+  static void _runJob(void *ptr);
   
   AudioManager();
   AudioManager(AudioManager const&);
@@ -76,12 +100,27 @@ public:
   }
   
   // These two methods have similar purposes: clear() notifies the manager
-  // that the engine is about to load a new node, which prepares all
-  // active audios for release. flush() effectively unloads every audio
-  // that is no longer needed.
+  // that the engine is about to load a new node, which releases the
+  // reference taken by requestAudio(). flush() effectively unloads every
+  // audio that is no longer needed, and fades out those nobody holds.
   void clear();
   void flush();
   
+  // Short clips are fully decoded once and shared by every audio
+  // that resolves to the same file. Audios hold the buffer they get or
+  // cache until releasing it. Once the cache outgrows its size, buffers
+  // no longer held are deleted, least recently used first.
+  ALuint acquireBuffer(const std::string &forFile);
+  void cacheBuffer(const std::string &forFile, ALuint buffer);
+  void releaseBuffer(ALuint buffer);
+  
+  // Voices are preallocated on init. When all of them are taken, the
+  // one with the lowest priority is stolen if below the requester. Its
+  // audio is no longer active, and plays again once a voice is free.
+  // NOTE: Never call these while holding the lock of an audio.
+  AudioVoice* acquireVoice(Audio* forAudio);
+  void releaseVoice(AudioVoice* voice);
+  
   void init();
   void registerAudio(Audio* target);
   void requestAudio(Audio* target);
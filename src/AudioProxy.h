@@ -34,6 +34,7 @@ namespace dagon {
 class AudioProxy : public ObjectProxy {
 public:
   static const char className[];
+  static const int objectType = kObjectAudio;
   static Luna<AudioProxy>::RegType methods[];
   
   // Constructor
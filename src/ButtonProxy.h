@@ -37,6 +37,7 @@ namespace dagon {
 class ButtonProxy : public ObjectProxy {
 public:
   static const char className[];
+  static const int objectType = kObjectButton;
   static Luna<ButtonProxy>::RegType methods[];
   
   // Constructor
@@ -27,106 +27,121 @@
 
 namespace dagon {
 
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+enum CameraLibProperties {
+  kCameraLibBreathe,
+  kCameraLibFov,
+  kCameraLibHorizontal,
+  kCameraLibHorizontalLimit,
+  kCameraLibInertia,
+  kCameraLibNeutralZone,
+  kCameraLibSpeed,
+  kCameraLibSmooth,
+  kCameraLibVertical,
+  kCameraLibVerticalLimit,
+  kCameraLibWalk,
+  kCameraLibNumOfProperties
+};
+
+// Same order as above
+static const char* kCameraLibPropertyNames[] = {
+  "breathe",
+  "fov",
+  "horizontal",
+  "horizontalLimit",
+  "inertia",
+  "neutralZone",
+  "speed",
+  "smooth",
+  "vertical",
+  "verticalLimit",
+  "walk",
+  NULL
+};
+
 ////////////////////////////////////////////////////////////
 // Interface
 ////////////////////////////////////////////////////////////
 
 static int CameraLibGet(lua_State *L) {
-  const char *key = luaL_checkstring(L, 2);
-  
-  if (strcmp(key, "breathe") == 0) {
-    lua_pushboolean(L, CameraManager::instance().canBreathe());
-    return 1;
-  }
-  
-  if (strcmp(key, "fov") == 0) {
-    lua_pushnumber(L, CameraManager::instance().fieldOfView());
-    return 1;
-  }
-  
-  if (strcmp(key, "horizontal") == 0) {
-    lua_pushnumber(L, CameraManager::instance().angleHorizontal());
-    return 1;
-  }
-  
-  if (strcmp(key, "horizontalLimit") == 0) {
-    lua_pushnumber(L, CameraManager::instance().horizontalLimit());
-    return 1;
-  }
-  
-  if (strcmp(key, "inertia") == 0) {
-    lua_pushnumber(L, CameraManager::instance().inertia());
-    return 1;
-  }
-  
-  if (strcmp(key, "neutralZone") == 0) {
-    lua_pushnumber(L, CameraManager::instance().neutralZone());
-    return 1;
-  }
-  
-  
-  if (strcmp(key, "speed") == 0) {
-    lua_pushnumber(L, CameraManager::instance().maxSpeed());
-    return 1;
-  }
-  
-  if (strcmp(key, "smooth") == 0) {
-    lua_pushnumber(L, CameraManager::instance().speedFactor());
-    return 1;
-  }
-  
-  if (strcmp(key, "vertical") == 0) {
-    lua_pushnumber(L, CameraManager::instance().angleVertical());
-    return 1;
-  }
-  
-  if (strcmp(key, "verticalLimit") == 0) {
-    lua_pushnumber(L, CameraManager::instance().verticalLimit());
-    return 1;
-  }
-  
-  if (strcmp(key, "walk") == 0) {
-    lua_pushboolean(L, CameraManager::instance().canWalk());
-    return 1;
+  switch (DGToProperty(L, 2)) {
+    case kCameraLibBreathe:
+      lua_pushboolean(L, CameraManager::instance().canBreathe());
+      return 1;
+    case kCameraLibFov:
+      lua_pushnumber(L, CameraManager::instance().fieldOfView());
+      return 1;
+    case kCameraLibHorizontal:
+      lua_pushnumber(L, CameraManager::instance().angleHorizontal());
+      return 1;
+    case kCameraLibHorizontalLimit:
+      lua_pushnumber(L, CameraManager::instance().horizontalLimit());
+      return 1;
+    case kCameraLibInertia:
+      lua_pushnumber(L, CameraManager::instance().inertia());
+      return 1;
+    case kCameraLibNeutralZone:
+      lua_pushnumber(L, CameraManager::instance().neutralZone());
+      return 1;
+    case kCameraLibSpeed:
+      lua_pushnumber(L, CameraManager::instance().maxSpeed());
+      return 1;
+    case kCameraLibSmooth:
+      lua_pushnumber(L, CameraManager::instance().speedFactor());
+      return 1;
+    case kCameraLibVertical:
+      lua_pushnumber(L, CameraManager::instance().angleVertical());
+      return 1;
+    case kCameraLibVerticalLimit:
+      lua_pushnumber(L, CameraManager::instance().verticalLimit());
+      return 1;
+    case kCameraLibWalk:
+      lua_pushboolean(L, CameraManager::instance().canWalk());
+      return 1;
   }
   
   return 0;
 }
 
 static int CameraLibSet(lua_State *L) {
-  const char *key = luaL_checkstring(L, 2);
-  
-  if (strcmp(key, "breathe") == 0)
-    CameraManager::instance().setBreathe((bool)lua_toboolean(L, 3));
-  if (strcmp(key, "fov") == 0)
-    CameraManager::instance().setFieldOfView(static_cast<float>(lua_tonumber(L, 3)));
-  
-  if (strcmp(key, "horizontal") == 0)
-    CameraManager::instance().setAngleHorizontal(static_cast<float>(lua_tonumber(L, 3)));
-
-  if (strcmp(key, "horizontalLimit") == 0)
-    CameraManager::instance().setHorizontalLimit(static_cast<float>(lua_tonumber(L, 3)));
-  
-  if (strcmp(key, "inertia") == 0)
-    CameraManager::instance().setInertia(static_cast<int>(lua_tonumber(L, 3)));
-  
-  if (strcmp(key, "neutralZone") == 0)
-    CameraManager::instance().setNeutralZone(static_cast<int>(lua_tonumber(L, 3)));
-  
-  if (strcmp(key, "speed") == 0)
-    CameraManager::instance().setMaxSpeed(static_cast<int>(lua_tonumber(L, 3)));
-  
-  if (strcmp(key, "smooth") == 0)
-    CameraManager::instance().setSpeedFactor(static_cast<int>(lua_tonumber(L, 3)));
-  
-  if (strcmp(key, "vertical") == 0)
-    CameraManager::instance().setAngleVertical(static_cast<float>(lua_tonumber(L, 3)));
-  
-  if (strcmp(key, "verticalLimit") == 0)
-    CameraManager::instance().setVerticalLimit(static_cast<float>(lua_tonumber(L, 3)));
-  
-  if (strcmp(key, "walk") == 0)
-    CameraManager::instance().setWalk((bool)lua_toboolean(L, 3));
+  switch (DGToProperty(L, 2)) {
+    case kCameraLibBreathe:
+      CameraManager::instance().setBreathe((bool)lua_toboolean(L, 3));
+      break;
+    case kCameraLibFov:
+      CameraManager::instance().setFieldOfView(static_cast<float>(lua_tonumber(L, 3)));
+      break;
+    case kCameraLibHorizontal:
+      CameraManager::instance().setAngleHorizontal(static_cast<float>(lua_tonumber(L, 3)));
+      break;
+    case kCameraLibHorizontalLimit:
+      CameraManager::instance().setHorizontalLimit(static_cast<float>(lua_tonumber(L, 3)));
+      break;
+    case kCameraLibInertia:
+      CameraManager::instance().setInertia(static_cast<int>(lua_tonumber(L, 3)));
+      break;
+    case kCameraLibNeutralZone:
+      CameraManager::instance().setNeutralZone(static_cast<int>(lua_tonumber(L, 3)));
+      break;
+    case kCameraLibSpeed:
+      CameraManager::instance().setMaxSpeed(static_cast<int>(lua_tonumber(L, 3)));
+      break;
+    case kCameraLibSmooth:
+      CameraManager::instance().setSpeedFactor(static_cast<int>(lua_tonumber(L, 3)));
+      break;
+    case kCameraLibVertical:
+      CameraManager::instance().setAngleVertical(static_cast<float>(lua_tonumber(L, 3)));
+      break;
+    case kCameraLibVerticalLimit:
+      CameraManager::instance().setVerticalLimit(static_cast<float>(lua_tonumber(L, 3)));
+      break;
+    case kCameraLibWalk:
+      CameraManager::instance().setWalk((bool)lua_toboolean(L, 3));
+      break;
+  }
   
   return 0;
 }
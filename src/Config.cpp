@@ -30,6 +30,8 @@ namespace dagon {
 Config::Config() {
   antialiasing = kDefAntialiasing;
   audioBuffer = kDefAudioBuffer;
+  audioCacheLimit = kDefAudioCacheLimit;
+  audioCacheSize = kDefAudioCacheSize;
   audioDevice = kDefAudioDevice;
   autopaths = kDefAutopaths;
   autorun = kDefAutorun;
@@ -44,13 +46,20 @@ Config::Config() {
   frameLimiter = kDefFrameLimiter;
   framerate = kDefFramerate;
   fullscreen = kDefFullscreen;
+  gcPause = kDefGCPause;
+  gcPerFrame = kDefGCPerFrame;
+  gcStepMultiplier = kDefGCStepMultiplier;
+  headless = kDefHeadless;
   log = kDefLog;
+  logLevel = kDefLogLevel;
   mute = kDefMute;
   numOfAudioBuffers = kDefNumOfAudioBuffers;
+  scriptMemoryLimit = kDefScriptMemoryLimit;
   showHelpers = kDefShowHelpers;
   showSplash = kDefShowSplash;
   showSpots = kDefShowSpots;
   silentFeeds = kDefSilentFeeds;
+  snapshots = kDefSnapshots;
   subtitles = kDefSubtitles;
   texCompression = kDefTexCompression;
   verticalSync = kDefVerticalSync;
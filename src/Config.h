@@ -39,6 +39,8 @@ enum ControlModes {
 enum DefaultConfiguration {
   kDefAntialiasing = false,
   kDefAudioBuffer = 8192,
+  kDefAudioCacheLimit = 524288,
+  kDefAudioCacheSize = 16777216,
   kDefAudioDevice = 0,
   kDefAutopaths = true,
   kDefAutorun = true,
@@ -53,13 +55,20 @@ enum DefaultConfiguration {
   kDefFrameLimiter = false,
   kDefFramerate = 60,
   kDefFullscreen = false,
+  kDefGCPause = 200, // Same as Lua's
+  kDefGCPerFrame = true,
+  kDefGCStepMultiplier = 200,
+  kDefHeadless = false,
   kDefLog = true,
+  kDefLogLevel = 0, // Everything
   kDefMute = false,
   kDefNumOfAudioBuffers = 8,
+  kDefScriptMemoryLimit = 0, // Unlimited
   kDefShowHelpers = false,
   kDefShowSplash = true,
   kDefShowSpots = false,
   kDefSilentFeeds = false,
+  kDefSnapshots = 8,
   kDefSubtitles = true,
   kDefTexCompression = false,
   kDefVerticalSync = true
@@ -84,6 +93,8 @@ class Config {
   
   bool antialiasing;
   int audioBuffer;
+  int audioCacheLimit; // Decoded clips up to this size in bytes are kept in memory
+  int audioCacheSize; // Bytes those clips add up to, save the ones in use
   int audioDevice;
   bool autopaths;
   bool autorun;
@@ -98,13 +109,20 @@ class Config {
   bool frameLimiter;
   int framerate;
   bool fullscreen;
+  int gcPause; // Percent the Lua heap grows by before collecting again
+  bool gcPerFrame; // Collect in the time left by each frame, Lua only doing so when far behind
+  int gcStepMultiplier; // Percent of the allocation speed each step collects at
+  bool headless; // Hidden window and no input, set by the benchmark runner
   bool log;
+  int logLevel; // See LogLevels
   bool mute;
   int numOfAudioBuffers;
+  int scriptMemoryLimit; // Lua heap in bytes, unlimited if 0
   bool showHelpers;
   bool showSplash;
   bool showSpots;
   bool silentFeeds;
+  int snapshots; // Kept in memory by snapshot(), oldest dropped first
   bool subtitles;
   bool texCompression;
   bool verticalSync;
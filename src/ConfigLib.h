@@ -28,6 +28,97 @@
 
 namespace dagon {
 
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Every property is handled by both switches below, so that a missing
+// setter is a -Wswitch warning. Those never set from Lua say so there.
+enum ConfigLibProperties {
+  kConfigLibUnknown = -1, // Not a property
+  kConfigLibAntialiasing,
+  kConfigLibAudioBuffer,
+  kConfigLibAudioCacheLimit,
+  kConfigLibAudioCacheSize,
+  kConfigLibAudioDevice,
+  kConfigLibAutopaths,
+  kConfigLibAutorun,
+  kConfigLibBundleEnabled,
+  kConfigLibControlMode,
+  kConfigLibDisplayWidth,
+  kConfigLibDisplayHeight,
+  kConfigLibDisplayDepth,
+  kConfigLibDebugMode,
+  kConfigLibEffects,
+  kConfigLibFramebuffer,
+  kConfigLibFramerate,
+  kConfigLibFullscreen,
+  kConfigLibGCPause,
+  kConfigLibGCPerFrame,
+  kConfigLibGCStepMultiplier,
+  kConfigLibHeadless,
+  kConfigLibLog,
+  kConfigLibLogLevel,
+  kConfigLibMute,
+  kConfigLibNumOfAudioBuffers,
+  kConfigLibScript,
+  kConfigLibScriptMemoryLimit,
+  kConfigLibShowHelpers,
+  kConfigLibShowSplash,
+  kConfigLibShowSpots,
+  kConfigLibSubtitles,
+  kConfigLibSilentFeeds,
+  kConfigLibSnapshots,
+  kConfigLibTexCompression,
+  kConfigLibTexExtension,
+  kConfigLibVerticalSync,
+  kConfigLibNumOfProperties
+};
+
+// Same order as above
+static const char* kConfigLibPropertyNames[] = {
+  "antialiasing",
+  "audioBuffer",
+  "audioCacheLimit",
+  "audioCacheSize",
+  "audioDevice",
+  "autopaths",
+  "autorun",
+  "bundleEnabled",
+  "controlMode",
+  "displayWidth",
+  "displayHeight",
+  "displayDepth",
+  "debugMode",
+  "effects",
+  "framebuffer",
+  "framerate",
+  "fullscreen",
+  "gcPause",
+  "gcPerFrame",
+  "gcStepMultiplier",
+  "headless",
+  "log",
+  "logLevel",
+  "mute",
+  "numOfAudioBuffers",
+  "script",
+  "scriptMemoryLimit",
+  "showHelpers",
+  "showSplash",
+  "showSpots",
+  "subtitles",
+  "silentFeeds",
+  "snapshots",
+  "texCompression",
+  "texExtension",
+  "verticalSync",
+  NULL
+};
+
+static_assert(sizeof(kConfigLibPropertyNames) / sizeof(kConfigLibPropertyNames[0]) ==
+              kConfigLibNumOfProperties + 1, "A property is missing its name");
+
 ////////////////////////////////////////////////////////////
 // Interface
 ////////////////////////////////////////////////////////////
@@ -35,239 +126,246 @@ namespace dagon {
 // TODO: Support changing the paths
 
 static int ConfigLibGet(lua_State *L) {
-  const char *key = luaL_checkstring(L, 2);
-  
-  if (strcmp(key, "antialiasing") == 0) {
-    lua_pushboolean(L, Config::instance().antialiasing);
-    return 1;
-  }
-  
-  if (strcmp(key, "audioBuffer") == 0) {
-    lua_pushnumber(L, Config::instance().audioBuffer);
-    return 1;
-  }
-  
-  if (strcmp(key, "audioDevice") == 0) {
-    lua_pushnumber(L, Config::instance().audioDevice);
-    return 1;
-  }
-  
-  if (strcmp(key, "autopaths") == 0) {
-    lua_pushboolean(L, Config::instance().autopaths);
-    return 1;
-  }
-  
-  if (strcmp(key, "autorun") == 0) {
-    lua_pushboolean(L, Config::instance().autorun);
-    return 1;
-  }
-  
-  if (strcmp(key, "bundleEnabled") == 0) {
-    lua_pushboolean(L, Config::instance().bundleEnabled);
-    return 1;
-  }
-  
-  if (strcmp(key, "controlMode") == 0) {
-    lua_pushnumber(L, Config::instance().controlMode);
-    return 1;
-  }
-  
-  if (strcmp(key, "displayWidth") == 0) {
-    lua_pushnumber(L, Config::instance().displayWidth);
-    return 1;
-  }
-  
-  if (strcmp(key, "displayHeight") == 0) {
-    lua_pushnumber(L, Config::instance().displayHeight);
-    return 1;
-  }
-  
-  if (strcmp(key, "displayDepth") == 0) {
-    lua_pushnumber(L, Config::instance().displayDepth);
-    return 1;
-  }
-  
-  if (strcmp(key, "debugMode") == 0) {
-    lua_pushboolean(L, Config::instance().debugMode);
-    return 1;
-  }
-  
-  if (strcmp(key, "effects") == 0) {
-    lua_pushboolean(L, Config::instance().effects);
-    return 1;
-  }
-  
-  if (strcmp(key, "framebuffer") == 0) {
-    lua_pushboolean(L, Config::instance().framebuffer);
-    return 1;
-  }
-  
-  if (strcmp(key, "framerate") == 0) {
-    lua_pushnumber(L, Config::instance().framerate);
-    return 1;
-  }
-  
-  if (strcmp(key, "fullscreen") == 0) {
-    lua_pushboolean(L, Config::instance().fullscreen);
-    return 1;
-  }
-  
-  if (strcmp(key, "log") == 0) {
-    lua_pushboolean(L, Config::instance().log);
-    return 1;
-  }
-  
-  if (strcmp(key, "mute") == 0) {
-    lua_pushboolean(L, Config::instance().mute);
-    return 1;
-  }
-  
-  if (strcmp(key, "numOfAudioBuffers") == 0) {
-    lua_pushnumber(L, Config::instance().numOfAudioBuffers);
-    return 1;
-  }
-  
-  if (strcmp(key, "script") == 0) {
-    lua_pushstring(L, Config::instance().script().c_str());
-    return 1;
-  }
-  
-  if (strcmp(key, "showHelpers") == 0) {
-    lua_pushboolean(L, Config::instance().showHelpers);
-    return 1;
-  }
-  
-  if (strcmp(key, "showSplash") == 0) {
-    lua_pushboolean(L, Config::instance().showSplash);
-    return 1;
-  }
-  
-  if (strcmp(key, "showSpots") == 0) {
-    lua_pushboolean(L, Config::instance().showSpots);
-    return 1;
-  }
-  
-  if (strcmp(key, "subtitles") == 0) {
-    lua_pushboolean(L, Config::instance().subtitles);
-    return 1;
-  }
-  
-  if (strcmp(key, "silentFeeds") == 0) {
-    lua_pushboolean(L, Config::instance().silentFeeds);
-    return 1;
-  }
-  
-  if (strcmp(key, "texCompression") == 0) {
-    lua_pushboolean(L, Config::instance().texCompression);
-    return 1;
-  }
-  
-  if (strcmp(key, "texExtension") == 0) {
-    lua_pushstring(L, Config::instance().texExtension().c_str());
-    return 1;
-  }
-  
-  if (strcmp(key, "verticalSync") == 0) {
-    lua_pushboolean(L, Config::instance().verticalSync);
-    return 1;
+  switch (static_cast<ConfigLibProperties>(DGToProperty(L, 2))) {
+    case kConfigLibAntialiasing:
+      lua_pushboolean(L, Config::instance().antialiasing);
+      return 1;
+    case kConfigLibAudioBuffer:
+      lua_pushnumber(L, Config::instance().audioBuffer);
+      return 1;
+    case kConfigLibAudioCacheLimit:
+      lua_pushnumber(L, Config::instance().audioCacheLimit);
+      return 1;
+    case kConfigLibAudioCacheSize:
+      lua_pushnumber(L, Config::instance().audioCacheSize);
+      return 1;
+    case kConfigLibAudioDevice:
+      lua_pushnumber(L, Config::instance().audioDevice);
+      return 1;
+    case kConfigLibAutopaths:
+      lua_pushboolean(L, Config::instance().autopaths);
+      return 1;
+    case kConfigLibAutorun:
+      lua_pushboolean(L, Config::instance().autorun);
+      return 1;
+    case kConfigLibBundleEnabled:
+      lua_pushboolean(L, Config::instance().bundleEnabled);
+      return 1;
+    case kConfigLibControlMode:
+      lua_pushnumber(L, Config::instance().controlMode);
+      return 1;
+    case kConfigLibDisplayWidth:
+      lua_pushnumber(L, Config::instance().displayWidth);
+      return 1;
+    case kConfigLibDisplayHeight:
+      lua_pushnumber(L, Config::instance().displayHeight);
+      return 1;
+    case kConfigLibDisplayDepth:
+      lua_pushnumber(L, Config::instance().displayDepth);
+      return 1;
+    case kConfigLibDebugMode:
+      lua_pushboolean(L, Config::instance().debugMode);
+      return 1;
+    case kConfigLibEffects:
+      lua_pushboolean(L, Config::instance().effects);
+      return 1;
+    case kConfigLibFramebuffer:
+      lua_pushboolean(L, Config::instance().framebuffer);
+      return 1;
+    case kConfigLibFramerate:
+      lua_pushnumber(L, Config::instance().framerate);
+      return 1;
+    case kConfigLibFullscreen:
+      lua_pushboolean(L, Config::instance().fullscreen);
+      return 1;
+    case kConfigLibGCPause:
+      lua_pushnumber(L, Config::instance().gcPause);
+      return 1;
+    case kConfigLibGCPerFrame:
+      lua_pushboolean(L, Config::instance().gcPerFrame);
+      return 1;
+    case kConfigLibGCStepMultiplier:
+      lua_pushnumber(L, Config::instance().gcStepMultiplier);
+      return 1;
+    case kConfigLibHeadless:
+      lua_pushboolean(L, Config::instance().headless);
+      return 1;
+    case kConfigLibLog:
+      lua_pushboolean(L, Config::instance().log);
+      return 1;
+    case kConfigLibLogLevel:
+      lua_pushnumber(L, Config::instance().logLevel);
+      return 1;
+    case kConfigLibMute:
+      lua_pushboolean(L, Config::instance().mute);
+      return 1;
+    case kConfigLibNumOfAudioBuffers:
+      lua_pushnumber(L, Config::instance().numOfAudioBuffers);
+      return 1;
+    case kConfigLibScript:
+      lua_pushstring(L, Config::instance().script().c_str());
+      return 1;
+    case kConfigLibScriptMemoryLimit:
+      lua_pushnumber(L, Config::instance().scriptMemoryLimit);
+      return 1;
+    case kConfigLibShowHelpers:
+      lua_pushboolean(L, Config::instance().showHelpers);
+      return 1;
+    case kConfigLibShowSplash:
+      lua_pushboolean(L, Config::instance().showSplash);
+      return 1;
+    case kConfigLibShowSpots:
+      lua_pushboolean(L, Config::instance().showSpots);
+      return 1;
+    case kConfigLibSubtitles:
+      lua_pushboolean(L, Config::instance().subtitles);
+      return 1;
+    case kConfigLibSilentFeeds:
+      lua_pushboolean(L, Config::instance().silentFeeds);
+      return 1;
+    case kConfigLibSnapshots:
+      lua_pushnumber(L, Config::instance().snapshots);
+      return 1;
+    case kConfigLibTexCompression:
+      lua_pushboolean(L, Config::instance().texCompression);
+      return 1;
+    case kConfigLibTexExtension:
+      lua_pushstring(L, Config::instance().texExtension().c_str());
+      return 1;
+    case kConfigLibVerticalSync:
+      lua_pushboolean(L, Config::instance().verticalSync);
+      return 1;
+    case kConfigLibUnknown:
+    case kConfigLibNumOfProperties:
+      break;
   }
   
   return 0;
 }
 
 static int ConfigLibSet(lua_State *L) {
-  const char *key = luaL_checkstring(L, 2);
-  
-  if (strcmp(key, "antialiasing") == 0)
-    Config::instance().antialiasing = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "audioBuffer") == 0)
-    Config::instance().audioBuffer = (int)luaL_checknumber(L, 3);
-  
-  if (strcmp(key, "audioDevice") == 0)
-    Config::instance().audioDevice = (int)luaL_checknumber(L, 3);
-  
-  if (strcmp(key, "autopaths") == 0)
-    Config::instance().autopaths = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "autorun") == 0)
-    Config::instance().autorun = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "bundleEnabled") == 0)
-    Config::instance().bundleEnabled = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "controlMode") == 0) {
-    Config::instance().controlMode = (int)luaL_checknumber(L, 3);
-    // Must refresh the viewport with this change
-    CameraManager::instance().setViewport(Config::instance().displayWidth, Config::instance().displayHeight);
-  }
-  
-  if (strcmp(key, "displayWidth") == 0)
-    Config::instance().displayWidth = (int)luaL_checknumber(L, 3);
-  
-  if (strcmp(key, "displayHeight") == 0)
-    Config::instance().displayHeight = (int)luaL_checknumber(L, 3);
-  
-  if (strcmp(key, "displayDepth") == 0)
-    Config::instance().displayDepth = (int)luaL_checknumber(L, 3);
-  
-  if (strcmp(key, "debugMode") == 0)
-    Config::instance().debugMode = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "effects") == 0)
-    Config::instance().effects = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "framebuffer") == 0)
-    Config::instance().framebuffer = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "framerate") == 0)
-    Config::instance().framerate = (int)luaL_checknumber(L, 3);
-  
-  if (strcmp(key, "fullscreen") == 0)
-    Config::instance().fullscreen = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "log") == 0)
-    Config::instance().log = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "mute") == 0)
-    Config::instance().mute = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "numOfAudioBuffers") == 0) {
-    int numOfAudioBuffers = (int)luaL_checknumber(L, 3);
-    
-    if (numOfAudioBuffers > kMaxAudioBuffers)
-      numOfAudioBuffers = kMaxAudioBuffers;
-    
-    Config::instance().numOfAudioBuffers = (int)luaL_checknumber(L, 3);
+  switch (static_cast<ConfigLibProperties>(DGToProperty(L, 2))) {
+    case kConfigLibAntialiasing:
+      Config::instance().antialiasing = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibAudioBuffer:
+      Config::instance().audioBuffer = (int)luaL_checknumber(L, 3);
+      break;
+    case kConfigLibAudioCacheLimit:
+      Config::instance().audioCacheLimit = (int)luaL_checknumber(L, 3);
+      break;
+    case kConfigLibAudioCacheSize:
+      Config::instance().audioCacheSize = (int)luaL_checknumber(L, 3);
+      break;
+    case kConfigLibAudioDevice:
+      Config::instance().audioDevice = (int)luaL_checknumber(L, 3);
+      break;
+    case kConfigLibAutopaths:
+      Config::instance().autopaths = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibAutorun:
+      Config::instance().autorun = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibBundleEnabled:
+      Config::instance().bundleEnabled = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibControlMode:
+      Config::instance().controlMode = (int)luaL_checknumber(L, 3);
+      // Must refresh the viewport with this change
+      CameraManager::instance().setViewport(Config::instance().displayWidth,
+                                            Config::instance().displayHeight);
+      break;
+    case kConfigLibDisplayWidth:
+      Config::instance().displayWidth = (int)luaL_checknumber(L, 3);
+      break;
+    case kConfigLibDisplayHeight:
+      Config::instance().displayHeight = (int)luaL_checknumber(L, 3);
+      break;
+    case kConfigLibDisplayDepth:
+      Config::instance().displayDepth = (int)luaL_checknumber(L, 3);
+      break;
+    case kConfigLibDebugMode:
+      Config::instance().debugMode = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibEffects:
+      Config::instance().effects = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibFramebuffer:
+      Config::instance().framebuffer = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibFramerate:
+      Config::instance().framerate = (int)luaL_checknumber(L, 3);
+      break;
+    case kConfigLibFullscreen:
+      Config::instance().fullscreen = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibGCPause:
+      Config::instance().gcPause = (int)luaL_checknumber(L, 3);
+      break;
+    case kConfigLibGCPerFrame:
+      Config::instance().gcPerFrame = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibGCStepMultiplier:
+      Config::instance().gcStepMultiplier = (int)luaL_checknumber(L, 3);
+      break;
+    case kConfigLibLog:
+      Config::instance().log = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibLogLevel:
+      Config::instance().logLevel = (int)luaL_checknumber(L, 3);
+      break;
+    case kConfigLibMute:
+      Config::instance().mute = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibNumOfAudioBuffers: {
+      int numOfAudioBuffers = (int)luaL_checknumber(L, 3);
+      
+      if (numOfAudioBuffers > kMaxAudioBuffers)
+        numOfAudioBuffers = kMaxAudioBuffers;
+      
+      Config::instance().numOfAudioBuffers = numOfAudioBuffers;
+      break;
+    }
+    case kConfigLibScript:
+      Config::instance().setScript(luaL_checkstring(L, 3));
+      break;
+    case kConfigLibScriptMemoryLimit:
+      Config::instance().scriptMemoryLimit = (int)luaL_checknumber(L, 3);
+      break;
+    case kConfigLibShowHelpers:
+      Config::instance().showHelpers = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibShowSplash:
+      Config::instance().showSplash = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibShowSpots:
+      Config::instance().showSpots = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibSilentFeeds:
+      Config::instance().silentFeeds = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibSnapshots:
+      Config::instance().snapshots = (int)luaL_checknumber(L, 3);
+      break;
+    case kConfigLibSubtitles:
+      Config::instance().subtitles = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibTexCompression:
+      Config::instance().texCompression = (bool)lua_toboolean(L, 3);
+      break;
+    case kConfigLibTexExtension:
+      Config::instance().setTexExtension(luaL_checkstring(L, 3));
+      break;
+    case kConfigLibVerticalSync:
+      Config::instance().verticalSync = (bool)lua_toboolean(L, 3);
+      break;
+    // Read-only, as only the command line may run headless
+    case kConfigLibHeadless:
+    case kConfigLibUnknown:
+    case kConfigLibNumOfProperties:
+      break;
   }
   
-  if (strcmp(key, "script") == 0)
-    Config::instance().setScript(luaL_checkstring(L, 3));
-  
-  if (strcmp(key, "showHelpers") == 0)
-    Config::instance().showHelpers = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "showSplash") == 0)
-    Config::instance().showSplash = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "showSpots") == 0)
-    Config::instance().showSpots = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "silentFeeds") == 0)
-    Config::instance().silentFeeds = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "subtitles") == 0)
-    Config::instance().subtitles = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "texCompression") == 0)
-    Config::instance().texCompression = (bool)lua_toboolean(L, 3);
-  
-  if (strcmp(key, "texExtension") == 0)
-    Config::instance().setTexExtension(luaL_checkstring(L, 3));
-  
-  if (strcmp(key, "verticalSync") == 0)
-    Config::instance().verticalSync = (bool)lua_toboolean(L, 3);
-  
   return 0;
 }
 
@@ -21,7 +21,9 @@
 #include "CursorManager.h"
 #include "Log.h"
 #include "FontManager.h"
+#include "Profiler.h"
 #include "RenderManager.h"
+#include "ScriptAllocator.h"
 
 namespace dagon {
 
@@ -35,7 +37,9 @@ config(Config::instance()),
 cursorManager(CursorManager::instance()),
 fontManager(FontManager::instance()),
 log(Log::instance()),
-renderManager(RenderManager::instance())
+profiler(Profiler::instance()),
+renderManager(RenderManager::instance()),
+scriptAllocator(ScriptAllocator::instance())
 {
   _command = "";
   
@@ -140,6 +144,26 @@ void Console::update() {
                      "Viewing angle: %2.0f", cameraManager.fieldOfView());
         _font->print(DGInfoMargin, (DGInfoMargin * 4) + (kDefFontSize * 3),
                      "FPS: %2.0f", config.framesPerSecond());
+        _font->print(DGInfoMargin, (DGInfoMargin * 5) + (kDefFontSize * 4),
+                     "Lua heap: %lu KB (peak %lu KB), %.0f allocations/s",
+                     static_cast<unsigned long>(scriptAllocator.liveBytes() / 1024),
+                     static_cast<unsigned long>(scriptAllocator.peakBytes() / 1024),
+                     scriptAllocator.allocationRate());
+        
+        // Frame time breakdown, only while profiling
+        if (profiler.isEnabled()) {
+          int line = 6;
+          for (int zone = kZoneFrame; zone < kNumOfZones; zone++) {
+            float p99 = profiler.percentile(zone, 99.0f);
+            if (p99 > 0.0f) {
+              _font->print(DGInfoMargin, (DGInfoMargin * line) + (kDefFontSize * (line - 1)),
+                           "%s: %.2f / %.2f / %.2f ms (GPU %.2f)", profiler.nameOfZone(zone),
+                           profiler.percentile(zone, 50.0f), profiler.percentile(zone, 95.0f),
+                           p99, profiler.percentile(zone, 50.0f, true));
+              line++;
+            }
+          }
+        }
         
         break;
       case ConsoleHiding:
@@ -179,7 +203,7 @@ void Console::update() {
           
           // Draw the current line
           renderManager.setColor(logData.color);
-          _font->print(ConsoleMargin, ((ConsoleSpacing + kDefFontSize) * row) - _offset, logData.line.c_str());
+          _font->wPrint(ConsoleMargin, ((ConsoleSpacing + kDefFontSize) * row) - _offset, logData.line.c_str());
           
           row--;
         } while (log.iterateHistory());
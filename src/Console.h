@@ -45,7 +45,9 @@ class CursorManager;
 class Font;
 class FontManager;
 class Log;
+class Profiler;
 class RenderManager;
+class ScriptAllocator;
 
 ////////////////////////////////////////////////////////////
 // Interface
@@ -57,7 +59,9 @@ class Console {
   CursorManager& cursorManager;
   FontManager& fontManager;
   Log& log;
+  Profiler& profiler;
   RenderManager& renderManager;
+  ScriptAllocator& scriptAllocator;
   
   Font* _font;
   
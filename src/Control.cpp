@@ -21,6 +21,8 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <algorithm>
+
 #include "AudioManager.h"
 #include "CameraManager.h"
 #include "Config.h"
@@ -31,10 +33,13 @@
 #include "FontManager.h"
 #include "EffectsManager.h"
 #include "Interface.h"
+#include "JobManager.h"
+#include "Profiler.h"
 #include "Log.h"
 #include "Node.h"
 #include "RenderManager.h"
 #include "Room.h"
+#include "SaveManager.h"
 #include "Scene.h"
 #include "Script.h"
 #include "Spot.h"
@@ -57,8 +62,10 @@ config(Config::instance()),
 cursorManager(CursorManager::instance()),
 feedManager(FeedManager::instance()),
 fontManager(FontManager::instance()),
+jobManager(JobManager::instance()),
 log(Log::instance()),
 renderManager(RenderManager::instance()),
+saveManager(SaveManager::instance()),
 script(Script::instance()),
 system(Config::instance(), Log::instance()),
 textureManager(TextureManager::instance()),
@@ -122,6 +129,17 @@ void Control::init(int argc, char* argv[]) {
   // FIXME: Solve problem when script not found (console isn't shown)
   script.init();
   
+  // The configuration is known now, so the log goes to its own thread
+  log.init();
+  
+  // Nobody is watching a headless run, so it goes as fast as possible
+  if (config.headless) {
+    config.fullscreen = false;
+    config.showSplash = false;
+    config.verticalSync = false;
+    config.frameLimiter = false;
+  }
+  
   system.init();
   
   renderManager.init();
@@ -130,6 +148,9 @@ void Control::init(int argc, char* argv[]) {
   cameraManager.init();
   cameraManager.setViewport(config.displayWidth, config.displayHeight);
   
+  // Start the workers before anyone submits jobs
+  jobManager.init();
+  
   // Init the audio manager
   audioManager.init();
   
@@ -609,6 +630,8 @@ void Control::switchTo(Object* theTarget) {
   static bool firstSwitch = true;
   static SettingCollection previousEffects; // Temporary patch
   
+  ProfilerScope scope(kZoneSwitch);
+  
   //log.trace(kModControl, "Begin switching...");
   
   _updateView(StateNode, true);
@@ -825,20 +848,35 @@ void Control::switchTo(Object* theTarget) {
           if (spot->hasVideo()) {
             //log.trace(kModControl, "Loading video...");
             Video* video = spot->video();
-            videoManager.requestVideo(video);
+            DGFrame* poster = textureManager.posterFrame(video->resource());
             
-            if (video->isLoaded()) {
+            if (poster) {
+              // Show the cached first frame and let the decoder start in the background
               if (!spot->hasTexture()) {
                 Texture* texture = new Texture;
                 spot->setTexture(texture);
               }
               
-              video->play();
-              
-              DGFrame* frame = video->currentFrame();
-              spot->texture()->loadRawData(frame->data, frame->width, frame->height);
+              spot->texture()->loadRawData(poster->data, poster->width, poster->height);
+              videoManager.requestVideo(video, true);
+            }
+            else {
+              videoManager.requestVideo(video);
               
-              video->pause();
+              if (video->isLoaded()) {
+                if (!spot->hasTexture()) {
+                  Texture* texture = new Texture;
+                  spot->setTexture(texture);
+                }
+                
+                video->play();
+                
+                DGFrame* frame = video->currentFrame();
+                spot->texture()->loadRawData(frame->data, frame->width, frame->height);
+                textureManager.storePosterFrame(video->resource(), frame);
+                
+                video->pause();
+              }
             }
           }
           
@@ -867,24 +905,11 @@ void Control::switchTo(Object* theTarget) {
       system.setTitle(title);
     }
     
-    // This has to be done every time so that room audios keep playing
-    if (_currentRoom->hasAudios() && (!_currentRoom->currentNode()->isSlide() && theTarget != NULL)) {
+    // Room audios keep playing across switches, so only the differences
+    // with the previous set are processed. Slides leave the set as it is.
+    if ((theTarget != NULL) && !_currentRoom->currentNode()->isSlide()) {
       //log.trace(kModControl, "Managing environmental sounds...");
-      std::vector<Audio*>::iterator it;
-      std::vector<Audio*> arrayOfAudios = _currentRoom->arrayOfAudios();
-      
-      it = arrayOfAudios.begin();
-      
-      while (it != arrayOfAudios.end()) {
-        if ((*it)->state() != kAudioPlaying)
-          (*it)->fadeIn();
-        audioManager.requestAudio((*it));
-        if ((*it)->doesAutoplay()) {
-          (*it)->play();
-        }
-        
-        ++it;
-      }
+      _updateRoomAudios(_currentRoom->arrayOfAudios());
     }
   }
   
@@ -956,6 +981,8 @@ void Control::terminate() {
   audioManager.terminate();
   timerManager.terminate();
   videoManager.terminate();
+  saveManager.terminate(); // Saves still being written need the workers
+  jobManager.terminate();
   
   int r = rand() % 8; // Double the replies, so that the default one appears often
   
@@ -984,6 +1011,7 @@ void Control::update() {
       break;
     case StateSleep:
       if (timerManager.checkManual(_sleepTimer)) {
+        timerManager.destroy(_sleepTimer);
         _state->setPrevious();
         cursorManager.fadeIn();
         script.resume();
@@ -1054,15 +1082,49 @@ void Control::_processAction() {
   cursorManager.removeAction();
 }
 
+void Control::_updateRoomAudios(const std::vector<Audio*>& arrayOfAudios) {
+  // Release the ones we are leaving behind; the manager fades them out on flush
+  std::vector<Audio*>::iterator it = _arrayOfRoomAudios.begin();
+  while (it != _arrayOfRoomAudios.end()) {
+    if (std::find(arrayOfAudios.begin(), arrayOfAudios.end(), *it) == arrayOfAudios.end())
+      (*it)->release();
+    ++it;
+  }
+  
+  // And start the new ones. Those staying keep our reference, which
+  // clearing the manager leaves alone, so they're untouched.
+  std::vector<Audio*>::const_iterator itNew = arrayOfAudios.begin();
+  while (itNew != arrayOfAudios.end()) {
+    Audio* audio = *itNew;
+    if (std::find(_arrayOfRoomAudios.begin(), _arrayOfRoomAudios.end(), audio) == _arrayOfRoomAudios.end()) {
+      if (audio->state() != kAudioPlaying)
+        audio->fadeIn();
+      audioManager.requestAudio(audio);
+      if (audio->doesAutoplay())
+        audio->play();
+      audio->retain();
+    }
+    ++itNew;
+  }
+  
+  _arrayOfRoomAudios = arrayOfAudios;
+}
+
 void Control::_updateView(int state, bool inBackground) {
   // TODO: Suspend all operations when doing a switch
   // FIXME: Add a render stack of Objects, especially for overlays
   // IMPORTANT: Ensure this function is thread-safe when switching rooms or nodes
   
+  // Frames drawn in the background aren't measured
+  ProfilerScope frameScope(inBackground ? kZoneNone : kZoneFrame);
+  Uint64 frameBegin = SDL_GetPerformanceCounter();
+  
   if (!inBackground) {
     // User post-render operations, supporting textures
-    if (_eventHandlers.hasPreRender)
+    if (_eventHandlers.hasPreRender) {
+      ProfilerScope scope(kZonePreRender);
       script.processCallback(_eventHandlers.preRender, 0);
+    }
   }
   
   // Setup the scene
@@ -1079,18 +1141,34 @@ void Control::_updateView(int state, bool inBackground) {
         script.resume();
       }
       break;
-    case StateNode:
-      _scene->scanSpots();
-      _scene->drawSpots(inBackground);
+    case StateNode: {
+      {
+        ProfilerScope scope(kZoneScanSpots);
+        _scene->scanSpots();
+      }
+      
+      {
+        ProfilerScope scope(kZoneDrawSpots, true);
+        _scene->drawSpots(inBackground);
+      }
       
       if (!inBackground) {
-        _interface->drawHelpers();
-        _interface->drawOverlays();
-        feedManager.update();
+        {
+          ProfilerScope scope(kZoneOverlays, true);
+          _interface->drawHelpers();
+          _interface->drawOverlays();
+        }
+        
+        {
+          ProfilerScope scope(kZoneFeeds, true);
+          feedManager.update();
+        }
+        
         _interface->drawCursor();
       }
       
       break;
+    }
     case StateSplash:
       static int handlerIn = timerManager.createManual(4);
       static int handlerOut = timerManager.createManual(5);
@@ -1118,8 +1196,10 @@ void Control::_updateView(int state, bool inBackground) {
   
   if (!inBackground) {
     // User post-render operations, supporting textures
-    if (_eventHandlers.hasPostRender)
+    if (_eventHandlers.hasPostRender) {
+      ProfilerScope scope(kZonePostRender);
       script.processCallback(_eventHandlers.postRender, 0);
+    }
   }
   
   // General fade, affects every graphic on screen
@@ -1128,7 +1208,10 @@ void Control::_updateView(int state, bool inBackground) {
   // Debug info (if enabled)
   if (_console->isEnabled() && !inBackground) {
     // BUG: This causes a crash sometimes. Why?
-    _console->update();
+    {
+      ProfilerScope scope(kZoneConsole, true);
+      _console->update();
+    }
     
     // We do this here in case the command changes the viewport
     cameraManager.endOrthoView();
@@ -1143,10 +1226,25 @@ void Control::_updateView(int state, bool inBackground) {
   
   audioManager.setOrientation(cameraManager.orientation());
   
-  timerManager.process();
+  {
+    ProfilerScope scope(kZoneTimers);
+    timerManager.process();
+  }
   
   if (!inBackground) {
+    // The frame is submitted first, so that the GPU draws it meanwhile. The
+    // framerate stands for the refresh rate when syncing.
+    glFlush();
+    
+    {
+      ProfilerScope scope(kZoneCollect);
+      double elapsed = (SDL_GetPerformanceCounter() - frameBegin) * 1000.0 /
+                       static_cast<double>(SDL_GetPerformanceFrequency());
+      script.collect((1000.0 / config.framerate) - elapsed - kCollectMargin);
+    }
+    
     // Flush the buffers
+    ProfilerScope scope(kZoneSwap);
     system.update();
   }
 }
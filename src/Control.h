@@ -31,6 +31,11 @@ namespace dagon {
 
 #define kMaxHotKeys 13
 
+// Milliseconds of each frame never spent collecting Lua garbage, so that
+// swapping buffers still makes it in time
+#define kCollectMargin 1.0
+
+class Audio;
 class AudioManager;
 class CameraManager;
 class Config;
@@ -39,11 +44,13 @@ class CursorManager;
 class FeedManager;
 class FontManager;
 class Interface;
+class JobManager;
 class Log;
 class Node;
 class Overlay;
 class Room;
 class RenderManager;
+class SaveManager;
 class Scene;
 class Script;
 class Spot;
@@ -92,8 +99,10 @@ class Control {
   CursorManager& cursorManager;
   FeedManager& feedManager;
   FontManager& fontManager;
+  JobManager& jobManager;
   Log& log;
   RenderManager& renderManager;
+  SaveManager& saveManager;
   Script& script;
   System system;
   TextureManager& textureManager;
@@ -101,6 +110,7 @@ class Control {
   VideoManager& videoManager;
   
   std::vector<Room*> _arrayOfRooms;
+  std::vector<Audio*> _arrayOfRoomAudios; // Currently retained by us
   Room* _currentRoom;
   
   Console* _console;
@@ -122,6 +132,7 @@ class Control {
   int _sleepTimer;
   
   void _processAction();
+  void _updateRoomAudios(const std::vector<Audio*>& arrayOfAudios);
   void _updateView(int state, bool inBackground);
   
   Control();
@@ -33,6 +33,7 @@
 #define kDefLogFile "dagon.log"
 #define kDefTexExtension "tex"
 #define kDefSaveExtension "sav"
+#define kDefSaveIndexFile "index.dat"
 
 namespace dagon {
 
@@ -22,20 +22,28 @@
 #include "Control.h"
 #include "Log.h"
 #include "Room.h"
+#include "Script.h"
+#include "Serializer.h"
 #include "Spot.h"
 #include "TimerManager.h"
 
+#include <algorithm>
+#include <cstring>
 #include <vector>
 
 namespace dagon {
 
-const char SAVIdent[] = { '\x44', '\x41', '\x47', '\x4F', '\x4E', '\x53', '\x41', '\x56', '\x45' };
+typedef struct {
+  const char *buf;
+  size_t size;
+} LuaReaderData;
 
 ////////////////////////////////////////////////////////////
 // Implementation - Constructor & Destructor
 ////////////////////////////////////////////////////////////
 
-Deserializer::Deserializer(lua_State *L, SDL_RWops *rw) : _L(L),_rw(rw) {}
+Deserializer::Deserializer(lua_State *L, SDL_RWops *rw) : _L(L), _rw(rw), _buffer(kSaveBufferSize),
+  _offset(0), _size(0), _format(kSaveFormatCurrent), _isExpanded(false), _isTruncated(false) {}
 
 Deserializer::~Deserializer() {
   SDL_RWclose(_rw);
@@ -47,15 +55,385 @@ Deserializer::~Deserializer() {
 
 const char *Deserializer::readFunction(lua_State *L, void *data, size_t *size) {
   LuaReaderData *readerData = reinterpret_cast<LuaReaderData*>(data);
-  void *p = const_cast<char*>(readerData->buf);
-  if (!SDL_RWread(readerData->rw, p, readerData->numBytes, 1)) {
-    readerData->readError = true;
-    *size = 0;
-    return nullptr;
+  const char *buf = readerData->buf;
+
+  // The whole function is handed over at once
+  *size = readerData->size;
+  readerData->size = 0;
+  return *size ? buf : nullptr;
+}
+
+bool Deserializer::readChangedKeys(int data) {
+  while (_offset < _size) {
+    lua_newtable(_L); // Tables read so far for this key, by id
+    int tables = lua_gettop(_L);
+
+    uint8_t tag = _readU8();
+    if (_isTruncated || (tag != kSaveTagNumber && tag != kSaveTagString) ||
+        !readValue(tag, tables))
+      return false;
+
+    tag = _readU8();
+    if (_isTruncated)
+      return false;
+
+    if (tag == kSaveTagTable) {
+      // Replaced entirely, but in place like the tables of full saves
+      lua_pushvalue(_L, -1);
+      lua_rawget(_L, data);
+      if (lua_istable(_L, -1)) {
+        _clearTable(lua_gettop(_L));
+      } else {
+        lua_pop(_L, 1);
+        lua_newtable(_L);
+      }
+
+      int numTables = 0;
+      if (!readTable(tables, &numTables))
+        return false;
+    } else if (tag == kSaveTagNil) {
+      lua_pushnil(_L);
+    } else if (!readValue(tag, tables)) {
+      return false;
+    }
+
+    lua_rawset(_L, data);
+    lua_pop(_L, 1);
+  }
+
+  return !_isTruncated;
+}
+
+void Deserializer::readChangedSpots() {
+  std::vector<Room*> rooms = Control::instance().rooms();
+
+  while (_offset < _size) {
+    uint16_t roomIdx = _readBE16();
+    uint16_t nodeIdx = _readBE16();
+    uint16_t spotIdx = _readBE16();
+    bool enable = _readU8();
+    if (_isTruncated)
+      return;
+
+    // Rooms may have been changed since, as with full saves
+    if (roomIdx >= rooms.size() || nodeIdx >= rooms[roomIdx]->numNodes())
+      continue;
+    Node *node = rooms[roomIdx]->arrayOfNodes()[nodeIdx];
+    if (spotIdx >= node->numSpots())
+      continue;
+
+    Spot *spot = node->arrayOfSpots()[spotIdx];
+    if (enable)
+      spot->enable(true);
+    else
+      spot->disable(true);
+  }
+}
+
+bool Deserializer::readTable(int tables, int *numTables) {
+  int table = lua_gettop(_L);
+  lua_pushvalue(_L, table);
+  lua_rawseti(_L, tables, ++(*numTables));
+
+  if (!lua_checkstack(_L, 4))
+    return false;
+
+  for (;;) {
+    // Reading past the end gives kSaveTagEnd too
+    uint8_t tag = _readU8();
+    if (_isTruncated)
+      return false;
+
+    if (tag == kSaveTagEnd)
+      return true;
+
+    // Keys are never tables
+    if ((tag != kSaveTagNumber && tag != kSaveTagString) || !readValue(tag, tables))
+      return false;
+
+    tag = _readU8();
+    if (_isTruncated)
+      return false;
+
+    if (tag == kSaveTagTable) {
+      // Tables are filled in place, so that scripts holding on to them
+      // see the restored values
+      lua_pushvalue(_L, -1);
+      lua_rawget(_L, table);
+      if (!lua_istable(_L, -1)) {
+        lua_pop(_L, 1);
+        lua_newtable(_L);
+      }
+
+      if (!readTable(tables, numTables))
+        return false;
+    } else if (!readValue(tag, tables)) {
+      return false;
+    }
+
+    lua_rawset(_L, table);
+  }
+}
+
+bool Deserializer::readValue(uint8_t tag, int tables) {
+  switch (tag) {
+  case kSaveTagFalse:
+  case kSaveTagTrue: {
+    lua_pushboolean(_L, tag == kSaveTagTrue);
+    break;
+  }
+  case kSaveTagNumber: {
+    lua_pushnumber(_L, _readDouble());
+    break;
+  }
+  case kSaveTagString: {
+    // Damaged saves mustn't make us allocate more than could be there
+    uint32_t len = _readBE32();
+    if (_isTruncated || len > _remaining())
+      return false;
+
+    std::vector<char> buf(len);
+    if (len > 0 && !_read(buf.data(), len))
+      return false;
+    lua_pushlstring(_L, buf.data(), len);
+    break;
+  }
+  case kSaveTagReference: {
+    uint32_t id = _readBE32();
+    lua_rawgeti(_L, tables, id + 1);
+    if (!lua_istable(_L, -1)) {
+      lua_pop(_L, 1);
+      return false;
+    }
+    break;
+  }
+  default:
+    return false;
+  }
+
+  return true;
+}
+
+bool Deserializer::readTextScriptData() {
+  uint32_t numFields = _readBE32();
+  for (uint32_t i = 0; i < numFields; i++) {
+    uint16_t lineLen = _readBE16();
+    std::vector<uint8_t> lineBuf(lineLen);
+    if (!_read(lineBuf.data(), lineBuf.capacity()))
+      return false;
+
+    std::string line(lineBuf.begin(), lineBuf.end());
+    int errCode = luaL_dostring(_L, line.c_str());
+    if (errCode != 0) { // Perhaps one of the tables we are inserting into doesn't exist
+      // TODO: begin creating empty tables at the deepest level of the line
+    }
   }
 
-  *size = readerData->numBytes;
-  return readerData->buf;
+  return true;
+}
+
+bool Deserializer::readTimer(double trigger, double elapsed, bool isLoopable, uint32_t funcLen) {
+  // Bounded before allocating, so a corrupt length can't ask for gigabytes
+  if (_isTruncated || funcLen > kSaveMaxSize || funcLen > _remaining())
+    return false;
+
+  std::vector<char> funcBuf(funcLen);
+  if (funcLen > 0 && !_read(funcBuf.data(), funcLen))
+    return false;
+
+  LuaReaderData data;
+  data.buf = funcBuf.data();
+  data.size = funcLen;
+
+  int errCode = lua_load(_L, readFunction, &data, "");
+  if (errCode != 0) {
+    Log::instance().warning(kModScript, "Couldn't read timer function. Error: %s",
+                            lua_tostring(_L, -1));
+    lua_pop(_L, 1);
+    return true;
+  }
+
+  int ref = luaL_ref(_L, LUA_REGISTRYINDEX);
+  int handle = TimerManager::instance().create(trigger, isLoopable, ref);
+  TimerManager::instance().rewind(handle, elapsed); // Rewind start time.
+  return true;
+}
+
+void Deserializer::setFieldOfView(float fov) {
+  bool lock = CameraManager::instance().isLocked();
+  if (lock)
+    CameraManager::instance().unlock();
+  CameraManager::instance().setFieldOfView(fov);
+  if (lock)
+    CameraManager::instance().lock();
+}
+
+void Deserializer::_clearTable(int index) {
+  lua_pushnil(_L);
+  while (lua_next(_L, index) != 0) {
+    lua_pop(_L, 1);
+    lua_pushvalue(_L, -1);
+    lua_pushnil(_L);
+    lua_rawset(_L, index);
+  }
+}
+
+bool Deserializer::_expand() {
+  uint32_t size = _readBE32();
+  uint32_t compressedSize = _readBE32();
+  if (_isTruncated || size > kSaveMaxSize || compressedSize > kSaveMaxSize)
+    return false;
+
+  std::vector<uint8_t> src(compressedSize);
+  if (compressedSize > 0 && !_read(src.data(), compressedSize))
+    return false;
+
+  std::vector<char> dst;
+  dst.reserve(size);
+
+  // Every length and offset is checked, since the file may be corrupt
+  size_t i = 0;
+  while (i < compressedSize) {
+    uint8_t token = src[i++];
+
+    size_t numLiterals = token >> 4;
+    if (numLiterals == 15) {
+      uint8_t byte;
+      do {
+        if (i == compressedSize)
+          return false;
+        byte = src[i++];
+        numLiterals += byte;
+      } while (byte == 255);
+    }
+
+    if (numLiterals > compressedSize - i || dst.size() + numLiterals > size)
+      return false;
+    dst.insert(dst.end(), src.begin() + i, src.begin() + i + numLiterals);
+    i += numLiterals;
+
+    // The last sequence ends with its literals
+    if (i == compressedSize)
+      break;
+
+    if (compressedSize - i < 2)
+      return false;
+    size_t offset = src[i] | (src[i + 1] << 8);
+    i += 2;
+
+    size_t matchLength = token & 15;
+    if (matchLength == 15) {
+      uint8_t byte;
+      do {
+        if (i == compressedSize)
+          return false;
+        byte = src[i++];
+        matchLength += byte;
+      } while (byte == 255);
+    }
+    matchLength += kSaveMinMatch;
+
+    if (offset == 0 || offset > dst.size() || dst.size() + matchLength > size)
+      return false;
+
+    // Matches may overlap what they produce, so copy one byte at a time
+    size_t from = dst.size() - offset;
+    for (size_t j = 0; j < matchLength; j++)
+      dst.push_back(dst[from + j]);
+  }
+
+  if (dst.size() != size)
+    return false;
+
+  // The rest of the save is read from memory
+  _buffer.swap(dst);
+  _offset = 0;
+  _size = _buffer.size();
+  _isExpanded = true;
+  return true;
+}
+
+bool Deserializer::_read(void *data, size_t size) {
+  char *dst = static_cast<char*>(data);
+  while (size > 0) {
+    if (_offset == _size) {
+      _offset = 0;
+      _size = _isExpanded ? 0 : SDL_RWread(_rw, _buffer.data(), 1, _buffer.size());
+      if (_size == 0) {
+        _isTruncated = true;
+        return false;
+      }
+    }
+
+    size_t len = std::min(size, _size - _offset);
+    std::memcpy(dst, &_buffer[_offset], len);
+    _offset += len;
+    dst += len;
+    size -= len;
+  }
+
+  return true;
+}
+
+size_t Deserializer::_remaining() {
+  size_t remaining = _size - _offset;
+  if (_isExpanded)
+    return remaining;
+
+  // Also what's still in the file, or the largest save if that's unknown
+  Sint64 size = SDL_RWsize(_rw);
+  Sint64 position = SDL_RWtell(_rw);
+  if (size < 0 || position < 0)
+    return kSaveMaxSize;
+
+  if (size > position)
+    remaining += static_cast<size_t>(size - position);
+  return remaining;
+}
+
+void Deserializer::_swapSource(std::vector<char> *buffer, size_t *offset, size_t *size) {
+  _buffer.swap(*buffer);
+  std::swap(_offset, *offset);
+  std::swap(_size, *size);
+}
+
+uint16_t Deserializer::_readBE16() {
+  uint8_t bytes[2];
+  if (!_read(bytes, sizeof(bytes)))
+    return 0;
+
+  return static_cast<uint16_t>((bytes[0] << 8) | bytes[1]);
+}
+
+uint32_t Deserializer::_readBE32() {
+  uint32_t high = _readBE16();
+  return (high << 16) | _readBE16();
+}
+
+double Deserializer::_readDouble() {
+  uint64_t high = _readBE32();
+  uint64_t bits = (high << 32) | _readBE32();
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+bool Deserializer::_readString8(std::string *str) {
+  uint8_t len = _readU8();
+  std::vector<char> buf(len);
+  if (len > 0 && !_read(buf.data(), len))
+    return false;
+
+  str->assign(buf.begin(), buf.end());
+  return true;
+}
+
+uint8_t Deserializer::_readU8() {
+  uint8_t value;
+  if (!_read(&value, sizeof(value)))
+    return 0;
+
+  return value;
 }
 
 ////////////////////////////////////////////////////////////
@@ -79,64 +457,136 @@ std::string Deserializer::roomName() {
 ////////////////////////////////////////////////////////////
 
 bool Deserializer::readHeader() {
-  { // Read magic number
-    char buf[sizeof(SAVIdent)];
-    if (!SDL_RWread(_rw, buf, sizeof(SAVIdent), 1))
+  { // Read magic number and format
+    char buf[sizeof(SAVIdent) + 1];
+    if (!_read(buf, sizeof(buf)))
       return false;
     if (std::memcmp(SAVIdent, buf, sizeof(SAVIdent)) != 0) {
       Log::instance().error(kModScript, "Unexpected magic number. This is not a Dagon save file.");
       return false;
     }
-  }
 
-  { // Read Dagon version string
-    uint8_t len = SDL_ReadU8(_rw);
-    std::vector<uint8_t> buf(len);
-    if (len > 0 && !SDL_RWread(_rw, buf.data(), buf.capacity(), 1))
+    _format = buf[sizeof(SAVIdent)] == 'E' ? kSaveFormatText : buf[sizeof(SAVIdent)];
+    if (_format < kSaveFormatText || _format > kSaveFormatCurrent) {
+      Log::instance().error(kModScript, "Unknown save format: %d", _format);
       return false;
-    _dgVersion = std::string(buf.begin(), buf.end());
+    }
   }
 
-  { // Read preview text
-    uint8_t len = SDL_ReadU8(_rw);
-    std::vector<uint8_t> buf(len);
-    if (len > 0 && !SDL_RWread(_rw, buf.data(), buf.capacity(), 1))
-      return false;
-    _preview = std::string(buf.begin(), buf.end());
+  // Read Dagon version string, preview text and room name
+  return _readString8(&_dgVersion) && _readString8(&_preview) && _readString8(&_roomName);
+}
+
+bool Deserializer::readJournal(SDL_RWops *rw) {
+  // Journals are only kept next to saves in the current format, so
+  // anything else was left behind and is ignored
+  if (_format < kSaveFormatCompressed) {
+    SDL_RWclose(rw);
+    return true;
   }
 
-  { // Read Room name
-    uint8_t len = SDL_ReadU8(_rw);
-    std::vector<uint8_t> buf(len);
-    if (len > 0 && !SDL_RWread(_rw, buf.data(), buf.capacity(), 1))
-      return false;
-    _roomName = std::string(buf.begin(), buf.end());
+  Sint64 fileSize = SDL_RWsize(rw);
+  std::vector<char> journal(fileSize > 0 && fileSize <= kSaveMaxSize ? fileSize : 0);
+  bool isRead = fileSize >= 0 && fileSize <= kSaveMaxSize &&
+                SDL_RWread(rw, journal.data(), 1, journal.size()) == journal.size();
+  SDL_RWclose(rw);
+
+  // The save itself comes first, so it's expanded now
+  if (!isRead || (!_isExpanded && !_expand()))
+    return false;
+
+  bool isTruncated = _isTruncated;
+  size_t offset = 0;
+  size_t size = journal.size();
+  _swapSource(&journal, &offset, &size);
+
+  while (_size - _offset >= 8) {
+    uint32_t length = _readBE32();
+    uint32_t checksum = _readBE32();
+
+    // A record cut short, most likely by a crash, ends the journal
+    if (length > _size - _offset || Serializer::checksum(&_buffer[_offset], length) != checksum)
+      break;
+
+    size_t start = _offset;
+    size_t end = start + length;
+    SaveRecord record;
+    std::string version, preview, roomName;
+    if (!_readString8(&version) || !_readString8(&preview) || !_readString8(&roomName) ||
+        _offset + 4 > end)
+      break;
+
+    record.keysSize = _readBE32();
+    record.keysOffset = _offset - start;
+    if (_isTruncated || record.keysSize > end - _offset)
+      break;
+    _offset += record.keysSize;
+    if (_offset + 4 > end)
+      break;
+
+    record.spotsSize = _readBE32();
+    record.spotsOffset = _offset - start;
+    if (_isTruncated || record.spotsSize > end - _offset)
+      break;
+    _offset += record.spotsSize;
+
+    record.stateOffset = _offset - start;
+    record.data.assign(_buffer.begin() + start, _buffer.begin() + end);
+    _records.push_back(record);
+    _offset = end;
+
+    _dgVersion = version;
+    _preview = preview;
+    _roomName = roomName;
   }
 
+  _swapSource(&journal, &offset, &size);
+  _isTruncated = isTruncated;
+
   return true;
 }
 
 bool Deserializer::readScriptData() {
-  uint32_t numFields = SDL_ReadBE32(_rw);
-  for (uint32_t i = 0; i < numFields; i++) {
-    uint16_t lineLen = SDL_ReadBE16(_rw);
-    std::vector<uint8_t> lineBuf(lineLen);
-    if (!SDL_RWread(_rw, lineBuf.data(), lineBuf.capacity(), 1))
-      return false;
+  if (_format == kSaveFormatText)
+    return readTextScriptData();
 
-    std::string line(lineBuf.begin(), lineBuf.end());
-    int errCode = luaL_dostring(_L, line.c_str());
-    if (errCode != 0) { // Perhaps one of the tables we are inserting into doesn't exist
-      // TODO: begin creating empty tables at the deepest level of the line
-    }
+  if (_format >= kSaveFormatCompressed && !_isExpanded && !_expand())
+    return false;
+
+  int top = lua_gettop(_L);
+  Script::pushPersistence(_L);
+  if (!lua_istable(_L, -1)) {
+    lua_pop(_L, 1);
+    lua_newtable(_L);
+    lua_pushvalue(_L, -1);
+    lua_setglobal(_L, "dgPersistence");
   }
 
-  return true;
+  lua_newtable(_L); // Tables read so far, by id
+  lua_insert(_L, -2);
+
+  int numTables = 0;
+  bool result = (_readU8() == kSaveTagTable) && readTable(lua_gettop(_L) - 1, &numTables);
+
+  // Then what changed in each delta save
+  for (SaveRecord &record : _records) {
+    if (!result)
+      break;
+
+    size_t offset = record.keysOffset;
+    size_t size = record.keysOffset + record.keysSize;
+    _swapSource(&record.data, &offset, &size);
+    result = readChangedKeys(top + 2);
+    _swapSource(&record.data, &offset, &size);
+  }
+  lua_settop(_L, top);
+
+  return result;
 }
 
 void Deserializer::toggleSpots() {
   // Restore spot activation statuses
-  uint16_t numRooms = SDL_ReadBE16(_rw);
+  uint16_t numRooms = _readBE16();
   if (numRooms != Control::instance().numRooms()) {
     Log::instance().warning(kModScript, "Room number mismatch. Expected %d. Got %d", numRooms,
                             Control::instance().numRooms());
@@ -146,7 +596,7 @@ void Deserializer::toggleSpots() {
     if (numRooms == 0)
       break;
 
-    uint16_t numNodes = SDL_ReadBE16(_rw);
+    uint16_t numNodes = _readBE16();
     if (numNodes != room->numNodes()) {
       Log::instance().warning(kModScript, "Node number mismatch. Expected %d. Got %d", numNodes,
                               room->numNodes());
@@ -158,7 +608,7 @@ void Deserializer::toggleSpots() {
       do {
         Node *node = room->iterator();
 
-        uint16_t numSpots = SDL_ReadBE16(_rw);
+        uint16_t numSpots = _readBE16();
         if (numSpots != node->numSpots()) {
           Log::instance().warning(kModScript, "Spot number mismatch. Expected %d. Got %d",
                                   numSpots, node->numSpots());
@@ -170,7 +620,7 @@ void Deserializer::toggleSpots() {
           do {
             Spot *spot = node->currentSpot();
 
-            bool enable = SDL_ReadU8(_rw);
+            bool enable = _readU8();
             if (enable)
               spot->enable(true); // TODO: find out if we should always force enable.
             else
@@ -181,7 +631,7 @@ void Deserializer::toggleSpots() {
 
           // Read remaining spots (necessary if number of spots has been reduced)
           for (size_t i = 0; i < numSpots; i++)
-            SDL_ReadU8(_rw);
+            _readU8();
         }
 
         numNodes--;
@@ -189,9 +639,9 @@ void Deserializer::toggleSpots() {
 
       // Read remaining nodes (necessary if number of nodes has been reduced)
       for (size_t i = 0; i < numNodes; i++) {
-        uint16_t numSpots = SDL_ReadBE16(_rw);
+        uint16_t numSpots = _readBE16();
         for (size_t j = 0; j < numSpots; j++)
-          SDL_ReadU8(_rw);
+          _readU8();
       }
     }
 
@@ -200,18 +650,35 @@ void Deserializer::toggleSpots() {
 
   // Read remaining rooms (necessary if number of rooms has been reduced)
   for (size_t i = 0; i < numRooms; i++) {
-    uint16_t numNodes = SDL_ReadBE16(_rw);
+    uint16_t numNodes = _readBE16();
     for (size_t j = 0; j < numNodes; j++) {
-      uint16_t numSpots = SDL_ReadBE16(_rw);
+      uint16_t numSpots = _readBE16();
       for (size_t k = 0; k < numSpots; k++)
-        SDL_ReadU8(_rw);
+        _readU8();
     }
   }
+
+  // Then what changed in each delta save
+  for (SaveRecord &record : _records) {
+    size_t offset = record.spotsOffset;
+    size_t size = record.spotsOffset + record.spotsSize;
+    _swapSource(&record.data, &offset, &size);
+    readChangedSpots();
+    _swapSource(&record.data, &offset, &size);
+  }
+
+  // The rest of the room state is read from the last one
+  if (!_records.empty()) {
+    SaveRecord &record = _records.back();
+    _buffer.swap(record.data);
+    _offset = record.stateOffset;
+    _size = _buffer.size();
+  }
 }
 
 Node *Deserializer::readNode() {
   Room *room = Control::instance().currentRoom();
-  uint16_t nodeIdx = SDL_ReadBE16(_rw);
+  uint16_t nodeIdx = _readBE16();
   Node *node;
 
   if (room->hasNodes()) {
@@ -230,9 +697,22 @@ Node *Deserializer::readNode() {
 }
 
 bool Deserializer::adjustCamera() {
-  uint8_t hAngleLen = SDL_ReadU8(_rw);
+  if (_format >= kSaveFormatCompressed) {
+    int hAngle = static_cast<int32_t>(_readBE32());
+    int vAngle = static_cast<int32_t>(_readBE32());
+    float fov = static_cast<float>(_readDouble());
+    if (_isTruncated)
+      return false;
+
+    CameraManager::instance().setAngleHorizontal(hAngle);
+    CameraManager::instance().setAngleVertical(vAngle);
+    setFieldOfView(fov);
+    return true;
+  }
+
+  uint8_t hAngleLen = _readU8();
   std::vector<uint8_t> hAngleBuf(hAngleLen);
-  if (!SDL_RWread(_rw, hAngleBuf.data(), hAngleBuf.capacity(), 1))
+  if (!_read(hAngleBuf.data(), hAngleBuf.capacity()))
     return false;
   const std::string hAngleStr(hAngleBuf.begin(), hAngleBuf.end());
 
@@ -244,9 +724,9 @@ bool Deserializer::adjustCamera() {
     Log::instance().warning(kModScript, "Unable to parse horizontal angle: %s", hAngleStr);
   }
 
-  uint8_t vAngleLen = SDL_ReadU8(_rw);
+  uint8_t vAngleLen = _readU8();
   std::vector<uint8_t> vAngleBuf(vAngleLen);
-  if (!SDL_RWread(_rw, vAngleBuf.data(), vAngleBuf.capacity(), 1))
+  if (!_read(vAngleBuf.data(), vAngleBuf.capacity()))
     return false;
   const std::string vAngleStr(vAngleBuf.begin(), vAngleBuf.end());
 
@@ -258,20 +738,14 @@ bool Deserializer::adjustCamera() {
     Log::instance().warning(kModScript, "Unable to parse vertical angle: %s", vAngleStr);
   }
 
-  uint8_t fovLen = SDL_ReadU8(_rw);
+  uint8_t fovLen = _readU8();
   std::vector<uint8_t> fovBuf(fovLen);
-  if (!SDL_RWread(_rw, fovBuf.data(), fovBuf.capacity(), 1))
+  if (!_read(fovBuf.data(), fovBuf.capacity()))
     return false;
   const std::string fovStr(fovBuf.begin(), fovBuf.end());
 
   try {
-    float fov = std::stof(fovStr);
-    bool lock = CameraManager::instance().isLocked();
-    if (lock)
-      CameraManager::instance().unlock();
-    CameraManager::instance().setFieldOfView(fov);
-    if (lock)
-      CameraManager::instance().lock();
+    setFieldOfView(std::stof(fovStr));
   }
   catch (std::exception &e) {
     Log::instance().warning(kModScript, "Unable to parse field of view: %s", fovStr);
@@ -283,14 +757,14 @@ bool Deserializer::adjustCamera() {
 void Deserializer::toggleAudio() {
   Room *room = Control::instance().currentRoom();
 
-  uint16_t numAudios = SDL_ReadBE16(_rw);
+  uint16_t numAudios = _readBE16();
   if (numAudios != room->arrayOfAudios().size()) {
     Log::instance().warning(kModScript, "Audio number mismatch. Expected %d. Got %d", numAudios,
                             room->arrayOfAudios().size());
   }
 
   for (Audio *audio : room->arrayOfAudios()) {
-    uint8_t state = SDL_ReadU8(_rw);
+    uint8_t state = _readU8();
 
     switch (state) {
     case kAudioInitial: {
@@ -320,62 +794,52 @@ void Deserializer::toggleAudio() {
 
   // Read remaining audios (necessary if number of audios has been reduced)
   for (uint16_t i = 0; i < numAudios; i++)
-    SDL_ReadU8(_rw);
+    _readU8();
 }
 
 bool Deserializer::readTimers() {
-  uint16_t numTimers = SDL_ReadBE16(_rw);
+  uint16_t numTimers = _readBE16();
 
   for (uint16_t i = 0; i < numTimers; i++) {
-    bool isLoopable = SDL_ReadU8(_rw);
+    bool isLoopable = _readU8();
 
-    uint8_t triggerLen = SDL_ReadU8(_rw);
+    if (_format >= kSaveFormatCompressed) {
+      double trigger = _readDouble();
+      double elapsed = _readDouble();
+      uint32_t funcLen = _readBE32();
+      if (!readTimer(trigger, elapsed, isLoopable, funcLen))
+        return false;
+      continue;
+    }
+
+    uint8_t triggerLen = _readU8();
     std::vector<uint8_t> triggerBuf(triggerLen);
-    if (!SDL_RWread(_rw, triggerBuf.data(), triggerBuf.capacity(), 1))
+    if (!_read(triggerBuf.data(), triggerBuf.capacity()))
       return false;
     const std::string triggerStr(triggerBuf.begin(), triggerBuf.end());
 
     try {
       double trigger = std::stod(triggerStr);
 
-      uint8_t elapsedLen = SDL_ReadU8(_rw);
+      uint8_t elapsedLen = _readU8();
       std::vector<uint8_t> elapsedBuf(elapsedLen);
-      if (!SDL_RWread(_rw, elapsedBuf.data(), elapsedBuf.capacity(), 1))
+      if (!_read(elapsedBuf.data(), elapsedBuf.capacity()))
         return false;
       const std::string elapsedStr(elapsedBuf.begin(), elapsedBuf.end());
 
       try {
         double elapsed = std::stod(elapsedStr);
 
-        LuaReaderData data;
-        uint16_t funcLen = SDL_ReadBE16(_rw);
-        std::vector<char> funcBuf(funcLen);
-        data.rw = _rw;
-        data.numBytes = funcLen;
-        data.buf = funcBuf.data();
-        data.readError = false;
-
-        int errCode = lua_load(_L, readFunction, &data, "");
-        if (data.readError)
+        if (!readTimer(trigger, elapsed, isLoopable, _readBE16()))
           return false;
-        if (errCode != 0) {
-          Log::instance().warning(kModScript, "Couldn't read timer function. Error: %s",
-                                  lua_tostring(_L, -1));
-          lua_pop(_L, 1);
-          continue;
-        }
-        
-        int ref = luaL_ref(_L, LUA_REGISTRYINDEX);
-        TimerManager::instance().create(trigger, isLoopable, ref);
-        TimerManager::instance().timers().back().lastTime -= elapsed; // Rewind start time.
       }
       catch (std::exception &e) {
         Log::instance().warning(kModScript, "Malformed timer. Couldn't parse time %s",
                                 elapsedStr);
         { // Read function block
-          uint16_t len = SDL_ReadBE16(_rw);
+          uint16_t len = _readBE16();
           std::vector<uint8_t> buf(len);
-          if (!SDL_RWread(_rw, buf.data(), buf.capacity(), 1))
+          if (!_read(buf.data(), buf.capacity()))
             return false;
         }
         continue;
@@ -384,15 +848,15 @@ bool Deserializer::readTimers() {
     catch (std::exception &e) {
       Log::instance().warning(kModScript, "Malformed timer. Couldn't parse time %s", triggerStr);
       { // Read string block
-        uint8_t len = SDL_ReadU8(_rw);
+        uint8_t len = _readU8();
         std::vector<uint8_t> buf(len);
-        if (!SDL_RWread(_rw, buf.data(), buf.capacity(), 1))
+        if (!_read(buf.data(), buf.capacity()))
           return false;
       }
       { // Read function block
-        uint16_t len = SDL_ReadBE16(_rw);
+        uint16_t len = _readBE16();
         std::vector<uint8_t> buf(len);
-        if (!SDL_RWread(_rw, buf.data(), buf.capacity(), 1))
+        if (!_read(buf.data(), buf.capacity()))
           return false;
       }
       continue;
@@ -403,7 +867,7 @@ bool Deserializer::readTimers() {
 }
 
 void Deserializer::readControlMode() {
-  uint8_t controlMode = SDL_ReadU8(_rw);
+  uint8_t controlMode = _readU8();
   switch (controlMode) {
   case kControlDrag:
   case kControlFixed:
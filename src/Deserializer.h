@@ -24,27 +24,65 @@
 #include <SDL2/SDL_rwops.h>
 
 #include <string>
+#include <vector>
 
 namespace dagon {
 
+// Delta saves read from the journal, with the position and size of
+// their sections
 typedef struct {
-  SDL_RWops *rw;
-  uint16_t numBytes;
-  const char *buf;
-  bool readError;
-}LuaReaderData;
+  std::vector<char> data;
+  size_t keysOffset;
+  size_t keysSize;
+  size_t spotsOffset;
+  size_t spotsSize;
+  size_t stateOffset;
+} SaveRecord;
 
 class Deserializer {
   lua_State *_L;
   SDL_RWops *_rw;
 
+  // Saves are read in chunks rather than a few bytes at a time
+  std::vector<char> _buffer;
+  size_t _offset;
+  size_t _size;
+
+  int _format;
+  bool _isExpanded; // Reading what was decompressed rather than the file
+  bool _isTruncated;
   std::string _dgVersion;
   std::string _preview;
   std::string _roomName;
+  std::vector<SaveRecord> _records;
 
   // Lua callback for reading a function
   static const char *readFunction(lua_State *L, void *data, size_t *size);
 
+  bool readChangedKeys(int data);
+  void readChangedSpots();
+  bool readTable(int tables, int *numTables);
+  bool readValue(uint8_t tag, int tables);
+  bool readTextScriptData();
+  bool readTimer(double trigger, double elapsed, bool isLoopable, uint32_t funcLen);
+  void setFieldOfView(float fov);
+
+  void _clearTable(int index);
+  bool _expand();
+  // Bytes left to read at most, for lengths to be checked against
+  size_t _remaining();
+  // Exchanges what's being read, such as a journal record for the save
+  void _swapSource(std::vector<char> *buffer, size_t *offset, size_t *size);
+
+  // Past the end of the file, these return zero like SDL_ReadU8 and others.
+  // That's also kSaveTagEnd, so _isTruncated must be checked after tags.
+  bool _read(void *data, size_t size);
+  uint16_t _readBE16();
+  uint32_t _readBE32();
+  double _readDouble();
+  bool _readString8(std::string *str);
+  uint8_t _readU8();
+
 public:
   Deserializer(lua_State *L, SDL_RWops *rw);
   ~Deserializer();
@@ -56,6 +94,9 @@ public:
 
   // State changes
   bool readHeader();
+  // Delta saves written after the full one. They're applied along with
+  // it, and the header and room state of the last one are used instead.
+  bool readJournal(SDL_RWops *rw);
   bool readScriptData();
   void toggleSpots();
   Node *readNode();
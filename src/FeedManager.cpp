@@ -62,6 +62,7 @@ void FeedManager::clear() {
 void FeedManager::init() {
   _feedAudio = new Audio;
   _feedAudio->setStatic();
+  _feedAudio->setPriority(kAudioPriorityFeed);
   audioManager.registerAudio(_feedAudio);
   
   _feedFont = fontManager.loadDefault();
@@ -109,28 +110,20 @@ void FeedManager::setFont(const char* fromFileName, unsigned int heightOfFont) {
 
 void FeedManager::show(const char* text) {
   if (config.subtitles && (strcmp(text, "") != 0)) {
-    std::string str = text;
-    std::size_t maxChars = config.displayWidth / _feedHeight;
-    std::size_t even = str.length() / (str.length() / maxChars + 1);
-    std::size_t currSpace = 0;
-    std::size_t nextSpace = 0;
+    std::vector<std::string> arrayOfLines;
+    std::size_t even = split(text, config.displayWidth / _feedHeight, &arrayOfLines);
     
     _dim();
-    while (nextSpace != str.npos) {
-      nextSpace = str.find(" " , even + currSpace);
-      std::string substr = str.substr(currSpace, (nextSpace - currSpace));
-      
+    for (std::size_t i = 0; i < arrayOfLines.size(); i++) {
       DGFeed feed;
       
-      strncpy(feed.text, substr.c_str(), kMaxFeedLength);
+      strncpy(feed.text, arrayOfLines[i].c_str(), kMaxFeedLength);
       _calculatePosition(&feed);
       feed.color = kColorWhite - 0xFF000000;
       feed.state = DGFeedFadeIn;
       feed.timerHandle = timerManager.createManual(even * DGFeedSpeed); // Trigger should be configurable
       
       _arrayOfActiveFeeds.push_back(feed);
-      
-      currSpace = currSpace + substr.length() + 1;
     }
   }
 }
@@ -148,6 +141,24 @@ void FeedManager::showAndPlay(const char* text, const char* audio) {
   }
 }
 
+std::size_t FeedManager::split(const std::string& text, std::size_t maxChars,
+                               std::vector<std::string>* arrayOfLines) {
+  // Lines are about even in length and always break at a space
+  std::size_t even = text.length() / (text.length() / maxChars + 1);
+  std::size_t currSpace = 0;
+  std::size_t nextSpace = 0;
+  
+  while (nextSpace != text.npos) {
+    nextSpace = text.find(" " , even + currSpace);
+    std::string substr = text.substr(currSpace, (nextSpace - currSpace));
+    arrayOfLines->push_back(substr);
+    
+    currSpace = currSpace + substr.length() + 1;
+  }
+  
+  return even;
+}
+
 void FeedManager::update() {
   std::vector<DGFeed>::iterator it;
   
@@ -187,16 +198,17 @@ void FeedManager::update() {
     
     if ((*it).state != DGFeedDiscard) {
       int displace = static_cast<int>((it - _arrayOfActiveFeeds.end() + 1) * (_feedHeight + DGFeedMargin));
+      const TextLayout* layout = _feedFont->layout((*it).text);
       
       // Shadow code
       if (DGFeedShadowEnabled) {
         _feedFont->setColor(kColorBlack & (*it).color);
-        _feedFont->wPrint((*it).location.x + DGFeedShadowDistance,
-                         (*it).location.y + displace + DGFeedShadowDistance, (*it).text);
+        _feedFont->draw(layout, (*it).location.x + DGFeedShadowDistance,
+                        (*it).location.y + displace + DGFeedShadowDistance);
       }
       
       _feedFont->setColor((*it).color);
-      _feedFont->wPrint((*it).location.x, (*it).location.y + displace, (*it).text);
+      _feedFont->draw(layout, (*it).location.x, (*it).location.y + displace);
     }
     
     ++it;
@@ -220,9 +232,7 @@ void FeedManager::update() {
 ////////////////////////////////////////////////////////////
 
 void FeedManager::_calculatePosition(DGFeed* feed) {
-  // We have no option but to estimate this
-  int width = static_cast<int>(_feedHeight * 0.66f);
-  int length = static_cast<int>(strlen(feed->text) * width);
+  int length = _feedFont->layout(feed->text)->width;
   feed->location = MakePoint((config.displayWidth >> 1) - (length / 2),
                              config.displayHeight - _feedHeight - DGFeedMargin);
 }
@@ -250,6 +260,7 @@ void FeedManager::_flush() {
     it = _arrayOfActiveFeeds.begin();
     while (it != _arrayOfActiveFeeds.end() && !_arrayOfActiveFeeds.empty()) {
       if ((*it).state == DGFeedDiscard) {
+        timerManager.destroy((*it).timerHandle);
         _arrayOfActiveFeeds.erase(it);
         done = false;
         break;
@@ -99,6 +99,9 @@ public:
   void setFont(const char* fromFileName, unsigned int heightOfFont);
   void show(const char* text);
   void showAndPlay(const char* text, const char* audio);
+  // Returns the length lines were evened to, which sets their duration
+  static std::size_t split(const std::string& text, std::size_t maxChars,
+                           std::vector<std::string>* arrayOfLines);
   void update();
 };
   
@@ -35,7 +35,13 @@ Font::Font() :
 config(Config::instance()),
 log(Log::instance())
 {
+  _face = NULL;
   _isLoaded = false;
+  _lineHeight = 0;
+  _pageSize = kFontPageSize;
+  _penX = 0;
+  _penY = 0;
+  _rowHeight = 0;
   this->setType(kObjectFont);
 }
 
@@ -44,87 +50,76 @@ log(Log::instance())
 ////////////////////////////////////////////////////////////
 
 void Font::clear() {
-  if (_isLoaded)
-    glDeleteTextures(kMaxChars, _textures);
+  if (_isLoaded) {
+    if (!_pages.empty())
+      glDeleteTextures(static_cast<GLsizei>(_pages.size()), &_pages[0]);
+    _pages.clear();
+    _glyphs.clear();
+    _layouts.clear();
+    FT_Done_Face(_face);
+    _face = NULL;
+    _isLoaded = false;
+  }
+}
+
+void Font::draw(const TextLayout* layout, int x, int y) {
+  if (_isLoaded && !layout->batches.empty()) {
+    glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT | GL_TRANSFORM_BIT);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glPushMatrix();
+    glTranslatef(static_cast<GLfloat>(x), static_cast<GLfloat>(y), 0);
+    
+    glTexCoordPointer(2, GL_FLOAT, 0, &layout->texCoords[0]);
+    glVertexPointer(2, GL_FLOAT, 0, &layout->coords[0]);
+    
+    std::vector<TextBatch>::const_iterator it = layout->batches.begin();
+    while (it != layout->batches.end()) {
+      glBindTexture(GL_TEXTURE_2D, (*it).texture);
+      glDrawArrays(GL_QUADS, (*it).first, (*it).count);
+      ++it;
+    }
+    
+    glPopMatrix();
+    glPopAttrib();
+  }
 }
 
 bool Font::isLoaded() {
   return _isLoaded;
 }
 
+const TextLayout* Font::layout(const char* text) {
+  std::string key = text;
+  std::unordered_map<std::string, TextLayout>::iterator it = _layouts.find(key);
+  if (it != _layouts.end()) {
+    it->second.isUsed = true;
+    return &it->second;
+  }
+  
+  if (_layouts.size() >= kFontMaxLayouts)
+    _purgeLayouts();
+  
+  TextLayout& layout = _layouts[key];
+  _layOut(&layout, text, strlen(text));
+  return &layout;
+}
+
 void Font::print(int x, int y, const char* text, ...) {
   if (_isLoaded) {
     char buffer[kMaxFeedLength];
     va_list ap;
     
     va_start(ap, text);
-    int length = vsnprintf(buffer, kMaxFeedLength, text, ap);
+    vsnprintf(buffer, kMaxFeedLength, text, ap);
     va_end(ap);
     
-    glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT | GL_TRANSFORM_BIT);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glPushMatrix();
-    glTranslatef(x, y, 0);
-    
-    for (const char* c = buffer; length > 0; c++, length--) {
-      int ch = *c;
-      
-      GLfloat texCoords[] = { 0, 0, 0, _glyph[ch].y,
-        _glyph[ch].x, _glyph[ch].y, _glyph[ch].x, 0 };
-      
-      GLshort coords[] = { 0, 0, 0, _glyph[ch].rows,
-        _glyph[ch].width, _glyph[ch].rows, _glyph[ch].width, 0 };
-      
-      glBindTexture(GL_TEXTURE_2D, _textures[ch]);
-      glTranslatef(static_cast<GLfloat>(_glyph[ch].left), 0, 0);
-      glPushMatrix();
-      glTranslatef(0, -static_cast<GLfloat>(_glyph[ch].top) + _height, 0);
-      glTexCoordPointer(2, GL_FLOAT, 0, texCoords);
-      glVertexPointer(2, GL_SHORT, 0, coords);
-      glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-      glPopMatrix();
-      glTranslatef(static_cast<GLfloat>(_glyph[ch].advance >> 6), 0, 0);
-    }
-    glPopMatrix();
-    glPopAttrib();
+    draw(layout(buffer), x, y);
   }
 }
 
 void Font::wPrint(int x, int y, const char* text) {
-  if (_isLoaded) {
-    size_t origsize = strlen(text) + 1;
-    wchar_t wcstring[kMaxFeedLength];
-   // setlocale(LC_CTYPE, "en_US.UTF-8");
-    mbstowcs(wcstring, text, origsize);
-   // setlocale(LC_ALL,"C");
-    
-    glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT | GL_TRANSFORM_BIT);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glPushMatrix();
-    glTranslatef(x, y, 0);
-    
-    size_t length = wcslen(wcstring);
-    for (const wchar_t* c = wcstring; length > 0; c++, length--) {
-      unsigned long ch = *c;
-      GLfloat texCoords[] = { 0, 0, 0, _glyph[ch].y,
-        _glyph[ch].x, _glyph[ch].y, _glyph[ch].x, 0 };
-      
-      GLshort coords[] = { 0, 0, 0, _glyph[ch].rows,
-        _glyph[ch].width, _glyph[ch].rows, _glyph[ch].width, 0 };
-      
-      glBindTexture(GL_TEXTURE_2D, _textures[ch]);
-      glTranslatef(static_cast<GLfloat>(_glyph[ch].left), 0, 0);
-      glPushMatrix();
-      glTranslatef(0, -static_cast<GLfloat>(_glyph[ch].top) + _height, 0);
-      glTexCoordPointer(2, GL_FLOAT, 0, texCoords);
-      glVertexPointer(2, GL_SHORT, 0, coords);
-      glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-      glPopMatrix();
-      glTranslatef(static_cast<GLfloat>(_glyph[ch].advance >> 6), 0, 0);
-    }
-    glPopMatrix();
-    glPopAttrib();
-  }
+  if (_isLoaded)
+    draw(layout(text), x, y);
 }
 
 // FIXME: This is a repeated method from RenderManager --
@@ -148,7 +143,6 @@ void Font::setDefault(unsigned int heightOfFont) {
   
   _height = heightOfFont;
   _loadFont(face);
-  FT_Done_Face(face);
 }
 
 void Font::setLibrary(FT_Library* library) {
@@ -169,71 +163,229 @@ void Font::setResource(const std::string &fromFileName,
   
   _height = heightOfFont;
   _loadFont(face);
-  FT_Done_Face(face);
 }
 
 ////////////////////////////////////////////////////////////
 // Implementation - Private methods
 ////////////////////////////////////////////////////////////
 
-void Font::_loadFont(FT_Face &face) {
-  FT_Set_Char_Size(face, _height << 6, _height << 6, 96, 96);
-  glGenTextures(kMaxChars, _textures);
+// Decodes one UTF-8 character and advances the pointer. Bytes that
+// aren't valid UTF-8 are taken as Latin-1, as they always were.
+uint32_t Font::_decode(const char* &c, const char* end) {
+  const unsigned char* u = reinterpret_cast<const unsigned char*>(c);
+  uint32_t ch = u[0];
+  int length = 0;
+  
+  if (ch >= 0xf0 && ch < 0xf8) {
+    length = 3;
+    ch &= 0x07;
+  }
+  else if (ch >= 0xe0) {
+    length = (ch < 0xf0) ? 2 : 0;
+    ch &= 0x0f;
+  }
+  else if (ch >= 0xc0) {
+    length = 1;
+    ch &= 0x1f;
+  }
   
-  for (wchar_t ch = 0; ch < kMaxChars; ch++) {
-    if (FT_Load_Glyph(face, FT_Get_Char_Index(face, ch), FT_LOAD_DEFAULT)) {
-      log.error(kModFont, "%s: %c", kString15006, ch);
-      return;
+  if (length && (c + length < end)) {
+    uint32_t decoded = ch;
+    int i = 1;
+    for (; i <= length; i++) {
+      if ((u[i] & 0xc0) != 0x80)
+        break;
+      decoded = (decoded << 6) | (u[i] & 0x3f);
     }
     
-    FT_Glyph glyph;
-    if (FT_Get_Glyph(face->glyph, &glyph)) {
-      log.error(kModFont, "%s: %c", kString15007, ch);
-      return;
+    if (i > length) {
+      c += length + 1;
+      return decoded;
+    }
+  }
+  
+  c++;
+  return u[0];
+}
+
+const Glyph* Font::_glyph(uint32_t ch) {
+  std::unordered_map<uint32_t, Glyph>::iterator it = _glyphs.find(ch);
+  if (it != _glyphs.end())
+    return &it->second;
+  
+  // Failed glyphs are stored empty so that they're not attempted again
+  Glyph& glyph = _glyphs[ch];
+  memset(&glyph, 0, sizeof(Glyph));
+  
+  if (FT_Load_Glyph(_face, FT_Get_Char_Index(_face, ch), FT_LOAD_DEFAULT)) {
+    log.error(kModFont, "%s: %u", kString15006, ch);
+    return &glyph;
+  }
+  
+  FT_Glyph ftGlyph;
+  if (FT_Get_Glyph(_face->glyph, &ftGlyph)) {
+    log.error(kModFont, "%s: %u", kString15007, ch);
+    return &glyph;
+  }
+  
+  FT_Glyph_To_Bitmap(&ftGlyph, ft_render_mode_normal, 0, 1);
+  FT_BitmapGlyph bitmapGlyph = (FT_BitmapGlyph)ftGlyph;
+  FT_Bitmap bitmap = bitmapGlyph->bitmap;
+  glyph = _makeGlyph(bitmap, bitmapGlyph, _face);
+  
+  int width = bitmap.width;
+  int height = bitmap.rows;
+  if (width && height) {
+    // Next row, or next page if this one is full
+    if (_penX + width + kFontPadding > _pageSize) {
+      _penX = 0;
+      _penY += _rowHeight + kFontPadding;
+      _rowHeight = 0;
     }
     
-    FT_Glyph_To_Bitmap(&glyph, ft_render_mode_normal, 0, 1);
-    FT_BitmapGlyph bitmapGlyph = (FT_BitmapGlyph)glyph;
-    FT_Bitmap bitmap = bitmapGlyph->bitmap;
-    
-    int width = _next(bitmap.width);
-    int height = _next(bitmap.rows);
-    GLubyte* expandedData;
-    expandedData = new GLubyte[2 * width * height];
+    if (_pages.empty() || (_penY + height + kFontPadding > _pageSize))
+      _openPage();
     
+    _expandedData.resize(2 * width * height);
     for (int j = 0; j < height; j++) {
       for (int i = 0; i < width; i++) {
-        expandedData[2 * (i + j * width)] =
-        expandedData[2 * (i + j * width) + 1] =
-        (i >= bitmap.width || j >= bitmap.rows) ?
-        0 : bitmap.buffer[i + bitmap.width * j];
+        _expandedData[2 * (i + j * width)] =
+        _expandedData[2 * (i + j * width) + 1] =
+        bitmap.buffer[i + bitmap.pitch * j];
       }
     }
     
-    float x = static_cast<float>(bitmap.width) / static_cast<float>(width);
-    float y = static_cast<float>(bitmap.rows) / static_cast<float>(height);
-    _glyph[ch] = _makeGlyph(x, y, bitmap, bitmapGlyph, face);
+    glBindTexture(GL_TEXTURE_2D, _pages.back());
+    glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, _penX, _penY, width, height,
+                    GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, &_expandedData[0]);
+    glPopClientAttrib();
+    
+    float size = static_cast<float>(_pageSize);
+    glyph.s0 = static_cast<float>(_penX) / size;
+    glyph.t0 = static_cast<float>(_penY) / size;
+    glyph.s1 = static_cast<float>(_penX + width) / size;
+    glyph.t1 = static_cast<float>(_penY + height) / size;
+    glyph.page = static_cast<int>(_pages.size()) - 1;
     
-    glBindTexture(GL_TEXTURE_2D, _textures[ch]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, 2, width, height, 0,
-                 GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, expandedData);
-    delete[] expandedData;
+    _penX += width + kFontPadding;
+    if (height > _rowHeight)
+      _rowHeight = height;
   }
+  
+  FT_Done_Glyph(ftGlyph);
+  return &glyph;
+}
+
+void Font::_loadFont(FT_Face &face) {
+  clear();
+  
+  _face = face;
+  FT_Set_Char_Size(_face, _height << 6, _height << 6, 96, 96);
+  _lineHeight = static_cast<int>(_face->size->metrics.height >> 6);
+  
+  // Large fonts get larger pages so that each still holds plenty of glyphs
+  _pageSize = _next(_height * 8);
+  if (_pageSize < kFontPageSize)
+    _pageSize = kFontPageSize;
+  
   _isLoaded = true;
+  
+  // Printable ASCII is nearly always needed, so it's ready up front
+  for (uint32_t ch = 32; ch < 127; ch++)
+    _glyph(ch);
 }
+
+// Glyphs are grouped by atlas page, so that each page takes a single
+// draw, which is normally all the string needs
+void Font::_layOut(TextLayout* layout, const char* text, size_t length) {
+  const char* end = text + length;
+  _arrayOfChars.clear();
+  _arrayOfGlyphs.clear();
+  while (text < end) {
+    uint32_t ch = _decode(text, end);
+    _arrayOfChars.push_back(ch);
+    _arrayOfGlyphs.push_back(_glyph(ch));
+  }
+  
+  // Position of each glyph and its line. The pen moves by the bearing
+  // as well as the advance, which is how text has always been spaced.
+  size_t numOfGlyphs = _arrayOfGlyphs.size();
+  _arrayOfPositions.assign(2 * numOfGlyphs, 0.0f);
   
-Glyph Font::_makeGlyph(float x, float y, FT_Bitmap bitmap,
-                       FT_BitmapGlyph bitmapGlyph, FT_Face face) {
+  int line = 0;
+  int width = 0;
+  GLfloat penX = 0.0f;
+  size_t i = 0;
+  for (i = 0; i < numOfGlyphs; i++) {
+    const Glyph* glyph = _arrayOfGlyphs[i];
+    
+    if (_arrayOfChars[i] == '\n') {
+      _arrayOfPositions[2 * i + 1] = -1.0f;
+      line++;
+      penX = 0.0f;
+      continue;
+    }
+    
+    GLfloat x = penX + glyph->left;
+    _arrayOfPositions[2 * i] = x;
+    _arrayOfPositions[2 * i + 1] = static_cast<GLfloat>(line);
+    penX = x + (glyph->advance >> 6);
+    
+    int right = static_cast<int>(penX);
+    if (right > width)
+      width = right;
+  }
+  
+  layout->coords.clear();
+  layout->texCoords.clear();
+  layout->batches.clear();
+  layout->coords.reserve(8 * numOfGlyphs);
+  layout->texCoords.reserve(8 * numOfGlyphs);
+  layout->width = width;
+  layout->height = (line + 1) * _lineHeight;
+  layout->isUsed = true;
+  
+  for (size_t page = 0; page < _pages.size(); page++) {
+    TextBatch batch;
+    batch.texture = _pages[page];
+    batch.first = static_cast<GLint>(layout->coords.size() / 2);
+    
+    for (i = 0; i < numOfGlyphs; i++) {
+      const Glyph* glyph = _arrayOfGlyphs[i];
+      GLfloat glyphLine = _arrayOfPositions[2 * i + 1];
+      if (glyph->page != static_cast<int>(page) || !glyph->width || glyphLine < 0.0f)
+        continue;
+      
+      GLfloat x0 = _arrayOfPositions[2 * i];
+      GLfloat y0 = glyphLine * _lineHeight + static_cast<GLfloat>(static_cast<int>(_height) - glyph->top);
+      GLfloat x1 = x0 + glyph->width;
+      GLfloat y1 = y0 + glyph->rows;
+      
+      GLfloat coords[] = { x0, y0, x0, y1, x1, y1, x1, y0 };
+      GLfloat texCoords[] = { glyph->s0, glyph->t0, glyph->s0, glyph->t1,
+        glyph->s1, glyph->t1, glyph->s1, glyph->t0 };
+      layout->coords.insert(layout->coords.end(), coords, coords + 8);
+      layout->texCoords.insert(layout->texCoords.end(), texCoords, texCoords + 8);
+    }
+    
+    batch.count = static_cast<GLsizei>(layout->coords.size() / 2) - batch.first;
+    if (batch.count)
+      layout->batches.push_back(batch);
+  }
+}
+
+Glyph Font::_makeGlyph(FT_Bitmap bitmap, FT_BitmapGlyph bitmapGlyph,
+                       FT_Face face) {
   Glyph glyph;
-  glyph.x = x;
-  glyph.y = y;
+  glyph.s0 = glyph.t0 = glyph.s1 = glyph.t1 = 0.0f;
   glyph.width = bitmap.width;
   glyph.rows = bitmap.rows;
   glyph.left = bitmapGlyph->left;
   glyph.top = bitmapGlyph->top;
   glyph.advance = face->glyph->advance.x;
+  glyph.page = 0;
   return glyph;
 }
   
@@ -242,5 +394,40 @@ int Font::_next(int a) {
   while (rval < a) rval <<= 1;
   return rval;
 }
+
+// Drops the layouts that weren't used since the last purge,
+// or all of them if every one was
+void Font::_purgeLayouts() {
+  std::unordered_map<std::string, TextLayout>::iterator it = _layouts.begin();
+  while (it != _layouts.end()) {
+    if (it->second.isUsed) {
+      it->second.isUsed = false;
+      ++it;
+    }
+    else {
+      it = _layouts.erase(it);
+    }
+  }
+  
+  if (_layouts.size() >= kFontMaxLayouts)
+    _layouts.clear();
+}
+
+void Font::_openPage() {
+  std::vector<GLubyte> emptyData(2 * _pageSize * _pageSize, 0);
+  GLuint page;
+  
+  glGenTextures(1, &page);
+  glBindTexture(GL_TEXTURE_2D, page);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, 2, _pageSize, _pageSize, 0,
+               GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, &emptyData[0]);
+  _pages.push_back(page);
+  
+  _penX = 0;
+  _penY = 0;
+  _rowHeight = 0;
+}
   
 }
@@ -19,8 +19,9 @@
 ////////////////////////////////////////////////////////////
 
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <stdint.h>
-#include <wchar.h>
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -42,19 +43,46 @@ class Log;
 // Definitions
 ////////////////////////////////////////////////////////////
 
-const wchar_t kMaxChars = 256;
+// Glyphs are rasterized on demand into shared pages of this size, which
+// grow if the font is too large to fit a reasonable number of glyphs
+#define kFontPageSize 512
+#define kFontPadding 1
 
 // This structure holds information from the Freetype font
 typedef struct {
-  float x;
-  float y;
+  float s0;
+  float t0;
+  float s1;
+  float t1;
   GLshort width;
   GLshort rows;
   int left;
   int top;
   long advance;
+  int page;
 } Glyph;
 
+// Laid out strings kept by each font before unused ones are purged
+#define kFontMaxLayouts 128
+
+// Consecutive glyphs that share an atlas page
+typedef struct {
+  GLuint texture;
+  GLint first;
+  GLsizei count;
+} TextBatch;
+
+// A string laid out once, with vertices relative to its origin, so
+// that drawing it again only takes setting the color
+typedef struct {
+  std::vector<GLfloat> coords;
+  std::vector<GLfloat> texCoords;
+  std::vector<TextBatch> batches;
+  int width;
+  int height;
+  bool isUsed;
+} TextLayout;
+
 // When default font is selected, we use data embedded in the
 // executable and declared in FontData.cpp
 extern "C" const unsigned char kFontData[];
@@ -70,9 +98,16 @@ class Font : public Object {
   ~Font() {};
   
   void clear();
+  void draw(const TextLayout* layout, int x, int y);
   bool isLoaded();
+  
+  // Returns the cached layout of the string, measured with the actual
+  // glyphs. Newlines start a new line.
+  // NOTE: The layout may be purged by the next call, so don't keep it.
+  const TextLayout* layout(const char* text);
+  
   void print(int x, int y, const char* text, ...);
-  void wPrint(int x, int y, const char* text);
+  void wPrint(int x, int y, const char* text); // Same as print(), but unformatted
   void setColor(uint32_t color);
   void setDefault(unsigned int heightOfFont);
   void setLibrary(FT_Library* library);
@@ -82,16 +117,35 @@ class Font : public Object {
   Config& config;
   Log& log;
   
-  Glyph _glyph[kMaxChars];
+  FT_Face _face; // Kept open to rasterize glyphs as they're needed
+  std::unordered_map<uint32_t, Glyph> _glyphs;
+  std::unordered_map<std::string, TextLayout> _layouts;
   unsigned int _height;
+  int _lineHeight;
   bool _isLoaded;
   FT_Library* _library;
-  GLuint _textures[kMaxChars];
   
+  // Atlas pages, filled in rows from left to right
+  std::vector<GLuint> _pages;
+  int _pageSize;
+  int _penX;
+  int _penY;
+  int _rowHeight;
+  
+  // Scratch kept to avoid allocations on every layout
+  std::vector<uint32_t> _arrayOfChars;
+  std::vector<const Glyph*> _arrayOfGlyphs;
+  std::vector<GLfloat> _arrayOfPositions;
+  std::vector<GLubyte> _expandedData;
+  
+  uint32_t _decode(const char* &c, const char* end);
+  const Glyph* _glyph(uint32_t ch);
+  void _layOut(TextLayout* layout, const char* text, size_t length);
+  void _purgeLayouts();
   void _loadFont(FT_Face &face);
-  Glyph _makeGlyph(float x, float y, FT_Bitmap bitmap,
-                   FT_BitmapGlyph bitmapGlyph, FT_Face face);
+  Glyph _makeGlyph(FT_Bitmap bitmap, FT_BitmapGlyph bitmapGlyph, FT_Face face);
   int _next(int a);
+  void _openPage();
   
   Font(const Font&);
   void operator=(const Font&);
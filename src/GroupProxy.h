@@ -34,6 +34,7 @@ namespace dagon {
 class GroupProxy : public ObjectProxy {
  public:
   static const char className[];
+  static const int objectType = kObjectGroup;
   static Luna<GroupProxy>::RegType methods[];
 
   // Constructor
@@ -34,6 +34,7 @@ namespace dagon {
 class ImageProxy : public ObjectProxy {
 public:
   static const char className[];
+  static const int objectType = kObjectImage;
   static Luna<ImageProxy>::RegType methods[];
   
   // Constructor
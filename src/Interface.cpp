@@ -130,7 +130,7 @@ void Interface::drawOverlays() {
                   renderManager.setColor(button->textColor(), button->fadeLevel());
                 else
                   renderManager.setColor(button->textColor());
-                button->font()->print(position.x, position.y, button->text().c_str());
+                button->font()->wPrint(position.x, position.y, button->text().c_str());
                 renderManager.setColor(kColorWhite); // Reset the color
               }
             }
@@ -0,0 +1,405 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <SDL2/SDL_cpuinfo.h>
+#include <SDL2/SDL_timer.h>
+
+#include "JobManager.h"
+#include "Log.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Earliest due time on top
+static bool _compareDueTimes(const Job* a, const Job* b) {
+  return static_cast<Sint32>(a->dueTime - b->dueTime) > 0;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Constructor
+////////////////////////////////////////////////////////////
+
+JobManager::JobManager() :
+log(Log::instance())
+{
+  _handles = 0;
+  _nextWorker = 0;
+  _numOfWaiters = 0;
+  _isInitialized = false;
+  _isRunning = false;
+  SDL_AtomicSet(&_nextDueTime, 0);
+  SDL_AtomicSet(&_numOfQueuedJobs, 0);
+  
+  _condition = SDL_CreateCond();
+  _doneCondition = SDL_CreateCond();
+  _mutex = SDL_CreateMutex();
+  if (!_mutex)
+    log.error(kModSystem, "%s", kString18001);
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Destructor
+////////////////////////////////////////////////////////////
+
+JobManager::~JobManager() {
+  SDL_DestroyCond(_condition);
+  SDL_DestroyCond(_doneCondition);
+  SDL_DestroyMutex(_mutex);
+}
+
+////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////
+
+void JobManager::expedite(int handle) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    std::unordered_map<int, Job*>::iterator it = _jobs.find(handle);
+    if (it != _jobs.end()) {
+      Job* job = it->second;
+      Uint32 currentTime = SDL_GetTicks();
+      
+      if (static_cast<Sint32>(job->dueTime - currentTime) > 0) {
+        job->dueTime = currentTime;
+        
+        // Still waiting for its time, so it's in the heap
+        if (!job->pendingDependencies) {
+          std::make_heap(_arrayOfDelayedJobs.begin(), _arrayOfDelayedJobs.end(), _compareDueTimes);
+          SDL_AtomicSet(&_nextDueTime, static_cast<int>(currentTime));
+          SDL_CondSignal(_condition);
+        }
+      }
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModSystem, "%s", kString18002);
+  }
+}
+
+void JobManager::init() {
+  log.trace(kModSystem, "%s", kString13011);
+  
+  // Leave one core for the main thread
+  int numOfWorkers = SDL_GetCPUCount() - 1;
+  if (numOfWorkers < kJobMinWorkers)
+    numOfWorkers = kJobMinWorkers;
+  if (numOfWorkers > kJobMaxWorkers)
+    numOfWorkers = kJobMaxWorkers;
+  
+  _isRunning = true;
+  
+  for (int i = 0; i < numOfWorkers; i++) {
+    JobWorker* worker = new JobWorker;
+    worker->index = i;
+    worker->threadID = 0;
+    worker->mutex = SDL_CreateMutex();
+    _arrayOfWorkers.push_back(worker);
+  }
+  
+  // All workers must exist before any of them tries to steal
+  std::vector<JobWorker*>::iterator it = _arrayOfWorkers.begin();
+  while (it != _arrayOfWorkers.end()) {
+    (*it)->thread = SDL_CreateThread(_runThread, "JobManager", (void*)*it);
+    if ((*it)->thread) {
+      (*it)->threadID = SDL_GetThreadID((*it)->thread);
+    }
+    else {
+      log.error(kModSystem, "%s:%s", kString18003, SDL_GetError());
+    }
+    ++it;
+  }
+  
+  log.info(kModSystem, "%s: %d", kString13012, numOfWorkers);
+  
+  _isInitialized = true;
+}
+
+bool JobManager::isPending(int handle) {
+  bool isPending = false;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    isPending = (_jobs.find(handle) != _jobs.end());
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModSystem, "%s", kString18002);
+  }
+  
+  return isPending;
+}
+
+int JobManager::numOfWorkers() {
+  return static_cast<int>(_arrayOfWorkers.size());
+}
+
+int JobManager::submit(JobFunction function, void* data, int priority,
+                       int after, Uint32 delay) {
+  int handle = 0;
+  
+  if (!_isRunning)
+    return handle;
+  
+  Job* job = new Job;
+  job->function = function;
+  job->data = data;
+  job->priority = priority;
+  job->dueTime = SDL_GetTicks() + delay;
+  job->pendingDependencies = 0;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    handle = ++_handles;
+    job->handle = handle;
+    _jobs[handle] = job;
+    
+    std::unordered_map<int, Job*>::iterator it = _jobs.find(after);
+    if (after && (it != _jobs.end())) {
+      job->pendingDependencies++;
+      it->second->dependents.push_back(job);
+    }
+    else {
+      _dispatch(job);
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModSystem, "%s", kString18002);
+    delete job;
+  }
+  
+  return handle;
+}
+
+void JobManager::terminate() {
+  if (!_isInitialized)
+    return;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    _isRunning = false;
+    SDL_CondBroadcast(_condition);
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModSystem, "%s", kString18002);
+  }
+  
+  std::vector<JobWorker*>::iterator it = _arrayOfWorkers.begin();
+  while (it != _arrayOfWorkers.end()) {
+    int threadReturnValue;
+    SDL_WaitThread((*it)->thread, &threadReturnValue);
+    SDL_DestroyMutex((*it)->mutex);
+    delete *it;
+    ++it;
+  }
+  _arrayOfWorkers.clear();
+  
+  // Whatever didn't get to run is simply discarded
+  std::unordered_map<int, Job*>::iterator jobIt = _jobs.begin();
+  while (jobIt != _jobs.end()) {
+    delete jobIt->second;
+    ++jobIt;
+  }
+  _jobs.clear();
+  _arrayOfDelayedJobs.clear();
+  
+  _isInitialized = false;
+}
+
+void JobManager::wait(int handle) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    _numOfWaiters++;
+    while (_isRunning && (_jobs.find(handle) != _jobs.end()))
+      SDL_CondWait(_doneCondition, _mutex);
+    _numOfWaiters--;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModSystem, "%s", kString18002);
+  }
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+// Must be called with the mutex locked
+void JobManager::_dispatch(Job* job) {
+  if (static_cast<Sint32>(job->dueTime - SDL_GetTicks()) > 0) {
+    _arrayOfDelayedJobs.push_back(job);
+    std::push_heap(_arrayOfDelayedJobs.begin(), _arrayOfDelayedJobs.end(), _compareDueTimes);
+    SDL_AtomicSet(&_nextDueTime, static_cast<int>(_arrayOfDelayedJobs.front()->dueTime));
+    
+    // Idle workers may be sleeping past the new due time
+    SDL_CondSignal(_condition);
+  }
+  else {
+    _enqueue(job);
+  }
+}
+
+// Must be called with the mutex locked
+void JobManager::_enqueue(Job* job) {
+  // Jobs submitted by a job stay with the same worker, which is
+  // likely to have its data in cache. Others are spread evenly.
+  JobWorker* worker = _worker();
+  if (!worker) {
+    worker = _arrayOfWorkers[_nextWorker];
+    _nextWorker = (_nextWorker + 1) % _arrayOfWorkers.size();
+  }
+  
+  if (SDL_LockMutex(worker->mutex) == 0) {
+    worker->queues[job->priority].push_back(job);
+    SDL_AtomicIncRef(&_numOfQueuedJobs);
+    SDL_UnlockMutex(worker->mutex);
+  } else {
+    log.error(kModSystem, "%s", kString18002);
+  }
+  
+  SDL_CondSignal(_condition);
+}
+
+void JobManager::_finish(Job* job) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    std::vector<Job*>::iterator it = job->dependents.begin();
+    while (it != job->dependents.end()) {
+      if (--(*it)->pendingDependencies == 0)
+        _dispatch(*it);
+      ++it;
+    }
+    
+    _jobs.erase(job->handle);
+    if (_numOfWaiters)
+      SDL_CondBroadcast(_doneCondition);
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModSystem, "%s", kString18002);
+  }
+  
+  delete job;
+}
+
+// Own jobs are taken last in, first out
+Job* JobManager::_pop(JobWorker* worker) {
+  Job* job = NULL;
+  
+  if (SDL_LockMutex(worker->mutex) == 0) {
+    for (int i = 0; i < kJobNumOfPriorities; i++) {
+      if (!worker->queues[i].empty()) {
+        job = worker->queues[i].back();
+        worker->queues[i].pop_back();
+        break;
+      }
+    }
+    SDL_UnlockMutex(worker->mutex);
+  }
+  
+  return job;
+}
+
+// Must be called with the mutex locked. Returns how long until the next one is due.
+Uint32 JobManager::_releaseDelayedJobs() {
+  Uint32 currentTime = SDL_GetTicks();
+  
+  while (!_arrayOfDelayedJobs.empty()) {
+    Job* job = _arrayOfDelayedJobs.front();
+    Sint32 remaining = static_cast<Sint32>(job->dueTime - currentTime);
+    if (remaining > 0) {
+      SDL_AtomicSet(&_nextDueTime, static_cast<int>(job->dueTime));
+      return static_cast<Uint32>(remaining);
+    }
+    
+    std::pop_heap(_arrayOfDelayedJobs.begin(), _arrayOfDelayedJobs.end(), _compareDueTimes);
+    _arrayOfDelayedJobs.pop_back();
+    _enqueue(job);
+  }
+  
+  SDL_AtomicSet(&_nextDueTime, static_cast<int>(currentTime + kJobIdleTimeout));
+  return kJobIdleTimeout;
+}
+
+// Jobs of others are taken first in, first out, and by priority across
+// all workers so that a worker busy with a long load never holds
+// back streaming
+Job* JobManager::_steal(JobWorker* thief) {
+  int numOfWorkers = static_cast<int>(_arrayOfWorkers.size());
+  
+  for (int i = 0; i < kJobNumOfPriorities; i++) {
+    for (int j = 1; j < numOfWorkers; j++) {
+      JobWorker* victim = _arrayOfWorkers[(thief->index + j) % numOfWorkers];
+      if (SDL_TryLockMutex(victim->mutex) == 0) {
+        if (!victim->queues[i].empty()) {
+          Job* job = victim->queues[i].front();
+          victim->queues[i].pop_front();
+          SDL_UnlockMutex(victim->mutex);
+          return job;
+        }
+        SDL_UnlockMutex(victim->mutex);
+      }
+    }
+  }
+  
+  return NULL;
+}
+
+// The worker running on this thread, if any
+JobWorker* JobManager::_worker() {
+  SDL_threadID threadID = SDL_ThreadID();
+  std::vector<JobWorker*>::iterator it = _arrayOfWorkers.begin();
+  while (it != _arrayOfWorkers.end()) {
+    if ((*it)->threadID == threadID)
+      return *it;
+    ++it;
+  }
+  
+  return NULL;
+}
+
+int JobManager::_runThread(void *ptr) {
+  JobManager& jobManager = JobManager::instance();
+  JobWorker* worker = static_cast<JobWorker*>(ptr);
+  
+  while (jobManager._isRunning) {
+    // Cheap check so that busy workers still release delayed jobs on time
+    Uint32 nextDueTime = static_cast<Uint32>(SDL_AtomicGet(&jobManager._nextDueTime));
+    if (static_cast<Sint32>(SDL_GetTicks() - nextDueTime) >= 0) {
+      if (SDL_LockMutex(jobManager._mutex) == 0) {
+        jobManager._releaseDelayedJobs();
+        SDL_UnlockMutex(jobManager._mutex);
+      }
+    }
+    
+    Job* job = jobManager._pop(worker);
+    if (!job)
+      job = jobManager._steal(worker);
+    
+    if (job) {
+      SDL_AtomicAdd(&jobManager._numOfQueuedJobs, -1);
+      job->function(job->data);
+      jobManager._finish(job);
+      continue;
+    }
+    
+    // Nothing to do, so sleep until the next delayed job or more work
+    if (SDL_LockMutex(jobManager._mutex) == 0) {
+      Uint32 timeout = jobManager._releaseDelayedJobs();
+      if (jobManager._isRunning && (SDL_AtomicGet(&jobManager._numOfQueuedJobs) == 0))
+        SDL_CondWaitTimeout(jobManager._condition, jobManager._mutex, timeout);
+      SDL_UnlockMutex(jobManager._mutex);
+    }
+  }
+  
+  return 0;
+}
+
+}
@@ -0,0 +1,133 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef DAGON_JOBMANAGER_H_
+#define DAGON_JOBMANAGER_H_
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+
+#include <deque>
+#include <unordered_map>
+
+#include "Platform.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+#define kJobMaxWorkers 8
+#define kJobMinWorkers 2
+#define kJobIdleTimeout 1000
+
+class Log;
+
+enum JobPriorities {
+  kJobPriorityHigh,   // Streaming, must never starve
+  kJobPriorityNormal,
+  kJobPriorityLow,    // Loading ahead of time
+  kJobNumOfPriorities
+};
+
+typedef void (*JobFunction)(void* data);
+
+typedef struct Job {
+  JobFunction function;
+  void* data;
+  int handle;
+  int priority;
+  Uint32 dueTime;
+  int pendingDependencies;
+  std::vector<Job*> dependents;
+} Job;
+
+typedef struct {
+  SDL_Thread* thread;
+  SDL_threadID threadID;
+  SDL_mutex* mutex;
+  std::deque<Job*> queues[kJobNumOfPriorities];
+  int index;
+} JobWorker;
+
+////////////////////////////////////////////////////////////
+// Interface - Singleton class
+////////////////////////////////////////////////////////////
+
+class JobManager {
+  Log& log;
+  
+  SDL_cond* _condition; // Signaled when there's work for idle workers
+  SDL_cond* _doneCondition; // Signaled when a job finishes and someone waits
+  SDL_mutex* _mutex;
+  
+  std::vector<JobWorker*> _arrayOfWorkers;
+  std::vector<Job*> _arrayOfDelayedJobs; // Heap ordered by due time
+  std::unordered_map<int, Job*> _jobs; // Submitted and not yet finished
+  SDL_atomic_t _nextDueTime;
+  SDL_atomic_t _numOfQueuedJobs;
+  int _handles;
+  int _nextWorker;
+  int _numOfWaiters;
+  
+  bool _isInitialized;
+  bool _isRunning;
+  
+  // All of these must be called with the mutex locked
+  void _dispatch(Job* job);
+  void _enqueue(Job* job);
+  Uint32 _releaseDelayedJobs();
+  
+  void _finish(Job* job);
+  Job* _pop(JobWorker* worker);
+  Job* _steal(JobWorker* thief);
+  JobWorker* _worker();
+  static int _runThread(void *ptr);
+  
+  JobManager();
+  JobManager(JobManager const&);
+  JobManager& operator=(JobManager const&);
+  ~JobManager();
+  
+public:
+  static JobManager& instance() {
+    static JobManager jobManager;
+    return jobManager;
+  }
+  
+  // Jobs run once on any worker. A job may depend on another one, in
+  // which case it's held until that job finishes, and may be delayed by
+  // some milliseconds. Periodic work is done by jobs that submit
+  // themselves again. Handles are never zero.
+  int submit(JobFunction function, void* data, int priority = kJobPriorityNormal,
+             int after = 0, Uint32 delay = 0);
+  
+  // Runs a delayed job as soon as possible
+  void expedite(int handle);
+  bool isPending(int handle);
+  void wait(int handle);
+  
+  void init();
+  int numOfWorkers();
+  void terminate();
+};
+
+}
+
+#endif // DAGON_JOBMANAGER_H_
@@ -82,6 +82,10 @@
 #define kString13008 "Could not enter fullscreen"
 #define kString13009 "Could not exit fullscreen"
 #define kString13010 "Could not create window"
+#define kString13011 "Starting job workers..."
+#define kString13012 "Job workers"
+#define kString13013 "Could not write trace"
+#define kString13014 "Trace saved"
 
 // Script module
 #define kString14001 "Initializing script..."
@@ -99,6 +103,11 @@
 #define kString14013 "Syntax error"
 #define kString14014 "Function expected as second parameter in register()"
 #define kString14015 "Bad configuration file"
+#define kString14016 "Could not write save file"
+#define kString14017 "Could not write save index"
+#define kString14018 "Could not open saves directory"
+#define kString14019 "Could not take snapshot"
+#define kString14020 "Could not write compiled script"
 
 // Font module
 #define kString15001 "Initializing font manager..."
@@ -120,6 +129,9 @@
 #define kString16008 "File not found"
 #define kString16009 "Unsupported number of channels in file"
 #define kString16010 "Unable to initialize Ogg callbacks"
+#define kString16011 "No voices available to play"
+#define kString16012 "Buffer underruns"
+#define kString16013 "Invalid position for audio"
 
 // Video module
 #define kString17001 "Initializing video manager..."
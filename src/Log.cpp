@@ -28,12 +28,53 @@
 
 namespace dagon {
 
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+static const char* kLogMonths[] = {
+  "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+  "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+static const char* kLogModules[] = {
+  "        AUDIO",
+  "       CAMERA",
+  "CONFIGURATION",
+  "   CONTROLLER",
+  "         CORE",
+  "      EFFECTS",
+  "         FONT",
+  "       RENDER",
+  "       SCRIPT",
+  "        STATE",
+  "       SYSTEM",
+  "      TEXTURE",
+  "        VIDEO",
+  "      GENERAL"
+};
+
 ////////////////////////////////////////////////////////////
 // Implementation - Constructor
 ////////////////////////////////////////////////////////////
 
 Log::Log() :
 config(Config::instance()) {
+  for (int i = 0; i < kLogQueueSize; i++)
+    SDL_AtomicSet(&_queue[i].sequence, i);
+  SDL_AtomicSet(&_enqueuePosition, 0);
+  SDL_AtomicSet(&_numOfDropped, 0);
+  _dequeuePosition = 0;
+  
+  _historyStart = 0;
+  _historySize = 0;
+  _historyIndex = 0;
+  
+  _mutex = SDL_CreateMutex();
+  _semaphore = SDL_CreateSemaphore(0);
+  
+  _isRunning = false;
+  _thread = NULL;
 }
 
 ////////////////////////////////////////////////////////////
@@ -41,8 +82,19 @@ config(Config::instance()) {
 ////////////////////////////////////////////////////////////
 
 Log::~Log() {
+  _isRunning = false;
+  if (_thread) {
+    SDL_SemPost(_semaphore);
+    int threadReturnValue;
+    SDL_WaitThread(_thread, &threadReturnValue);
+  }
+  _drain();
+  
   if (_filestr.is_open())
     _filestr.close();
+  
+  SDL_DestroySemaphore(_semaphore);
+  SDL_DestroyMutex(_mutex);
 }
 
 ////////////////////////////////////////////////////////////
@@ -50,68 +102,67 @@ Log::~Log() {
 ////////////////////////////////////////////////////////////
 
 void Log::command(int forModule, const char* theString, ...) {
-  char buffer[kMaxLogLength];
   va_list args;
-  
   va_start(args, theString);
-  vsnprintf(&buffer[0], kMaxLogLength, theString, args);
+  _log(kColorBrightMagenta, forModule, kLogTrace, theString, args);
   va_end(args);
-  
-  LogData data = _makeLogData(kColorBrightMagenta, forModule, kLogTrace);
-  data.line = buffer;
-  _log(&data);
 }
 
 void Log::error(int forModule, const char* theString, ...) {
-  char buffer[kMaxLogLength];
-  va_list args;
+  if (config.logLevel > kLogLevelError)
+    return;
   
+  va_list args;
   va_start(args, theString);
-  vsnprintf(&buffer[0], kMaxLogLength, theString, args);
+  _log(kColorBrightRed, forModule, kLogError, theString, args);
   va_end(args);
-  
-  LogData data = _makeLogData(kColorBrightRed, forModule, kLogError);
-  data.line = buffer;
-  _log(&data);
 }
 
 void Log::info(int forModule, const char* theString, ...) {
-  char buffer[kMaxLogLength];
-  va_list args;
+  if (config.logLevel > kLogLevelInfo)
+    return;
   
+  va_list args;
   va_start(args, theString);
-  vsnprintf(&buffer[0], kMaxLogLength, theString, args);
+  _log(kColorBrightCyan, forModule, kLogTrace, theString, args);
   va_end(args);
+}
+
+void Log::init() {
+  if (_thread)
+    return;
+  
+  // Config isn't safe to read from the writer, so the path is known before
+  if (SDL_LockMutex(_mutex) == 0) {
+    _path = config.path(kPathUserData, kDefLogFile, kObjectGeneric);
+    if (_filestr.is_open())
+      _filestr.close();
+    SDL_UnlockMutex(_mutex);
+  }
   
-  LogData data = _makeLogData(kColorBrightCyan, forModule, kLogTrace);
-  data.line = buffer;
-  _log(&data);
+  // Without a writer, messages are still written by whoever logs them
+  _isRunning = true;
+  _thread = SDL_CreateThread(_runThread, "Log", (void*)this);
 }
 
 void Log::trace(int forModule, const char* theString, ...) {
-  char buffer[kMaxLogLength];
-  va_list args;
+  if (config.logLevel > kLogLevelTrace)
+    return;
   
+  va_list args;
   va_start(args, theString);
-  vsnprintf(&buffer[0], kMaxLogLength, theString, args);
+  _log(kColorWhite, forModule, kLogTrace, theString, args);
   va_end(args);
-  
-  LogData data = _makeLogData(kColorWhite, forModule, kLogTrace);
-  data.line = buffer;
-  _log(&data);
 }
 
 void Log::warning(int forModule, const char* theString, ...) {
-  char buffer[kMaxLogLength];
-  va_list args;
+  if (config.logLevel > kLogLevelWarning)
+    return;
   
+  va_list args;
   va_start(args, theString);
-  vsnprintf(&buffer[0], kMaxLogLength, theString, args);
+  _log(kColorYellow, forModule, kLogWarning, theString, args);
   va_end(args);
-  
-  LogData data = _makeLogData(kColorYellow, forModule, kLogWarning);
-  data.line = buffer;
-  _log(&data);
 }
 
 ////////////////////////////////////////////////////////////
@@ -119,109 +170,135 @@ void Log::warning(int forModule, const char* theString, ...) {
 ////////////////////////////////////////////////////////////
 
 bool Log::beginIteratingHistory() {
-  if (!_history.empty()) {
-    _it = _history.rbegin();
-    return true;
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_historySize) {
+      _historyIndex = 0;
+      return true;
+    }
+    SDL_UnlockMutex(_mutex);
   }
   return false;
 }
 
 bool Log::iterateHistory() {
-  ++_it;
-  if (_it == (_history.rend() - 1) || _history.empty()) {
-    return false; // Bypass the first line
-  } else {
+  // Newest to oldest, bypassing the first line
+  if (++_historyIndex < (_historySize - 1)) {
     return true;
+  } else {
+    SDL_UnlockMutex(_mutex);
+    return false;
   }
 }
 
 void Log::getCurrentLine(LogData* pointerToLogData) {
-  assert(_it != _history.rend());
-  pointerToLogData->line = _it->line;
-  pointerToLogData->color = _it->color;
-  pointerToLogData->module = _it->module;
-  pointerToLogData->type = _it->type;
+  assert(_historyIndex < _historySize);
+  int index = (_historyStart + _historySize - 1 - _historyIndex) % kMaxLogHistory;
+  pointerToLogData->line = _history[index].line;
+  pointerToLogData->color = _history[index].color;
+  pointerToLogData->module = _history[index].module;
+  pointerToLogData->type = _history[index].type;
 }
 
 ////////////////////////////////////////////////////////////
 // Implementation - Private methods
 ////////////////////////////////////////////////////////////
 
-void Log::_log(LogData* data) {
-  if (config.log) {
-    if (!_filestr.is_open())
-      _filestr.open(config.path(kPathUserData, kDefLogFile,
-                                kObjectGeneric).c_str(),
-                    std::ofstream::app);
-    
-    time_t now = time(0);
-    struct tm* tm = localtime(&now);
-    
-    _filestr << "[";
-    
-    switch(tm->tm_mon+1) {
-      case 1:   _filestr << "Jan "; break;
-      case 2:   _filestr << "Feb "; break;
-      case 3:   _filestr << "Mar "; break;
-      case 4:   _filestr << "Apr "; break;
-      case 5:   _filestr << "May "; break;
-      case 6:   _filestr << "Jun "; break;
-      case 7:   _filestr << "Jul "; break;
-      case 8:   _filestr << "Aug "; break;
-      case 9:   _filestr << "Sep "; break;
-      case 10:  _filestr << "Oct "; break;
-      case 11:  _filestr << "Nov "; break;
-      case 12:  _filestr << "Dec "; break;
-      default: {
-        assert(false);
-      }
+// Reserves the next free record, or returns NULL if the queue is full
+LogRecord* Log::_acquire() {
+  int position = SDL_AtomicGet(&_enqueuePosition);
+  for (;;) {
+    LogRecord* record = &_queue[position & (kLogQueueSize - 1)];
+    int difference = SDL_AtomicGet(&record->sequence) - position;
+    if (difference == 0) {
+      if (SDL_AtomicCAS(&_enqueuePosition, position, position + 1))
+        return record;
+    }
+    else if (difference < 0) {
+      return NULL;
+    }
+    position = SDL_AtomicGet(&_enqueuePosition);
+  }
+}
+
+// Writes every record published so far
+void Log::_drain() {
+  if (SDL_LockMutex(_mutex) == 0) {
+    bool hasWritten = false;
+    for (;;) {
+      LogRecord* record = &_queue[_dequeuePosition & (kLogQueueSize - 1)];
+      if (SDL_AtomicGet(&record->sequence) != (_dequeuePosition + 1))
+        break;
+      
+      _write(record);
+      SDL_AtomicSet(&record->sequence, _dequeuePosition + kLogQueueSize);
+      _dequeuePosition++;
+      hasWritten = true;
     }
     
-    if (tm->tm_mday < 10)
-      _filestr << " ";
-    
-    _filestr << tm->tm_mday << " " << tm->tm_hour << ":";
-    
-    if (tm->tm_min < 10)
-      _filestr << "0";
-    
-    _filestr << tm->tm_min << ":";
-    
-    if (tm->tm_sec < 10)
-      _filestr << "0";
-    
-    _filestr << tm->tm_sec << "] ";
+    int numOfDropped = SDL_AtomicSet(&_numOfDropped, 0);
+    if (numOfDropped) {
+      LogRecord record;
+      snprintf(record.line, kMaxLogLength, "%d messages dropped", numOfDropped);
+      record.color = kColorYellow;
+      record.module = kModNone;
+      record.type = kLogWarning;
+      record.time = time(0);
+      _write(&record);
+      hasWritten = true;
+    }
     
-    switch (data->module) {
-      case kModAudio:   _filestr << "        AUDIO"; break;
-      case kModCamera:  _filestr << "       CAMERA"; break;
-      case kModConfig:  _filestr << "CONFIGURATION"; break;
-      case kModControl: _filestr << "   CONTROLLER"; break;
-      case kModCore:    _filestr << "         CORE"; break;
-      case kModEffects: _filestr << "      EFFECTS"; break;
-      case kModFont:    _filestr << "         FONT"; break;
-      case kModRender:  _filestr << "       RENDER"; break;
-      case kModScript:  _filestr << "       SCRIPT"; break;
-      case kModState:   _filestr << "        STATE"; break;
-      case kModSystem:  _filestr << "       SYSTEM"; break;
-      case kModTexture: _filestr << "      TEXTURE"; break;
-      case kModVideo:   _filestr << "        VIDEO"; break;
-      case kModNone:
-      default: {
-        _filestr << "      GENERAL";
-        break;
-      }
+    if (hasWritten && _filestr.is_open())
+      _filestr.flush();
+    SDL_UnlockMutex(_mutex);
+  }
+}
+
+void Log::_log(int color, int module, int type, const char* theString, va_list args) {
+  LogRecord* record = _acquire();
+  if (!record) {
+    SDL_AtomicIncRef(&_numOfDropped);
+    return;
+  }
+  
+  int position = SDL_AtomicGet(&record->sequence);
+  vsnprintf(record->line, kMaxLogLength, theString, args);
+  record->color = color;
+  record->module = module;
+  record->type = type;
+  record->time = time(0);
+  SDL_AtomicSet(&record->sequence, position + 1);
+  
+  if (_thread)
+    SDL_SemPost(_semaphore);
+  else
+    _drain();
+}
+
+// Must be called with the mutex locked
+void Log::_write(const LogRecord* record) {
+  if (config.log) {
+    // Only the main thread logs before the path is known
+    if (!_filestr.is_open()) {
+      if (_path.empty())
+        _filestr.open(config.path(kPathUserData, kDefLogFile,
+                                  kObjectGeneric).c_str(), std::ofstream::app);
+      else
+        _filestr.open(_path.c_str(), std::ofstream::app);
     }
     
-    _filestr << " -> ";
+    struct tm* tm = localtime(&record->time);
+    int module = record->module;
+    if (module < kModAudio || module > kModNone)
+      module = kModNone;
     
-    switch (data->type) {
+    const char* prefix = "";
+    switch (record->type) {
       case kLogError: {
-        _filestr << "ERROR: ";
+        prefix = "ERROR: ";
         break;
       }
       case kLogWarning: {
-        _filestr << "WARNING: ";
+        prefix = "WARNING: ";
         break;
       }
       default: {
@@ -229,24 +306,38 @@ void Log::_log(LogData* data) {
       }
     }
     
-    _filestr << data->line.c_str() << std::endl;
+    char buffer[kMaxLogLength + 64];
+    snprintf(buffer, sizeof(buffer), "[%s %2d %d:%02d:%02d] %s -> %s%s\n",
+             kLogMonths[tm->tm_mon], tm->tm_mday, tm->tm_hour, tm->tm_min,
+             tm->tm_sec, kLogModules[module], prefix, record->line);
+    _filestr << buffer;
   }
   
-  if (_history.size() == kMaxLogHistory)
-    _history.erase(_history.begin());
-  
-  _history.push_back(*data);
+  LogData* data;
+  if (_historySize == kMaxLogHistory) {
+    data = &_history[_historyStart];
+    _historyStart = (_historyStart + 1) % kMaxLogHistory;
+  }
+  else {
+    data = &_history[(_historyStart + _historySize) % kMaxLogHistory];
+    _historySize++;
+  }
+  data->line = record->line;
+  data->color = record->color;
+  data->module = record->module;
+  data->type = record->type;
   
   if (config.debugMode)
-    std::cout << data->line.c_str() << std::endl; // Echo to console
+    std::cout << record->line << std::endl; // Echo to console
 }
-  
-LogData Log::_makeLogData(int color, int module, int type) {
-  LogData logData;
-  logData.color = color;
-  logData.module = module;
-  logData.type = type;
-  return logData;
+
+int Log::_runThread(void *ptr) {
+  Log* log = static_cast<Log*>(ptr);
+  while (log->_isRunning) {
+    SDL_SemWaitTimeout(log->_semaphore, kLogFlushInterval);
+    log->_drain();
+  }
+  return 0;
 }
 
 }
@@ -21,8 +21,15 @@
 #include <fstream>
 #include <string>
 #include <stdint.h>
+#include <time.h>
 #include <vector>
 
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+
+#include "Defines.h"
+
 namespace dagon {
 
 ////////////////////////////////////////////////////////////
@@ -58,6 +65,16 @@ enum LogTypes {
   kLogWarning
 };
 
+// Messages below the level set in the configuration are discarded
+// before being formatted. Commands typed in the console always go through.
+enum LogLevels {
+  kLogLevelTrace,
+  kLogLevelInfo,
+  kLogLevelWarning,
+  kLogLevelError,
+  kLogLevelNone
+};
+
 struct LogData {
   std::string line;
   uint32_t color;
@@ -65,6 +82,20 @@ struct LogData {
   int type;
 };
 
+// Messages waiting to be written, must be a power of two. When full,
+// messages are dropped rather than blocking the caller.
+#define kLogQueueSize 256
+#define kLogFlushInterval 100
+
+struct LogRecord {
+  SDL_atomic_t sequence;
+  char line[kMaxLogLength];
+  uint32_t color;
+  int module;
+  int type;
+  time_t time;
+};
+
 ////////////////////////////////////////////////////////////
 // Interface - Singleton class
 ////////////////////////////////////////////////////////////
@@ -79,10 +110,14 @@ class Log {
   void command(int forModule, const char* theString, ...);
   void error(int forModule, const char* theString, ...);
   void info(int forModule, const char* theString, ...);
+  // Starts the writer once paths and the configuration are known. Until
+  // then, messages are written by whoever logs them.
+  void init();
   void trace(int forModule, const char* theString, ...);
   void warning(int forModule, const char* theString, ...);
   
-  // Helpers for the console feature
+  // Helpers for the console feature. The history is locked from a
+  // successful begin until iterating returns false.
   
   bool beginIteratingHistory();
   bool iterateHistory();
@@ -92,10 +127,30 @@ class Log {
   Config& config;
   
   std::ofstream _filestr;
-  std::vector<LogData> _history;
-  std::vector<LogData>::reverse_iterator _it;
-  void _log(LogData* data);
-  LogData _makeLogData(int color, int module, int type);
+  std::string _path; // Of the file, resolved before the writer starts
+  
+  // Lock-free queue written by any thread and drained by the writer
+  LogRecord _queue[kLogQueueSize];
+  SDL_atomic_t _enqueuePosition;
+  SDL_atomic_t _numOfDropped;
+  int _dequeuePosition;
+  
+  // Most recent lines, oldest one first
+  LogData _history[kMaxLogHistory];
+  int _historyStart;
+  int _historySize;
+  int _historyIndex;
+  
+  SDL_mutex* _mutex; // Guards the history and the file
+  SDL_sem* _semaphore;
+  SDL_Thread* _thread;
+  bool _isRunning;
+  
+  LogRecord* _acquire();
+  void _drain();
+  void _log(int color, int module, int type, const char* theString, va_list args);
+  void _write(const LogRecord* record);
+  static int _runThread(void *ptr);
   
   Log();
   ~Log();
@@ -6,8 +6,51 @@ extern "C" {
 #include "lauxlib.h"
 }
 
+// Yet another modification: userdata of every class begins with a tag
+// telling its type, so that it's checked without knowing the class first
+#define kLunaMagic 0x4C554E41
+
+// Reference to the registry table holding the metatables of every class
+// as keys. Shared by every file including this one.
+inline int &LunaMetatables() {
+  static int ref = LUA_NOREF;
+  return ref;
+}
+
+typedef struct {
+  unsigned int magic;
+  int type;
+  void *pT;
+} LunaUserdata;
+
+// Returns the userdata at the given index, or NULL if not created by Luna
+static inline LunaUserdata *LunaToUserdata(lua_State *L, int narg) {
+  if (lua_type(L, narg) != LUA_TUSERDATA || lua_objlen(L, narg) != sizeof(LunaUserdata))
+    return NULL;
+  
+  // Userdata from elsewhere may be the same size and even begin the same
+  // way, but only ours have these metatables
+  if (!lua_getmetatable(L, narg))
+    return NULL;
+  
+  lua_rawgeti(L, LUA_REGISTRYINDEX, LunaMetatables());
+  bool isLuna = false;
+  if (lua_istable(L, -1)) {
+    lua_pushvalue(L, -2);
+    lua_rawget(L, -2);
+    isLuna = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 2);
+  
+  if (!isLuna)
+    return NULL;
+  
+  LunaUserdata *ud = static_cast<LunaUserdata*>(lua_touserdata(L, narg));
+  return ud->magic == kLunaMagic ? ud : NULL;
+}
+
 template <typename T> class Luna {
-  typedef struct { T *pT; } userdataType;
 public:
   typedef int (T::*mfp)(lua_State *L);
   typedef struct { const char *name; mfp mfunc; } RegType;
@@ -19,6 +62,21 @@ public:
     luaL_newmetatable(L, T::className);
     int metatable = lua_gettop(L);
     
+    // Known from now on as the metatable of a class, and as ours
+    lua_pushvalue(L, metatable);
+    metatableRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, LunaMetatables());
+    if (!lua_istable(L, -1)) {
+      lua_pop(L, 1);
+      lua_newtable(L);
+      lua_pushvalue(L, -1);
+      LunaMetatables() = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    lua_pushvalue(L, metatable);
+    lua_pushboolean(L, 1);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+    
     // store method table in globals so that
     // scripts can add functions written in Lua.
     lua_pushstring(L, T::className);
@@ -56,7 +114,8 @@ public:
       /* edited by Snaily: shouldn't it be const RegType *l ... ? */
       lua_pushstring(L, l->name);
       lua_pushlightuserdata(L, (void*)l);
-      lua_pushcclosure(L, thunk, 1);
+      lua_pushvalue(L, metatable);
+      lua_pushcclosure(L, thunk, 2);
       lua_settable(L, methods);
     }
     
@@ -65,19 +124,38 @@ public:
   
   // get userdata from Lua stack and return pointer to T object
   static T *check(lua_State *L, int narg) {
-    userdataType *ud =
-    static_cast<userdataType*>(luaL_checkudata(L, narg, T::className));
-    if(!ud) luaL_typerror(L, narg, T::className);
-    return ud->pT;  // pointer to T object
+    if (narg < 0 && narg > LUA_REGISTRYINDEX)
+      narg = lua_gettop(L) + narg + 1;  // still the same once the metatable is pushed
+    lua_rawgeti(L, LUA_REGISTRYINDEX, metatableRef);
+    T *obj = test(L, narg, lua_gettop(L));
+    lua_pop(L, 1);
+    if(!obj) luaL_typerror(L, narg, T::className);
+    return obj;  // pointer to T object
   }
   
 private:
+  static int metatableRef;
+  
   Luna();  // hide default constructor
   
+  // Only userdata of this class carry its metatable, so comparing with it
+  // is all the checking needed
+  static T *test(lua_State *L, int narg, int metatable) {
+    LunaUserdata *ud = static_cast<LunaUserdata*>(lua_touserdata(L, narg));
+    if (!ud || !lua_getmetatable(L, narg))
+      return NULL;
+    
+    bool isOurs = lua_rawequal(L, -1, metatable);
+    lua_pop(L, 1);
+    return isOurs ? static_cast<T*>(ud->pT) : NULL;
+  }
+  
   // member function dispatcher
   static int thunk(lua_State *L) {
-    // stack has userdata, followed by method args
-    T *obj = check(L, 1);  // get 'self', or if you prefer, 'this'
+    // stack has userdata, followed by method args. The metatable to
+    // check it with is the second upvalue.
+    T *obj = test(L, 1, lua_upvalueindex(2));  // get 'self', or if you prefer, 'this'
+    if(!obj) luaL_typerror(L, 1, T::className);
     lua_remove(L, 1);  // remove self so member function args start at index 1
     // get member function from upvalue
     RegType *l = static_cast<RegType*>(lua_touserdata(L, lua_upvalueindex(1)));
@@ -89,10 +167,12 @@ private:
   static int new_T(lua_State *L) {
     lua_remove(L, 1);   // use classname:new(), instead of classname.new()
     T *obj = new T(L);  // call constructor for T objects
-    userdataType *ud =
-    static_cast<userdataType*>(lua_newuserdata(L, sizeof(userdataType)));
+    LunaUserdata *ud =
+    static_cast<LunaUserdata*>(lua_newuserdata(L, sizeof(LunaUserdata)));
+    ud->magic = kLunaMagic;
+    ud->type = T::objectType;
     ud->pT = obj;  // store pointer to object in userdata
-    luaL_getmetatable(L, T::className);  // lookup metatable in Lua registry
+    lua_rawgeti(L, LUA_REGISTRYINDEX, metatableRef);  // lookup metatable in Lua registry
     lua_setmetatable(L, -2);
     
     // This is our modification to the Luna template. We grab a reference to the newly
@@ -107,16 +187,16 @@ private:
   
   // garbage collection metamethod
   static int gc_T(lua_State *L) {
-    userdataType *ud = static_cast<userdataType*>(lua_touserdata(L, 1));
-    T *obj = ud->pT;
+    LunaUserdata *ud = static_cast<LunaUserdata*>(lua_touserdata(L, 1));
+    T *obj = static_cast<T*>(ud->pT);
     delete obj;  // call destructor for T objects
     return 0;
   }
   
   static int tostring_T (lua_State *L) {
     char buff[32];
-    userdataType *ud = static_cast<userdataType*>(lua_touserdata(L, 1));
-    T *obj = ud->pT;
+    LunaUserdata *ud = static_cast<LunaUserdata*>(lua_touserdata(L, 1));
+    T *obj = static_cast<T*>(ud->pT);
     // Another modification: print the name of the Dagon object instead
     // of its pointer
     sprintf(buff, "%s", obj->ptr()->name().c_str());
@@ -126,4 +206,6 @@ private:
   }
 };
 
+template <typename T> int Luna<T>::metatableRef = LUA_NOREF;
+
 #endif
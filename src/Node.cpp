@@ -109,6 +109,10 @@ bool Node::hasUnpersistEvent() {
 // Implementation - Gets
 ////////////////////////////////////////////////////////////
 
+const std::vector<Spot*>& Node::arrayOfSpots() {
+  return _arrayOfSpots;
+}
+
 std::string Node::bundleName() {
   return _bundleName;
 }
@@ -53,6 +53,7 @@ class Node : public Object {
   bool hasUnpersistEvent();
   
   // Gets
+  const std::vector<Spot*>& arrayOfSpots();
   std::string bundleName();
   Spot* currentSpot();
   std::string description();
@@ -52,6 +52,7 @@ namespace dagon {
 class NodeProxy : public ObjectProxy {
 public:
   static const char className[];
+  static const int objectType = kObjectNode;
   static Luna<NodeProxy>::RegType methods[];
   
   // Constructor
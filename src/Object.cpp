@@ -15,12 +15,20 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <SDL2/SDL_mutex.h>
+
+#include <algorithm>
+
 #include "Group.h"
 #include "Object.h"
 
 namespace dagon {
 
 static int globalID = 0;
+static std::vector<Object*> changedObjects;
+
+// Audios fade out on job threads, so the changes are locked
+static SDL_mutex* changedMutex = SDL_CreateMutex();
 
 ////////////////////////////////////////////////////////////
 // Implementation - Constructor
@@ -32,6 +40,7 @@ Object::Object() {
   _fadeDirection = kFadeNone;
   _fadeLevel = 1.0f;
   _fadeTarget = 1.0f;
+  _isChanged = false;
   _isEnabled = true;
   _isGrouped = false;  
   _isStatic = false;
@@ -39,6 +48,20 @@ Object::Object() {
   this->setFadeSpeed(kFadeNormal);
 }
 
+////////////////////////////////////////////////////////////
+// Implementation - Destructor
+////////////////////////////////////////////////////////////
+
+Object::~Object() {
+  if (SDL_LockMutex(changedMutex) == 0) {
+    if (_isChanged) {
+      changedObjects.erase(std::find(changedObjects.begin(),
+                                     changedObjects.end(), this));
+    }
+    SDL_UnlockMutex(changedMutex);
+  }
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - Checks
 ////////////////////////////////////////////////////////////
@@ -144,19 +167,19 @@ void Object::disable(bool forced) {
   if (_isGrouped && !forced)
     _attachedGroup->disable();
   else
-    _isEnabled = false;
+    _setEnabled(false);
 }
 
 void Object::enable(bool forced) {
   if (_isGrouped && !forced)
     _attachedGroup->enable();
   else
-    _isEnabled = true;
+    _setEnabled(true);
 }
 
 void Object::fadeIn() {
   // Force object to enabled state
-  _isEnabled = true;
+  _setEnabled(true);
   _fadeLevel = 0;
   _fadeTarget = _defaultFade;
   _fadeDirection = kFadeIn;
@@ -177,7 +200,7 @@ void Object::release() {
 }
 
 void Object::toggle() {
-  _isEnabled = !_isEnabled;
+  _setEnabled(!_isEnabled);
 }
 
 void Object::updateFade() {
@@ -193,11 +216,51 @@ void Object::updateFade() {
       _fadeLevel = _fadeTarget;
       _fadeDirection = kFadeNone;
       if (_fadeLevel <= 0)
-        _isEnabled = false;
+        _setEnabled(false);
     } else {
       _fadeLevel -= _fadeSpeed;
     }
   }
 }
   
+////////////////////////////////////////////////////////////
+// Implementation - Static methods
+////////////////////////////////////////////////////////////
+
+std::vector<Object*> Object::arrayOfChangedObjects() {
+  std::vector<Object*> arrayOfObjects;
+  if (SDL_LockMutex(changedMutex) == 0) {
+    arrayOfObjects = changedObjects;
+    SDL_UnlockMutex(changedMutex);
+  }
+  return arrayOfObjects;
+}
+
+void Object::clearChangedObjects() {
+  if (SDL_LockMutex(changedMutex) == 0) {
+    std::vector<Object*>::iterator it = changedObjects.begin();
+    while (it != changedObjects.end()) {
+      (*it)->_isChanged = false;
+      ++it;
+    }
+    changedObjects.clear();
+    SDL_UnlockMutex(changedMutex);
+  }
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+void Object::_setEnabled(bool enabled) {
+  if (SDL_LockMutex(changedMutex) == 0) {
+    if (enabled != _isEnabled && !_isChanged) {
+      changedObjects.push_back(this);
+      _isChanged = true;
+    }
+    SDL_UnlockMutex(changedMutex);
+  }
+  _isEnabled = enabled;
+}
+  
 }
@@ -19,6 +19,7 @@
 ////////////////////////////////////////////////////////////
 
 #include <string>
+#include <vector>
 
 namespace dagon {
 
@@ -71,7 +72,7 @@ enum ObjectTypes {
 class Object {
  public:
   Object();
-  virtual ~Object() {};
+  virtual ~Object();
   
   // Checks
   bool isEnabled();
@@ -106,6 +107,11 @@ class Object {
   void toggle();
   void updateFade();
   
+  // Objects whose enabled state changed since last cleared, so that
+  // saves may write only those. A copy, as job threads may add to it.
+  static std::vector<Object*> arrayOfChangedObjects();
+  static void clearChangedObjects();
+  
  private:
   Group* _attachedGroup;
   
@@ -120,10 +126,13 @@ class Object {
   float _fadeLevel;
   float _fadeSpeed;
   float _fadeTarget;
+  bool _isChanged;
   bool _isEnabled;
   bool _isGrouped;
   bool _isStatic;
   
+  void _setEnabled(bool enabled);
+  
   Object(const Object&);
   void operator=(const Object&);
 };
@@ -35,6 +35,7 @@ namespace dagon {
 class OverlayProxy : public ObjectProxy {
 public:
   static const char className[];
+  static const int objectType = kObjectOverlay;
   static Luna<OverlayProxy>::RegType methods[];
   
   // Constructor
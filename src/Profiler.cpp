@@ -0,0 +1,256 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <SDL2/SDL_timer.h>
+
+#include "Log.h"
+#include "Profiler.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+static const char* kProfilerZoneNames[] = {
+  "Frame",
+  "Pre-render",
+  "Scan spots",
+  "Draw spots",
+  "Overlays",
+  "Feeds",
+  "Post-render",
+  "Console",
+  "Timers",
+  "Collect",
+  "Swap",
+  "Audio",
+  "Video",
+  "Video load",
+  "Switch",
+  "Texture load"
+};
+
+////////////////////////////////////////////////////////////
+// Implementation - Constructor
+////////////////////////////////////////////////////////////
+
+Profiler::Profiler() :
+log(Log::instance())
+{
+  SDL_AtomicSet(&_numOfEvents, 0);
+  for (int i = 0; i < kNumOfZones; i++) {
+    SDL_AtomicSet(&_samples[i].numOfSamples, 0);
+    SDL_AtomicSet(&_gpuSamples[i].numOfSamples, 0);
+    _queries[i].index = 0;
+    for (int j = 0; j < kProfilerQueryLatency; j++) {
+      _queries[i].queries[j] = 0;
+      _queries[i].isPending[j] = false;
+    }
+  }
+  
+  _listener = NULL;
+  _mainThread = 0;
+  _hasTimerQueries = false;
+  _isEnabled = false;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Destructor
+////////////////////////////////////////////////////////////
+
+Profiler::~Profiler() {
+  // GL queries go away with the context
+}
+
+////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////
+
+void Profiler::beginGPU(int zone) {
+  if (!_hasTimerQueries)
+    return;
+  
+  ProfilerQueries* queries = &_queries[zone];
+  int index = queries->index;
+  if (!queries->queries[index])
+    glGenQueries(1, &queries->queries[index]);
+  
+  // Collect the result from kProfilerQueryLatency frames ago, which
+  // is normally ready. If not, it's dropped rather than waited for.
+  if (queries->isPending[index]) {
+    GLint isAvailable = 0;
+    glGetQueryObjectiv(queries->queries[index], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+    if (isAvailable) {
+      GLuint64 elapsed = 0;
+      glGetQueryObjectui64v(queries->queries[index], GL_QUERY_RESULT, &elapsed);
+      
+      float duration = static_cast<float>(elapsed / 1000000.0);
+      _addSample(&_gpuSamples[zone], duration);
+      
+      int slot = SDL_AtomicAdd(&_numOfEvents, 1) & (kProfilerMaxEvents - 1);
+      ProfilerEvent* event = &_events[slot];
+      event->zone = zone;
+      event->begin = queries->begins[index];
+      event->end = event->begin +
+        static_cast<Uint64>(elapsed * SDL_GetPerformanceFrequency() / 1000000000ULL);
+      event->thread = 0;
+      event->isGPU = true;
+    }
+    queries->isPending[index] = false;
+  }
+  
+  queries->begins[index] = now();
+  glBeginQuery(GL_TIME_ELAPSED, queries->queries[index]);
+}
+
+void Profiler::endGPU(int zone) {
+  if (!_hasTimerQueries)
+    return;
+  
+  ProfilerQueries* queries = &_queries[zone];
+  glEndQuery(GL_TIME_ELAPSED);
+  queries->isPending[queries->index] = true;
+  queries->index = (queries->index + 1) % kProfilerQueryLatency;
+}
+
+const char* Profiler::nameOfZone(int zone) {
+  if (zone >= 0 && zone < kNumOfZones)
+    return kProfilerZoneNames[zone];
+  
+  return "";
+}
+
+Uint64 Profiler::now() {
+  return SDL_GetPerformanceCounter();
+}
+
+float Profiler::percentile(int zone, float percentile, bool onGPU) {
+  if (zone < 0 || zone >= kNumOfZones)
+    return 0.0f;
+  
+  return _percentile(onGPU ? &_gpuSamples[zone] : &_samples[zone], percentile);
+}
+
+void Profiler::record(int zone, Uint64 begin, Uint64 end) {
+  int slot = SDL_AtomicAdd(&_numOfEvents, 1) & (kProfilerMaxEvents - 1);
+  ProfilerEvent* event = &_events[slot];
+  event->zone = zone;
+  event->begin = begin;
+  event->end = end;
+  event->thread = SDL_ThreadID();
+  event->isGPU = false;
+  
+  float duration = static_cast<float>((end - begin) * 1000.0 / SDL_GetPerformanceFrequency());
+  _addSample(&_samples[zone], duration);
+  
+  if (_listener)
+    _listener(zone, duration);
+}
+
+bool Profiler::saveTrace(const char* fileName) {
+  FILE* file = fopen(fileName, "w");
+  if (!file) {
+    log.error(kModSystem, "%s: %s", kString13013, fileName);
+    return false;
+  }
+  
+  // Timestamps are relative to the oldest event kept
+  int numOfEvents = SDL_AtomicGet(&_numOfEvents);
+  int first = numOfEvents > kProfilerMaxEvents ? numOfEvents - kProfilerMaxEvents : 0;
+  double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+  Uint64 origin = _events[first & (kProfilerMaxEvents - 1)].begin;
+  
+  fprintf(file, "{\"traceEvents\":[\n");
+  fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}},\n");
+  fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"Main\"}}",
+          static_cast<unsigned long>(_mainThread));
+  
+  for (int i = first; i < numOfEvents; i++) {
+    const ProfilerEvent* event = &_events[i & (kProfilerMaxEvents - 1)];
+    if (event->begin < origin)
+      continue;
+    
+    double begin = (event->begin - origin) * 1000000.0 / frequency;
+    double duration = (event->end - event->begin) * 1000000.0 / frequency;
+    fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%lu}",
+            nameOfZone(event->zone), event->isGPU ? "gpu" : "cpu", begin, duration,
+            static_cast<unsigned long>(event->thread));
+  }
+  
+  // Anything else ran on the job workers
+  std::vector<SDL_threadID> arrayOfWorkers;
+  for (int i = first; i < numOfEvents; i++) {
+    SDL_threadID thread = _events[i & (kProfilerMaxEvents - 1)].thread;
+    if (thread && (thread != _mainThread) &&
+        std::find(arrayOfWorkers.begin(), arrayOfWorkers.end(), thread) == arrayOfWorkers.end()) {
+      arrayOfWorkers.push_back(thread);
+      fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"Worker\"}}",
+              static_cast<unsigned long>(thread));
+    }
+  }
+  
+  fprintf(file, "\n]}\n");
+  fclose(file);
+  
+  log.info(kModSystem, "%s: %s", kString13014, fileName);
+  return true;
+}
+
+void Profiler::setEnabled(bool enabled) {
+  if (enabled && !_isEnabled) {
+    // Enabled from the main thread, which also owns the GL context
+    _mainThread = SDL_ThreadID();
+    _hasTimerQueries = GLEW_ARB_timer_query ? true : false;
+    
+    for (int i = 0; i < kNumOfZones; i++) {
+      SDL_AtomicSet(&_samples[i].numOfSamples, 0);
+      SDL_AtomicSet(&_gpuSamples[i].numOfSamples, 0);
+    }
+    SDL_AtomicSet(&_numOfEvents, 0);
+  }
+  
+  _isEnabled = enabled;
+}
+
+void Profiler::setListener(ProfilerListener listener) {
+  _listener = listener;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+void Profiler::_addSample(ProfilerSamples* samples, float duration) {
+  int slot = SDL_AtomicAdd(&samples->numOfSamples, 1) % kProfilerMaxSamples;
+  samples->durations[slot] = duration;
+}
+
+float Profiler::_percentile(ProfilerSamples* samples, float percentile) {
+  int numOfSamples = SDL_AtomicGet(&samples->numOfSamples);
+  if (numOfSamples > kProfilerMaxSamples)
+    numOfSamples = kProfilerMaxSamples;
+  if (!numOfSamples)
+    return 0.0f;
+  
+  std::vector<float> durations(samples->durations, samples->durations + numOfSamples);
+  size_t nth = static_cast<size_t>(percentile / 100.0f * (numOfSamples - 1));
+  std::nth_element(durations.begin(), durations.begin() + nth, durations.end());
+  return durations[nth];
+}
+
+}
@@ -0,0 +1,170 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef DAGON_PROFILER_H_
+#define DAGON_PROFILER_H_
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_thread.h>
+
+#include "Platform.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Events kept for the trace, must be a power of two
+#define kProfilerMaxEvents 16384
+
+// Durations kept for each zone to calculate percentiles
+#define kProfilerMaxSamples 256
+
+// GPU results are read this many frames later to avoid stalls
+#define kProfilerQueryLatency 4
+
+class Log;
+
+enum ProfilerZones {
+  kZoneNone = -1, // Measures nothing
+  kZoneFrame,
+  kZonePreRender,
+  kZoneScanSpots,
+  kZoneDrawSpots,
+  kZoneOverlays,
+  kZoneFeeds,
+  kZonePostRender,
+  kZoneConsole,
+  kZoneTimers,
+  kZoneCollect,
+  kZoneSwap,
+  kZoneAudio,
+  kZoneVideo,
+  kZoneVideoLoad,
+  kZoneSwitch,
+  kZoneTextureLoad,
+  kNumOfZones
+};
+
+// Notified of every duration recorded, from the thread that measured it
+typedef void (*ProfilerListener)(int zone, float duration);
+
+typedef struct {
+  int zone;
+  Uint64 begin;
+  Uint64 end;
+  SDL_threadID thread;
+  bool isGPU;
+} ProfilerEvent;
+
+typedef struct {
+  float durations[kProfilerMaxSamples]; // Milliseconds
+  SDL_atomic_t numOfSamples;
+} ProfilerSamples;
+
+typedef struct {
+  GLuint queries[kProfilerQueryLatency];
+  Uint64 begins[kProfilerQueryLatency];
+  bool isPending[kProfilerQueryLatency];
+  int index;
+} ProfilerQueries;
+
+////////////////////////////////////////////////////////////
+// Interface - Singleton class
+////////////////////////////////////////////////////////////
+
+class Profiler {
+  Log& log;
+  
+  ProfilerEvent _events[kProfilerMaxEvents];
+  SDL_atomic_t _numOfEvents;
+  ProfilerSamples _samples[kNumOfZones];
+  ProfilerSamples _gpuSamples[kNumOfZones];
+  ProfilerQueries _queries[kNumOfZones];
+  ProfilerListener _listener;
+  SDL_threadID _mainThread;
+  
+  bool _hasTimerQueries;
+  bool _isEnabled;
+  
+  void _addSample(ProfilerSamples* samples, float duration);
+  float _percentile(ProfilerSamples* samples, float percentile);
+  
+  Profiler();
+  Profiler(Profiler const&);
+  Profiler& operator=(Profiler const&);
+  ~Profiler();
+
+public:
+  static Profiler& instance() {
+    static Profiler profiler;
+    return profiler;
+  }
+  
+  // Both sides must be called from the thread that owns the GL context.
+  // Zones measured on the GPU must never overlap.
+  void beginGPU(int zone);
+  void endGPU(int zone);
+  
+  bool isEnabled() { return _isEnabled; }
+  const char* nameOfZone(int zone);
+  Uint64 now();
+  float percentile(int zone, float percentile, bool onGPU = false);
+  void record(int zone, Uint64 begin, Uint64 end);
+  
+  // Writes every event kept in the Chrome trace event format
+  bool saveTrace(const char* fileName);
+  void setEnabled(bool enabled);
+  void setListener(ProfilerListener listener);
+};
+
+// Records the time until going out of scope, if profiling is enabled
+class ProfilerScope {
+  int _zone;
+  Uint64 _begin;
+  bool _onGPU;
+
+public:
+  ProfilerScope(int zone, bool onGPU = false) {
+    _zone = zone;
+    _onGPU = onGPU;
+    _begin = 0;
+    
+    Profiler& profiler = Profiler::instance();
+    if (profiler.isEnabled() && (_zone != kZoneNone)) {
+      _begin = profiler.now();
+      if (_onGPU)
+        profiler.beginGPU(_zone);
+    }
+  }
+  
+  ~ProfilerScope() {
+    Profiler& profiler = Profiler::instance();
+    if (_begin) {
+      // Queries are always closed, even if profiling was just disabled
+      if (_onGPU)
+        profiler.endGPU(_zone);
+      if (profiler.isEnabled())
+        profiler.record(_zone, _begin, profiler.now());
+    }
+  }
+};
+
+}
+
+#endif // DAGON_PROFILER_H_
@@ -50,6 +50,17 @@ extern "C" {
 
 #define method(class, name) {#name, &class::name}
 
+namespace dagon {
+
+// Libs exporting properties resolve keys through a table mapping their
+// names to indexes, given to their functions as first upvalue. Strings are
+// interned in Lua, so that's a single lookup instead of comparing each.
+static void DGRegisterProperties(lua_State *L, const luaL_Reg *functions,
+                                 const char **names);
+static int DGToProperty(lua_State *L, int idx); // Returns -1 if unknown
+
+}
+
 // We include non-proxy libraries here as well
 
 #include "CameraLib.h"
@@ -94,70 +105,45 @@ namespace dagon {
 // Implementation
 ////////////////////////////////////////////////////////////
 
-// NOTE: This isn't so efficient because the operations required
-// to check the type of object are essentially the same as those
-// required to perform the cast (via Luna). Since we don't do this
-// very often, it will do for now.
-//
-// In the future, we should find some way to safely try a cast
-// without triggering an assertion in Lua.
-
-// Custom check user type function that simply returns true if the
-// object in the given index is the desired one
-static bool _checkutype(lua_State *L, int idx, const char* name) {
-  int v1, v2;
-  
-  lua_getfield(L, LUA_REGISTRYINDEX, name);  // Get correct metatable
-  v1 = lua_getmetatable(L, idx);
-  v2 = lua_rawequal(L, -1, -2);
-  lua_pop(L, 2);  // Remove both metatables
-  
-  if (!v1 || !v2)
-    return false; // Not the type
-  else
-    return true; // Correct type
-}
-
 int DGCheckProxy(lua_State *L, int idx) {
   // Let's make sure this is a userdata first
   if (lua_isuserdata(L, idx)) {
-    // Good, now check against each user type
-    
-    if (_checkutype(L, idx, AudioProxy::className))
-      return kObjectAudio; // It's an audio
-    
-    if (_checkutype(L, idx, ButtonProxy::className))
-      return kObjectButton; // It's a button
-    
-    if (_checkutype(L, idx, GroupProxy::className))
-      return kObjectGroup; // It's an group
-    
-    if (_checkutype(L, idx, ImageProxy::className))
-      return kObjectImage; // It's an image
+    // Proxies carry their type in the userdata itself
+    LunaUserdata *ud = LunaToUserdata(L, idx);
+    if (ud)
+      return ud->type;
     
-    if (_checkutype(L, idx, NodeProxy::className))
-      return kObjectNode; // It's a node
-    
-    if (_checkutype(L, idx, OverlayProxy::className))
-      return kObjectOverlay; // It's an overlay
-    
-    if (_checkutype(L, idx, RoomProxy::className))
-      return kObjectRoom; // It's a room
-    
-    if (_checkutype(L, idx, SlideProxy::className))
-      return kObjectSlide; // It's a slide
-    
-    if (_checkutype(L, idx, SpotProxy::className))
-      return kObjectSpot; // It's a spot
-    
-    // No, it's Superman!
-    
-    return kObjectGeneric; // None of the above, we return a generic type
+    return kObjectGeneric; // Any other userdata is generic
   }
   
   return kObjectNone;
 }
 
+// Registers the functions in the table on top of the stack
+void DGRegisterProperties(lua_State *L, const luaL_Reg *functions, const char **names) {
+  lua_newtable(L);
+  for (int i = 0; names[i]; i++) {
+    lua_pushinteger(L, i);
+    lua_setfield(L, -2, names[i]);
+  }
+  
+  for (const luaL_Reg *function = functions; function->name; function++) {
+    lua_pushvalue(L, -1);
+    lua_pushcclosure(L, function->func, 1);
+    lua_setfield(L, -3, function->name);
+  }
+  
+  lua_pop(L, 1);
+}
+
+int DGToProperty(lua_State *L, int idx) {
+  lua_pushvalue(L, idx);
+  lua_rawget(L, lua_upvalueindex(1));
+  int property = lua_isnumber(L, -1) ? static_cast<int>(lua_tointeger(L, -1)) : -1;
+  lua_pop(L, 1);
+  return property;
+}
+
 Audio* ProxyToAudio(lua_State *L, int idx) {
   AudioProxy* a = Luna<AudioProxy>::check(L, idx);
   return a->ptr();
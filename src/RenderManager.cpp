@@ -147,6 +147,39 @@ void RenderManager::resetFade() {
 // Implementation - Conversion of coordinates
 ////////////////////////////////////////////////////////////
 
+Point RenderManager::centerOfPolygon(std::vector<int> arrayOfCoordinates) {
+  Point center = ZeroPoint;
+  int size = static_cast<int>(arrayOfCoordinates.size());
+  int vertex = size >> 1;
+  
+  double area = 0.0;
+  double x0 = 0.0; // Current vertex X
+  double y0 = 0.0; // Current vertex Y
+  double x1 = 0.0; // Next vertex X
+  double y1 = 0.0; // Next vertex Y
+  double a = 0.0; // Partial signed area
+  
+  // For all vertices
+  for (int i = 0; i < vertex; ++i) {
+    x0 = arrayOfCoordinates[i << 1];
+    y0 = arrayOfCoordinates[(i << 1) + 1];
+    x1 = arrayOfCoordinates[((i << 1) + 2) % size];
+    y1 = arrayOfCoordinates[((i << 1) + 3) % size];
+    
+    a = (x0 * y1) - (x1 * y0);
+    area += a;
+    
+    MovePoint(center, (x0 + x1) * a, (y0 + y1) * a);
+  }
+  
+  area *= 3.0;
+  double invArea = 1.0 / area;
+  center.x *= invArea;
+  center.y *= invArea;
+  
+  return center;
+}
+
 Vector RenderManager::project(GLdouble x, GLdouble y, GLdouble z) {
   GLdouble winX, winY, winZ;
   
@@ -349,7 +382,7 @@ void RenderManager::drawPolygon(std::vector<int> withArrayOfCoordinates, unsigne
   else {
     // We can safely assume this spot has a color and therefore can use
     // a "helper". Not the most elegant way to do this but, hey, it works.
-    Point center = _centerOfPolygon(withArrayOfCoordinates);
+    Point center = centerOfPolygon(withArrayOfCoordinates);
     
     // This code is a bit redundant but optimal: the center is only calculated in
     // the required cases. Basically, this projects the calculated point onto the
@@ -487,6 +520,54 @@ uint32_t RenderManager::testColor(int xPosition, int yPosition) {
 // Implementation - Helpers processing
 ////////////////////////////////////////////////////////////
 
+bool RenderManager::testPolygon(std::vector<int> withArrayOfCoordinates, unsigned int onFace) {
+  GLdouble modelView[16];
+  glGetDoublev(GL_MODELVIEW_MATRIX, modelView);
+  
+  GLdouble projection[16];
+  glGetDoublev(GL_PROJECTION_MATRIX, projection);
+  
+  // Both matrices are column-major
+  GLdouble matrix[16];
+  for (int col = 0; col < 4; col++) {
+    for (int row = 0; row < 4; row++) {
+      matrix[(col * 4) + row] = 0.0;
+      for (int k = 0; k < 4; k++)
+        matrix[(col * 4) + row] += projection[(k * 4) + row] * modelView[(col * 4) + k];
+    }
+  }
+  
+  // The polygon is culled only if all its vertices lie outside the same
+  // clipping plane, so this may report as visible a few polygons that aren't
+  int outside[6] = {0, 0, 0, 0, 0, 0};
+  int vertices = static_cast<int>(withArrayOfCoordinates.size()) >> 1;
+  
+  for (int i = 0; i < vertices; i++) {
+    Vector v = _vertexOnFace(withArrayOfCoordinates[i << 1],
+                             withArrayOfCoordinates[(i << 1) + 1], onFace);
+    
+    GLdouble clip[4];
+    for (int row = 0; row < 4; row++) {
+      clip[row] = (matrix[row] * v.x) + (matrix[4 + row] * v.y) +
+        (matrix[8 + row] * v.z) + matrix[12 + row];
+    }
+    
+    if (clip[0] < -clip[3]) outside[0]++;
+    if (clip[0] > clip[3]) outside[1]++;
+    if (clip[1] < -clip[3]) outside[2]++;
+    if (clip[1] > clip[3]) outside[3]++;
+    if (clip[2] < -clip[3]) outside[4]++;
+    if (clip[2] > clip[3]) outside[5]++;
+  }
+  
+  for (int i = 0; i < 6; i++) {
+    if (outside[i] == vertices)
+      return false;
+  }
+  
+  return true;
+}
+
 bool RenderManager::beginIteratingHelpers() {
   if (!_arrayOfHelpers.empty()) {
     if (_helperLoop > 1.0f) _helperLoop = 0.0f;
@@ -609,37 +690,28 @@ void RenderManager::fadeView() {
 // Implementation - Private methods
 ////////////////////////////////////////////////////////////
 
-Point RenderManager::_centerOfPolygon(std::vector<int> arrayOfCoordinates) {
-  Point center = ZeroPoint;
-  int size = static_cast<int>(arrayOfCoordinates.size());
-  int vertex = size >> 1;
+// Same transformation applied by drawPolygon()
+Vector RenderManager::_vertexOnFace(int x, int y, unsigned int onFace) {
+  const double size = static_cast<double>(kDefTexSize >> 1);
+  const double u = static_cast<double>(x) / size;
+  const double v = static_cast<double>(y) / size;
   
-  double area = 0.0;
-  double x0 = 0.0; // Current vertex X
-  double y0 = 0.0; // Current vertex Y
-  double x1 = 0.0; // Next vertex X
-  double y1 = 0.0; // Next vertex Y
-  double a = 0.0; // Partial signed area
-  
-  // For all vertices
-  for (int i = 0; i < vertex; ++i) {
-    x0 = arrayOfCoordinates[i << 1];
-    y0 = arrayOfCoordinates[(i << 1) + 1];
-    x1 = arrayOfCoordinates[((i << 1) + 2) % size];
-    y1 = arrayOfCoordinates[((i << 1) + 3) % size];
-    
-    a = (x0 * y1) - (x1 * y0);
-    area += a;
-    
-    MovePoint(center, (x0 + x1) * a, (y0 + y1) * a);
+  switch (onFace) {
+    case kNorth:
+      return MakeVector(-1.0 + u, 1.0 - v, -1.0);
+    case kEast:
+      return MakeVector(1.0, 1.0 - v, -1.0 + u);
+    case kSouth:
+      return MakeVector(1.0 - u, 1.0 - v, 1.0);
+    case kWest:
+      return MakeVector(-1.0, 1.0 - v, 1.0 - u);
+    case kUp:
+      return MakeVector(-1.0 + u, 1.0, 1.0 - v);
+    case kDown:
+      return MakeVector(-1.0 + u, -1.0, -1.0 + v);
+    default:
+      return ZeroVector;
   }
-  
-  area *= 3.0;
-  double invArea = 1.0 / area;
-  center.x *= invArea;
-  center.y *= invArea;
-  
-  return center;
 }
 
 void RenderManager::_initFrameBuffer() {
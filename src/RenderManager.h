@@ -65,7 +65,7 @@ class RenderManager {
   Texture* _blendTexture;
   Texture* _fadeTexture;
   
-  Point _centerOfPolygon(std::vector<int> arrayOfCoordinates); // Used for the helpers feature
+  Vector _vertexOnFace(int x, int y, unsigned int onFace);
   void _initFrameBuffer();
   void _initFrameBufferDepthBuffer();
   void _initFrameBufferTexture();
@@ -95,6 +95,7 @@ public:
   
   // Conversion of coordinates (note this requires glu)
   
+  Point centerOfPolygon(std::vector<int> arrayOfCoordinates); // Used for the helpers feature
   Vector project(GLdouble x, GLdouble y, GLdouble z); // If more than three coordinates, attempts to calculate center
   Vector unProject(int x, int y);
   
@@ -113,6 +114,7 @@ public:
   void setAlpha(float alpha);
   void setColor(uint32_t color, float alpha = 0);
   uint32_t    testColor(int xPosition, int yPosition);
+  bool testPolygon(std::vector<int> withArrayOfCoordinates, unsigned int onFace); // Conservative frustum test
   
   // Helpers processing (indicates clickable spots)
   
@@ -74,10 +74,14 @@ bool Room::hasUnpersistEvent() {
 // Implementation - Gets
 ////////////////////////////////////////////////////////////
 
-std::vector<Audio*> Room::arrayOfAudios() {
+const std::vector<Audio*>& Room::arrayOfAudios() {
   return _arrayOfAudios;
 }
 
+const std::vector<Node*>& Room::arrayOfNodes() {
+  return _arrayOfNodes;
+}
+
 Node* Room::currentNode() {
   assert(_currentNode != NULL);
   return _currentNode;
@@ -151,6 +155,7 @@ void Room::setUnpersistEvent(const int luaRef) {
 Audio* Room::addAudio(Audio* anAudio) {
   _arrayOfAudios.push_back(anAudio);
   anAudio->setFadeSpeed(kFadeSlow);
+  anAudio->setPriority(kAudioPriorityAmbience);
   return anAudio;
 }
 
@@ -48,7 +48,8 @@ class Room : public Object {
   bool hasUnpersistEvent();
   
   // Gets
-  std::vector<Audio*> arrayOfAudios();
+  const std::vector<Audio*>& arrayOfAudios();
+  const std::vector<Node*>& arrayOfNodes();
   Node* currentNode();
   Audio* defaultFootstep();
   SettingCollection effects();
@@ -80,8 +81,8 @@ class Room : public Object {
   std::vector<Node*>::iterator _it;
   Node* _currentNode;
   
-  // TODO: When switching rooms, confirm if a given audio is already playing,
-  // so that no unnecessary fade ins/outs are performed.
+  // These are carried across switches by Control, so an audio shared
+  // with the previous room is never faded out and in again
   std::vector<Audio*> _arrayOfAudios;
   Audio* _defaultFootstep;
   bool _hasDefaultFootstep;
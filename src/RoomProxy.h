@@ -37,6 +37,7 @@ namespace dagon {
 class RoomProxy : public ObjectProxy {
 public:
   static const char className[];
+  static const int objectType = kObjectRoom;
   static Luna<RoomProxy>::RegType methods[];
   
   // Constructor
@@ -0,0 +1,687 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <SDL2/SDL_rwops.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "Config.h"
+#include "Deserializer.h"
+#include "JobManager.h"
+#include "Log.h"
+#include "SaveManager.h"
+#include "Serializer.h"
+#include "Version.h"
+
+#ifdef DAGON_WINDOWS
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Numbers in the index are big-endian, and strings are preceded by their
+// length, as in saves
+static void _writeBE(std::vector<uint8_t>* data, uint64_t value, int numBytes) {
+  for (int i = numBytes - 1; i >= 0; i--)
+    data->push_back(static_cast<uint8_t>(value >> (i * 8)));
+}
+
+static void _writeString8(std::vector<uint8_t>* data, const std::string& str) {
+  size_t len = str.length() < 255 ? str.length() : 255;
+  data->push_back(static_cast<uint8_t>(len));
+  data->insert(data->end(), str.begin(), str.begin() + len);
+}
+
+static bool _readBE(const std::vector<uint8_t>& data, size_t* offset, int numBytes,
+                    uint64_t* value) {
+  if (data.size() - *offset < static_cast<size_t>(numBytes))
+    return false;
+  
+  *value = 0;
+  for (int i = 0; i < numBytes; i++)
+    *value = (*value << 8) | data[(*offset)++];
+  return true;
+}
+
+static bool _readString8(const std::vector<uint8_t>& data, size_t* offset, std::string* str) {
+  uint64_t len;
+  if (!_readBE(data, offset, 1, &len) || (data.size() - *offset < len))
+    return false;
+  
+  str->assign(data.begin() + *offset, data.begin() + *offset + len);
+  *offset += len;
+  return true;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Constructor
+////////////////////////////////////////////////////////////
+
+SaveManager::SaveManager() :
+config(Config::instance()),
+jobManager(JobManager::instance()),
+log(Log::instance())
+{
+  _baseSize = 0;
+  _journalSize = 0;
+  _numOfDeltas = 0;
+  _numOfBases = 0;
+  _failedBase = 0;
+  _isIndexLoaded = false;
+  
+  _indexMutex = SDL_CreateMutex();
+  _mutex = SDL_CreateMutex();
+  if (!_indexMutex || !_mutex)
+    log.error(kModScript, "%s", kString18001);
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Destructor
+////////////////////////////////////////////////////////////
+
+SaveManager::~SaveManager() {
+  SDL_DestroyMutex(_indexMutex);
+  SDL_DestroyMutex(_mutex);
+}
+
+////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////
+
+void SaveManager::append(const std::string& path, Serializer* serializer) {
+  int base = 0;
+  if (SDL_LockMutex(_mutex) == 0) {
+    base = _numOfBases;
+    _numOfDeltas++;
+    _journalSize += serializer->data().size();
+    
+    // Tables written again replace those before them
+    SavedTables& savedTables = serializer->savedTables();
+    for (SavedTables::iterator it = savedTables.begin(); it != savedTables.end(); ++it) {
+      if (it->second.empty())
+        _savedTables.erase(it->first);
+      else
+        _savedTables[it->first].swap(it->second);
+    }
+    _index(path, serializer);
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModScript, "%s", kString18002);
+  }
+  
+  SaveJob* job = new SaveJob;
+  job->path = path;
+  job->serializer = serializer;
+  job->base = base;
+  job->isDelta = true;
+  _submit(job);
+}
+
+bool SaveManager::canAppend(const std::string& path) {
+  bool canAppend = false;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    canAppend = (path == _journalPath) && (_numOfDeltas < kSaveMaxDeltas) &&
+                (_journalSize < _baseSize);
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModScript, "%s", kString18002);
+  }
+  
+  return canAppend;
+}
+
+bool SaveManager::erase(const std::string& path) {
+  wait(path);
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    _saveInfos.erase(_nameOf(path));
+    if (path == _journalPath)
+      _journalPath.clear();
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModScript, "%s", kString18002);
+  }
+  
+  bool isErased = (remove(path.c_str()) == 0);
+  remove((path + kSaveJournalExtension).c_str());
+  _submitIndex();
+  
+  return isErased;
+}
+
+void SaveManager::flush() {
+  std::vector<int> handles;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    std::unordered_map<std::string, int>::iterator it = _pendingSaves.begin();
+    while (it != _pendingSaves.end()) {
+      handles.push_back(it->second);
+      ++it;
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModScript, "%s", kString18002);
+  }
+  
+  std::vector<int>::iterator it = handles.begin();
+  while (it != handles.end()) {
+    jobManager.wait(*it);
+    ++it;
+  }
+}
+
+bool SaveManager::isPending(const std::string& path) {
+  bool isPending = false;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    isPending = (_pendingSaves.find(path) != _pendingSaves.end());
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModScript, "%s", kString18002);
+  }
+  
+  return isPending;
+}
+
+void SaveManager::resetJournal() {
+  if (SDL_LockMutex(_mutex) == 0) {
+    _journalPath.clear();
+    _savedTables.clear();
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModScript, "%s", kString18002);
+  }
+}
+
+void SaveManager::save(const std::string& path, Serializer* serializer,
+                       SpotLocations* spotLocations) {
+  int base = 0;
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (spotLocations) {
+      base = ++_numOfBases;
+      _journalPath = path;
+      _spotLocations.swap(*spotLocations);
+      _savedTables.swap(serializer->savedTables());
+      _baseSize = serializer->data().size();
+      _journalSize = 0;
+      _numOfDeltas = 0;
+    }
+    else if (path == _journalPath) {
+      _journalPath.clear();
+      _savedTables.clear();
+    }
+    _index(path, serializer);
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModScript, "%s", kString18002);
+  }
+  
+  SaveJob* job = new SaveJob;
+  job->path = path;
+  job->serializer = serializer;
+  job->base = base;
+  job->isDelta = false;
+  _submit(job);
+}
+
+SaveInfos SaveManager::saveInfos() {
+  _loadIndex();
+  
+  SaveInfos saveInfos;
+  if (SDL_LockMutex(_mutex) == 0) {
+    saveInfos = _saveInfos;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModScript, "%s", kString18002);
+  }
+  
+  return saveInfos;
+}
+
+const SavedTables& SaveManager::savedTables() {
+  return _savedTables;
+}
+
+const SpotLocations& SaveManager::spotLocations() {
+  return _spotLocations;
+}
+
+void SaveManager::terminate() {
+  flush();
+}
+
+void SaveManager::wait(const std::string& path) {
+  int handle = 0;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    std::unordered_map<std::string, int>::iterator it = _pendingSaves.find(path);
+    if (it != _pendingSaves.end())
+      handle = it->second;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModScript, "%s", kString18002);
+  }
+  
+  // Earlier saves to the same file always finish first
+  if (handle)
+    jobManager.wait(handle);
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+void SaveManager::_finish(SaveJob* job, bool isWritten) {
+  SaveInfo fileInfo;
+  if (isWritten && job->serializer)
+    _stat(job->path, &fileInfo);
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    // Now the index can tell whether it changed since
+    SaveInfos::iterator infoIt = _saveInfos.find(_nameOf(job->path));
+    if (isWritten && job->serializer && (infoIt != _saveInfos.end())) {
+      infoIt->second.fileSize = fileInfo.fileSize;
+      infoIt->second.fileTime = fileInfo.fileTime;
+      infoIt->second.journalSize = fileInfo.journalSize;
+    }
+    
+    // A newer save to the same file may already be queued
+    std::unordered_map<std::string, int>::iterator it = _pendingSaves.find(job->path);
+    if (job->handle && (it != _pendingSaves.end()) && (it->second == job->handle))
+      _pendingSaves.erase(it);
+    
+    // The journal may now end in a partial record, and nothing appended
+    // after it would be read
+    if (!isWritten && (job->path == _journalPath))
+      _journalPath.clear();
+    if (!isWritten && job->base)
+      _failedBase = job->base;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModScript, "%s", kString18002);
+  }
+  
+  if (isWritten && job->serializer)
+    _writeIndex();
+  
+  delete job->serializer;
+  delete job;
+}
+
+bool SaveManager::_isFailed(int base) {
+  bool isFailed = true;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    isFailed = (base == _failedBase);
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModScript, "%s", kString18002);
+  }
+  
+  return isFailed;
+}
+
+// Saves are listed as soon as they're made, even if still being written.
+// Must be called with the mutex locked.
+void SaveManager::_index(const std::string& path, Serializer* serializer) {
+  SaveInfo saveInfo;
+  saveInfo.version = DAGON_VERSION_STRING;
+  saveInfo.preview = serializer->preview();
+  saveInfo.roomName = serializer->roomName();
+  saveInfo.time = static_cast<int64_t>(time(NULL));
+  saveInfo.fileSize = -1; // Unknown until written
+  saveInfo.fileTime = -1;
+  saveInfo.journalSize = -1;
+  _saveInfos[_nameOf(path)] = saveInfo;
+}
+
+void SaveManager::_loadIndex() {
+  if (_isIndexLoaded)
+    return;
+  
+  SaveInfos indexedInfos;
+  bool isChanged = !_readIndex(&indexedInfos);
+  SaveInfos foundInfos;
+  
+  const std::string dirPath = config.path(kPathUserData, "", kObjectSave);
+  DIR* dir = opendir(dirPath.c_str());
+  if (dir) {
+    dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+      const char* dot = strrchr(entry->d_name, '.');
+      if (!dot || (strcmp(dot + 1, kDefSaveExtension) != 0))
+        continue;
+      
+      const std::string path = dirPath + entry->d_name;
+      const std::string name = _nameOf(path);
+      SaveInfo saveInfo;
+      _stat(path, &saveInfo);
+      
+      SaveInfos::iterator it = indexedInfos.find(name);
+      if ((it != indexedInfos.end()) && (it->second.fileSize == saveInfo.fileSize) &&
+          (it->second.fileTime == saveInfo.fileTime) &&
+          (it->second.journalSize == saveInfo.journalSize)) {
+        foundInfos[name] = it->second;
+        continue;
+      }
+      
+      // Only saves changed behind the index's back are read again
+      isChanged = true;
+      SDL_RWops* rw = SDL_RWFromFile(path.c_str(), "rb");
+      if (!rw)
+        continue;
+      
+      Deserializer loader(NULL, rw);
+      if (!loader.readHeader())
+        continue;
+      
+      SDL_RWops* journal = SDL_RWFromFile((path + kSaveJournalExtension).c_str(), "rb");
+      if (journal)
+        loader.readJournal(journal);
+      
+      saveInfo.version = loader.version();
+      saveInfo.preview = loader.preview();
+      saveInfo.roomName = loader.roomName();
+      saveInfo.time = saveInfo.fileTime;
+      foundInfos[name] = saveInfo;
+    }
+    closedir(dir);
+  }
+  else {
+    log.error(kModScript, "%s: %s", kString14018, dirPath.c_str());
+  }
+  
+  // Some were removed
+  if (foundInfos.size() != indexedInfos.size())
+    isChanged = true;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    // Saves made since started are newer
+    _saveInfos.insert(foundInfos.begin(), foundInfos.end());
+    _isIndexLoaded = true;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModScript, "%s", kString18002);
+  }
+  
+  if (isChanged)
+    _submitIndex();
+}
+
+std::string SaveManager::_nameOf(const std::string& path) {
+  size_t start = path.find_last_of("/\\");
+  start = (start == std::string::npos) ? 0 : start + 1;
+  
+  size_t end = path.rfind('.');
+  if ((end == std::string::npos) || (end < start))
+    end = path.length();
+  
+  return path.substr(start, end - start);
+}
+
+bool SaveManager::_readIndex(SaveInfos* saveInfos) {
+  const std::string indexPath = config.path(kPathUserData, kDefSaveIndexFile, kObjectSave);
+  SDL_RWops* rw = SDL_RWFromFile(indexPath.c_str(), "rb");
+  if (!rw)
+    return false;
+  
+  Sint64 size = SDL_RWsize(rw);
+  std::vector<uint8_t> data((size > 0) && (size <= kSaveMaxSize) ? size : 0);
+  bool isRead = !data.empty() &&
+                (SDL_RWread(rw, data.data(), 1, data.size()) == data.size());
+  SDL_RWclose(rw);
+  
+  if (!isRead || (data.size() <= sizeof(IDXIdent)) ||
+      (memcmp(data.data(), IDXIdent, sizeof(IDXIdent)) != 0) ||
+      (data[sizeof(IDXIdent)] != kSaveIndexFormat))
+    return false;
+  
+  size_t offset = sizeof(IDXIdent) + 1;
+  uint64_t numOfSaves;
+  if (!_readBE(data, &offset, 4, &numOfSaves))
+    return false;
+  
+  for (uint64_t i = 0; i < numOfSaves; i++) {
+    std::string name;
+    SaveInfo saveInfo;
+    uint64_t time, fileSize, fileTime, journalSize;
+    if (!_readString8(data, &offset, &name) ||
+        !_readString8(data, &offset, &saveInfo.version) ||
+        !_readString8(data, &offset, &saveInfo.preview) ||
+        !_readString8(data, &offset, &saveInfo.roomName) ||
+        !_readBE(data, &offset, 8, &time) || !_readBE(data, &offset, 8, &fileSize) ||
+        !_readBE(data, &offset, 8, &fileTime) || !_readBE(data, &offset, 8, &journalSize))
+      return false;
+    
+    saveInfo.time = static_cast<int64_t>(time);
+    saveInfo.fileSize = static_cast<int64_t>(fileSize);
+    saveInfo.fileTime = static_cast<int64_t>(fileTime);
+    saveInfo.journalSize = static_cast<int64_t>(journalSize);
+    (*saveInfos)[name] = saveInfo;
+  }
+  
+  return true;
+}
+
+// Replaces the file in one step, so that a crash leaves either the
+// previous save or the new one, never a mix of both
+bool SaveManager::_replace(const char* fromPath, const char* toPath) {
+#ifdef DAGON_WINDOWS
+  return MoveFileExA(fromPath, toPath,
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  return rename(fromPath, toPath) == 0;
+#endif
+}
+
+void SaveManager::_runJob(void* ptr) {
+  SaveManager& saveManager = SaveManager::instance();
+  SaveJob* job = static_cast<SaveJob*>(ptr);
+  
+  // Without a serializer, it's the index that's written
+  if (!job->serializer) {
+    saveManager._writeIndex();
+    saveManager._finish(job, true);
+    return;
+  }
+  
+  const std::vector<uint8_t>& data = job->serializer->data();
+  std::string journalPath = job->path + kSaveJournalExtension;
+  bool isWritten;
+  int error = 0;
+  
+  if (job->isDelta) {
+    // Appending is enough, since a partial record is ignored when loading.
+    // Deltas run after the save before them, so if that failed the journal
+    // belongs to an older full save, or ends in a partial record.
+    if (saveManager._isFailed(job->base)) {
+      isWritten = false;
+      error = ECANCELED;
+    }
+    else {
+      isWritten = _writeFile(journalPath, data, "ab");
+      if (!isWritten)
+        error = errno;
+    }
+  }
+  else {
+    job->serializer->compress();
+    
+    std::string tempPath = job->path + kSaveTempExtension;
+    isWritten = _writeFile(tempPath, data, "wb");
+    
+    // Delta saves refer to the previous save, so they're removed first.
+    // If interrupted right after, the previous save is still complete.
+    if (isWritten)
+      isWritten = (remove(journalPath.c_str()) == 0) || (errno == ENOENT);
+    
+    if (isWritten)
+      isWritten = _replace(tempPath.c_str(), job->path.c_str());
+    
+    if (!isWritten) {
+      error = errno;
+      remove(tempPath.c_str());
+    }
+  }
+  
+  if (!isWritten)
+    saveManager.log.error(kModScript, "%s: %s (%s)", kString14016, job->path.c_str(),
+                          strerror(error));
+  
+  saveManager._finish(job, isWritten);
+}
+
+void SaveManager::_stat(const std::string& path, SaveInfo* saveInfo) {
+  struct stat fileStat;
+  if (stat(path.c_str(), &fileStat) == 0) {
+    saveInfo->fileSize = static_cast<int64_t>(fileStat.st_size);
+    saveInfo->fileTime = static_cast<int64_t>(fileStat.st_mtime);
+  }
+  else {
+    saveInfo->fileSize = -1;
+    saveInfo->fileTime = -1;
+  }
+  
+  if (stat((path + kSaveJournalExtension).c_str(), &fileStat) == 0)
+    saveInfo->journalSize = static_cast<int64_t>(fileStat.st_size);
+  else
+    saveInfo->journalSize = 0;
+}
+
+void SaveManager::_submit(SaveJob* job) {
+  int handle = 0;
+  job->handle = 0;
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    // Saves to the same file are written in order. A worker may run the
+    // job right away, but _finish() waits for the mutex before reading
+    // the handle, so it's recorded by then.
+    int after = 0;
+    std::unordered_map<std::string, int>::iterator it = _pendingSaves.find(job->path);
+    if (it != _pendingSaves.end())
+      after = it->second;
+    
+    handle = jobManager.submit(_runJob, job, kJobPriorityNormal, after);
+    job->handle = handle;
+    if (handle)
+      _pendingSaves[job->path] = handle;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModScript, "%s", kString18002);
+  }
+  
+  // No workers (yet, or anymore), so it's written right away. Otherwise
+  // the job may be gone already, so only the handle kept here is read.
+  if (!handle)
+    _runJob(job);
+}
+
+void SaveManager::_submitIndex() {
+  SaveJob* job = new SaveJob;
+  job->path = config.path(kPathUserData, kDefSaveIndexFile, kObjectSave);
+  job->serializer = NULL;
+  job->base = 0;
+  job->isDelta = false;
+  _submit(job);
+}
+
+// Written like saves, so that it's never found half written
+void SaveManager::_writeIndex() {
+  if (SDL_LockMutex(_indexMutex) != 0) {
+    log.error(kModScript, "%s", kString18002);
+    return;
+  }
+  
+  std::vector<uint8_t> data;
+  bool isIndexLoaded = false;
+  if (SDL_LockMutex(_mutex) == 0) {
+    // Until loaded, it would be missing every save made before
+    isIndexLoaded = _isIndexLoaded;
+    if (isIndexLoaded) {
+      data.insert(data.end(), IDXIdent, IDXIdent + sizeof(IDXIdent));
+      data.push_back(kSaveIndexFormat);
+      _writeBE(&data, _saveInfos.size(), 4);
+      
+      SaveInfos::iterator it = _saveInfos.begin();
+      while (it != _saveInfos.end()) {
+        _writeString8(&data, it->first);
+        _writeString8(&data, it->second.version);
+        _writeString8(&data, it->second.preview);
+        _writeString8(&data, it->second.roomName);
+        _writeBE(&data, static_cast<uint64_t>(it->second.time), 8);
+        _writeBE(&data, static_cast<uint64_t>(it->second.fileSize), 8);
+        _writeBE(&data, static_cast<uint64_t>(it->second.fileTime), 8);
+        _writeBE(&data, static_cast<uint64_t>(it->second.journalSize), 8);
+        ++it;
+      }
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModScript, "%s", kString18002);
+  }
+  
+  if (isIndexLoaded) {
+    const std::string indexPath = config.path(kPathUserData, kDefSaveIndexFile, kObjectSave);
+    const std::string tempPath = indexPath + kSaveTempExtension;
+    if (!_writeFile(tempPath, data, "wb") || !_replace(tempPath.c_str(), indexPath.c_str())) {
+      remove(tempPath.c_str());
+      log.error(kModScript, "%s", kString14017);
+    }
+  }
+  
+  SDL_UnlockMutex(_indexMutex);
+}
+
+// Makes sure it's on disk before anything refers to it
+bool SaveManager::_writeFile(const std::string& path, const std::vector<uint8_t>& data,
+                             const char* mode) {
+  FILE* file = fopen(path.c_str(), mode);
+  if (!file)
+    return false;
+  
+  bool isWritten = (fwrite(&data[0], 1, data.size(), file) == data.size()) &&
+                   (fflush(file) == 0);
+  
+#ifdef DAGON_WINDOWS
+  if (isWritten)
+    isWritten = (_commit(_fileno(file)) == 0);
+#else
+  if (isWritten)
+    isWritten = (fsync(fileno(file)) == 0);
+#endif
+  
+  if (fclose(file) != 0)
+    isWritten = false;
+  
+  return isWritten;
+}
+
+}
@@ -0,0 +1,163 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef DAGON_SAVEMANAGER_H_
+#define DAGON_SAVEMANAGER_H_
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <SDL2/SDL_mutex.h>
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Platform.h"
+#include "Serializer.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Saves are written here first, then renamed over the real file
+#define kSaveTempExtension ".tmp"
+
+// Delta saves are appended here, next to the full save
+#define kSaveJournalExtension ".journal"
+
+// A full save is written instead once there are this many delta saves,
+// or once they add up to more than the full save itself
+#define kSaveMaxDeltas 32
+
+// The index of saves begins with this, followed by the format
+const char IDXIdent[] = { '\x44', '\x41', '\x47', '\x4F', '\x4E', '\x49', '\x44', '\x58' };
+#define kSaveIndexFormat 1
+
+class Config;
+class JobManager;
+class Log;
+
+typedef struct {
+  std::string path;
+  Serializer* serializer;
+  int handle;
+  int base; // Full save that delta saves are appended to, if any
+  bool isDelta;
+} SaveJob;
+
+// What the index knows of each save, by name. The size and time of the
+// files are compared to find saves changed behind the index's back.
+typedef struct {
+  std::string version;
+  std::string preview;
+  std::string roomName;
+  int64_t time; // Seconds since the epoch
+  int64_t fileSize;
+  int64_t fileTime;
+  int64_t journalSize;
+} SaveInfo;
+
+typedef std::map<std::string, SaveInfo> SaveInfos;
+
+////////////////////////////////////////////////////////////
+// Interface - Singleton class
+////////////////////////////////////////////////////////////
+
+class SaveManager {
+  Config& config;
+  JobManager& jobManager;
+  Log& log;
+  
+  SDL_mutex* _indexMutex; // Held while writing the index
+  SDL_mutex* _mutex;
+  std::unordered_map<std::string, int> _pendingSaves; // Latest job for each path
+  
+  // The full save that delta saves may be appended to, if any
+  std::string _journalPath;
+  SpotLocations _spotLocations;
+  SavedTables _savedTables; // As of the last save, only used on the main thread
+  size_t _baseSize;
+  size_t _journalSize;
+  int _numOfDeltas;
+  
+  // Counts full saves taking deltas. Once one of them or a delta fails,
+  // deltas queued after it are dropped rather than appended.
+  int _numOfBases;
+  int _failedBase;
+  
+  // Loaded the first time it's needed, then kept up to date
+  SaveInfos _saveInfos;
+  bool _isIndexLoaded;
+  
+  void _finish(SaveJob* job, bool isWritten);
+  void _index(const std::string& path, Serializer* serializer);
+  bool _isFailed(int base);
+  void _loadIndex();
+  static std::string _nameOf(const std::string& path);
+  bool _readIndex(SaveInfos* saveInfos);
+  static bool _replace(const char* fromPath, const char* toPath);
+  static void _runJob(void* ptr);
+  static void _stat(const std::string& path, SaveInfo* saveInfo);
+  void _submit(SaveJob* job);
+  void _submitIndex();
+  void _writeIndex();
+  static bool _writeFile(const std::string& path, const std::vector<uint8_t>& data,
+                         const char* mode);
+  
+  SaveManager();
+  SaveManager(SaveManager const&);
+  SaveManager& operator=(SaveManager const&);
+  ~SaveManager();
+
+public:
+  static SaveManager& instance() {
+    static SaveManager saveManager;
+    return saveManager;
+  }
+  
+  // Takes the serializer, holding a delta save, and appends it to the
+  // journal of the full save
+  void append(const std::string& path, Serializer* serializer);
+  bool canAppend(const std::string& path);
+  // Removes the save along with its delta saves
+  bool erase(const std::string& path);
+  // Waits for every pending save
+  void flush();
+  bool isPending(const std::string& path);
+  // Delta saves must follow a full save again, as the state was replaced
+  void resetJournal();
+  
+  // Takes the serializer, already holding the whole save, and compresses
+  // and writes it on a worker. The file is only replaced once complete.
+  // With the locations of its spots, delta saves may follow.
+  void save(const std::string& path, Serializer* serializer,
+            SpotLocations* spotLocations = NULL);
+  // Answered from the index, which is checked against the files once,
+  // reading again only the saves that changed
+  SaveInfos saveInfos();
+  const SavedTables& savedTables();
+  const SpotLocations& spotLocations();
+  void terminate();
+  void wait(const std::string& path);
+};
+
+}
+
+#endif // DAGON_SAVEMANAGER_H_
@@ -93,6 +93,13 @@ void Scene::drawSpots(bool disableVideos) {
       do {
         Spot* spot = currentNode->currentSpot();
         
+        // Videos out of sight aren't converted nor uploaded, only kept in sync.
+        // Neither are those of a node drawn in the background.
+        if (spot->hasVideo()) {
+          spot->video()->setVisible(!disableVideos && spot->isEnabled() &&
+                                    renderManager.testPolygon(spot->arrayOfCoordinates(), spot->face()));
+        }
+        
         if (spot->hasTexture() && spot->isEnabled()) {
           if (spot->texture()->isLoaded()) {
 			// FIXME: This was the culprit of a crash that should be investigated someday
@@ -137,6 +144,14 @@ void Scene::drawSpots(bool disableVideos) {
       renderManager.disablePostprocess();
       processed = true;
     }
+    else if (currentNode->hasSpots()) {
+      currentNode->beginIteratingSpots();
+      do {
+        Spot* spot = currentNode->currentSpot();
+        if (spot->hasVideo())
+          spot->video()->setVisible(false);
+      } while (currentNode->iterateSpots());
+    }
   }
   
   
@@ -21,14 +21,22 @@
 #include "FeedManager.h"
 #include "Log.h"
 #include "Proxy.h"
+#include "SaveManager.h"
 #include "Script.h"
+#include "ScriptAllocator.h"
+#include "ScriptProfiler.h"
+#include "Snapshot.h"
 #include "TimerManager.h"
 #include "Serializer.h"
 #include "Deserializer.h"
 
 #include "Luna.h"
 
-#include <dirent.h>
+#include <SDL2/SDL_timer.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 
 // The way the engine is designed, all static Lua functions will have
 // to grab a reference to the Control singleton and Log when required.
@@ -39,16 +47,71 @@
 
 namespace dagon {
 
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// 64-bit FNV-1a, only to tell whether the source changed
+static uint64_t _hashOf(const std::vector<char> &data) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (char c : data) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ULL;
+  }
+  
+  return hash;
+}
+
+static bool _readFile(const std::string &path, std::vector<char> *data) {
+  SDL_RWops *rw = SDL_RWFromFile(path.c_str(), "rb");
+  if (!rw)
+    return false;
+  
+  Sint64 size = SDL_RWsize(rw);
+  data->resize(size > 0 ? static_cast<size_t>(size) : 0);
+  bool isRead = (size >= 0) &&
+                (data->empty() || SDL_RWread(rw, data->data(), 1, data->size()) == data->size());
+  SDL_RWclose(rw);
+  
+  return isRead;
+}
+
+// As luaL_loadfile does, a first line starting with '#' is skipped, but
+// still counted
+static int _loadSource(lua_State *L, const std::vector<char> &source, const std::string &path) {
+  size_t start = 0;
+  if (!source.empty() && source[0] == '#') {
+    while (start < source.size() && source[start] != '\n')
+      start++;
+  }
+  
+  const std::string chunkName = "@" + path;
+  return luaL_loadbuffer(L, source.data() + start, source.size() - start, chunkName.c_str());
+}
+
+static int _writeChunk(lua_State *L, const void *p, size_t sz, void *ud) {
+  const char *bytes = static_cast<const char*>(p);
+  std::vector<char> *chunk = static_cast<std::vector<char>*>(ud);
+  chunk->insert(chunk->end(), bytes, bytes + sz);
+  return 0;
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - Constructor
 ////////////////////////////////////////////////////////////
 
 Script::Script() :
 config(Config::instance()),
-log(Log::instance())
+log(Log::instance()),
+scriptAllocator(ScriptAllocator::instance()),
+scriptProfiler(ScriptProfiler::instance())
 {
+  _collectThreshold = 0;
+  _gcPause = 0;
+  _gcStepMultiplier = 0;
   _isInitialized = false;
   _isSuspended = false;
+  _numOfSnapshots = 0;
 }
 
 ////////////////////////////////////////////////////////////
@@ -56,6 +119,15 @@ log(Log::instance())
 ////////////////////////////////////////////////////////////
 
 Script::~Script() {
+  // Snapshots hold references in Lua
+  while (!_snapshots.empty()) {
+    delete _snapshots.back();
+    _snapshots.pop_back();
+  }
+  
+  // Gives back the allocator it wraps
+  scriptProfiler.setEnabled(false);
+  
   if (_isInitialized)
     lua_close(_L);
 }
@@ -69,16 +141,116 @@ Script::~Script() {
 // create a string with the actual modification, ie: spot:enable()
 // Filter switch and other heavy duty operations.
 
+// Lua's collector runs here in the time left by frames. Tuning is followed
+// as Lua would: a cycle starts once the heap grows by the pause, and each
+// step collects as much as the step multiplier says.
+void Script::collect(double budget) {
+  if (!_isInitialized)
+    return;
+  
+  if (config.gcStepMultiplier != _gcStepMultiplier) {
+    _gcStepMultiplier = config.gcStepMultiplier;
+    lua_gc(_L, LUA_GCSETSTEPMUL, _gcStepMultiplier);
+  }
+  
+  int pause = config.gcPause;
+  if (config.gcPerFrame) {
+    if (lua_gc(_L, LUA_GCCOUNT, 0) >= _collectThreshold) {
+      Uint64 begin = SDL_GetPerformanceCounter();
+      double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+      do {
+        if (lua_gc(_L, LUA_GCSTEP, 0)) {
+          // Finished a cycle, so wait until the heap grows again
+          _collectThreshold = lua_gc(_L, LUA_GCCOUNT, 0) * config.gcPause / 100;
+          break;
+        }
+      } while ((SDL_GetPerformanceCounter() - begin) * 1000.0 / frequency < budget);
+    }
+    
+    // Lua still collects on its own, for callbacks, room loads and frames
+    // in the background, but waits longer. Never past the memory limit,
+    // though, as allocations would fail without collecting first.
+    pause *= kScriptCollectBackstop;
+    if (config.scriptMemoryLimit > 0) {
+      int heap = std::max(lua_gc(_L, LUA_GCCOUNT, 0), 1);
+      int limit = config.scriptMemoryLimit / 1024 * kScriptCollectHeadroom / heap;
+      pause = std::max(std::min(pause, limit), 100);
+    }
+  }
+  
+  if (pause != _gcPause) {
+    _gcPause = pause;
+    lua_gc(_L, LUA_GCSETPAUSE, _gcPause);
+  }
+}
+
+bool Script::compile(const std::string &path, std::string *error) {
+  std::vector<char> source;
+  if (!_readFile(path, &source)) {
+    *error = std::string(kString14006) + ": " + path;
+    return false;
+  }
+  
+  std::vector<char> compiled(LUCIdent, LUCIdent + sizeof(LUCIdent));
+  uint64_t hash = _hashOf(source);
+  for (int i = 7; i >= 0; i--)
+    compiled.push_back(static_cast<char>(hash >> (i * 8)));
+  
+  // A state of its own, as nothing is run
+  lua_State *L = luaL_newstate();
+  bool isCompiled = (_loadSource(L, source, path) == 0) &&
+                    (lua_dump(L, _writeChunk, &compiled) == 0);
+  if (!isCompiled)
+    *error = lua_isstring(L, -1) ? lua_tostring(L, -1) : path;
+  lua_close(L);
+  
+  if (!isCompiled)
+    return false;
+  
+  const std::string compiledPath = path + kScriptCompiledSuffix;
+  SDL_RWops *rw = SDL_RWFromFile(compiledPath.c_str(), "wb");
+  bool isWritten = rw && (SDL_RWwrite(rw, compiled.data(), 1, compiled.size()) == compiled.size());
+  if (rw && (SDL_RWclose(rw) != 0))
+    isWritten = false;
+  
+  if (!isWritten) {
+    remove(compiledPath.c_str());
+    *error = std::string(kString14020) + ": " + compiledPath;
+    return false;
+  }
+  
+  return true;
+}
+
 // TODO: Support loading script from parameters
 // TODO: Consider seeking paths again if debug mode was enabled
 void Script::init() {
   char script[kMaxFileLength];
   
-  _L = lua_open();
+  // Small blocks are pooled, and the heap is limited as configured
+  _L = lua_newstate(ScriptAllocator::allocate, &scriptAllocator);
+  lua_atpanic(_L, _panic);
   luaL_openlibs(_L);
   
+  // The config lib requires a special treatment because
+  // it exports properties, not methods. It's registered first,
+  // as the config file is applied through it.
+  lua_newuserdata(_L, sizeof(void*));
+  
+  lua_pushvalue(_L, -1);
+  
+  luaL_newmetatable(_L, "ConfigLib");
+  DGRegisterProperties(_L, ConfigLib, kConfigLibPropertyNames);
+  lua_setmetatable(_L, -2);
+  
+  lua_newtable(_L);
+  lua_setfenv(_L, -2);
+  
+  lua_setglobal(_L, "config");
+  lua_pop(_L, 1);
+  
   // The following code attempts to load a config file, and if it does exist
-  // copies the created table to the Config metatable
+  // copies the created table to the config lib
   if (luaL_loadfile(_L, config.path(kPathApp, kDefConfigFile, kObjectGeneric).c_str()) == 0) {
     lua_newtable(_L);
     lua_pushvalue(_L, -1);
@@ -87,13 +259,15 @@ void Script::init() {
     
     lua_pcall(_L, 0, 0, 0);
     
+    lua_getglobal(_L, "config");
     lua_rawgeti(_L, LUA_REGISTRYINDEX, ref);
     lua_pushnil(_L);
-    while (lua_next(_L, 1) != 0) {
-      ConfigLibSet(_L);
-      
-      lua_pop(_L, 1);
+    while (lua_next(_L, -2) != 0) {
+      lua_pushvalue(_L, -2);
+      lua_insert(_L, -2);
+      lua_settable(_L, -5);
     }
+    lua_pop(_L, 2);
   }
   else
     log.error(kModScript, "%s", kString14015);
@@ -113,6 +287,13 @@ void Script::init() {
   luaL_dostring(_L, "package.path = package.path .. \";modules/?.lua\"");
   luaL_dostring(_L, "package.path = package.path .. \";scripts/?.lua\"");
   
+  // Modules are loaded like scripts, so that compiled ones are preferred
+  lua_getglobal(_L, "package");
+  lua_getfield(_L, -1, "loaders");
+  lua_pushcfunction(_L, _searchModule);
+  lua_rawseti(_L, -2, 2);
+  lua_pop(_L, 2);
+  
   // Register all proxys
   Luna<AudioProxy>::Register(_L);
   Luna<ButtonProxy>::Register(_L);
@@ -128,28 +309,13 @@ void Script::init() {
   luaL_register(_L, "cursor", kCursorLib);
   luaL_register(_L, "system", SystemLib);
   
-  // The config lib requires a special treatment because
-  // it exports properties, not methods
-  lua_newuserdata(_L, sizeof(void*));
-  
-  lua_pushvalue(_L, -1);
-  
-  luaL_newmetatable(_L, "ConfigLib");
-  luaL_register(_L, NULL, ConfigLib);
-  lua_setmetatable(_L, -2);
-  
-  lua_newtable(_L);
-  lua_setfenv(_L, -2);
-  
-  lua_setglobal(_L, "config");
-  
-  // Same with the camera settings
+  // Same as the config lib with the camera settings
   lua_newuserdata(_L, sizeof(void*));
   
   lua_pushvalue(_L, -1);
   
   luaL_newmetatable(_L, "CameraLib");
-  luaL_register(_L, NULL, CameraLib);
+  DGRegisterProperties(_L, CameraLib, kCameraLibPropertyNames);
   lua_setmetatable(_L, -2);
   
   lua_newtable(_L);
@@ -171,8 +337,21 @@ void Script::init() {
   
   lua_setglobal(_L, "effects");
 
-  // Create a table for game scripts to store data they want persisted
+  // Create a table for game scripts to store data they want persisted.
+  // Its metatable forwards everything to the actual data, so raw access
+  // (next, rawget, rawset, # and table functions) only sees an empty
+  // table. Scripts index it and iterate it with pairs and ipairs instead.
+  lua_newtable(_L);
+  luaL_newmetatable(_L, kScriptPersistence);
+  lua_newtable(_L);
+  lua_setfield(_L, -2, "data");
   lua_newtable(_L);
+  lua_setfield(_L, -2, "changes");
+  lua_pushcfunction(_L, _persistenceIndex);
+  lua_setfield(_L, -2, "__index");
+  lua_pushcfunction(_L, _persistenceNewIndex);
+  lua_setfield(_L, -2, "__newindex");
+  lua_setmetatable(_L, -2);
   lua_setglobal(_L, "dgPersistence");
   
   // Now we register the global functions that don't belong to any library
@@ -180,8 +359,9 @@ void Script::init() {
   
   // We're ready to roll, let's attempt to load the script in a Lua thread
   _thread = lua_newthread(_L);
+  scriptProfiler.init(_L, _thread);
   snprintf(script, kMaxFileLength, "scripts/%s", config.script().c_str());
-  int s = luaL_loadfile(_thread, config.path(kPathApp, script, kObjectGeneric).c_str());
+  int s = _loadFile(_thread, config.path(kPathApp, script, kObjectGeneric));
   if (s == 0)
     _isInitialized = true;
   else {
@@ -200,6 +380,33 @@ const char* Script::module() {
   return _arrayOfModuleNames.back().c_str();
 }
 
+void Script::clearPersistenceChanges(lua_State *L) {
+  if (!pushPersistenceChanges(L))
+    return;
+  
+  lua_pushnil(L);
+  while (lua_next(L, -2) != 0) {
+    lua_pop(L, 1);
+    lua_pushvalue(L, -1);
+    lua_pushnil(L);
+    lua_rawset(L, -4);
+  }
+  lua_pop(L, 1);
+}
+
+void Script::pushPersistence(lua_State *L) {
+  lua_getglobal(L, "dgPersistence");
+  if (_pushPersistenceField(L, lua_gettop(L), "data"))
+    lua_remove(L, -2);
+}
+
+bool Script::pushPersistenceChanges(lua_State *L) {
+  lua_getglobal(L, "dgPersistence");
+  bool isTracked = _pushPersistenceField(L, lua_gettop(L), "changes");
+  lua_remove(L, isTracked ? -2 : -1);
+  return isTracked;
+}
+
 bool Script::isExecutingModule() {
   // We simply test if the vector is empty. If it is,
   // it means no modules are stacked.
@@ -215,9 +422,17 @@ void Script::processCallback(int handler, int object) {
   
   lua_rawgeti(_thread, LUA_REGISTRYINDEX, handler);
   
+  // Measured along with every function it calls, if profiling scripts
+  bool isProfiled = scriptProfiler.isEnabled();
+  if (isProfiled)
+    scriptProfiler.beginCallback(_thread, handler);
+  
   if (int result =  lua_pcall(_thread, 0, 0, 0))
     _error(result);
   
+  if (isProfiled)
+    scriptProfiler.endCallback();
+  
   // TODO: Confirm this change is not breaking something else
 /*  if (_isSuspended) {
     if (int result =  lua_pcall(_thread, 0, 0, 0))
@@ -235,6 +450,10 @@ void Script::processCommand(const char *command) {
     _error(result);
 }
 
+void Script::releaseCallback(int handler) {
+  luaL_unref(_L, LUA_REGISTRYINDEX, handler);
+}
+
 void Script::resume() {
   if (_isSuspended) {
     _isSuspended = false;
@@ -293,6 +512,40 @@ void Script::_error(int result) {
   }
 }
 
+// Same as luaL_loadfile, but prefers the compiled script when it was
+// compiled from the same source, or when there's no source
+int Script::_loadFile(lua_State *L, const std::string &path) {
+  std::vector<char> source;
+  bool hasSource = _readFile(path, &source);
+  
+  std::vector<char> compiled;
+  const size_t headerSize = sizeof(LUCIdent) + 8;
+  if (_readFile(path + kScriptCompiledSuffix, &compiled) && (compiled.size() > headerSize) &&
+      (memcmp(compiled.data(), LUCIdent, sizeof(LUCIdent)) == 0)) {
+    uint64_t hash = 0;
+    for (size_t i = sizeof(LUCIdent); i < headerSize; i++)
+      hash = (hash << 8) | static_cast<uint8_t>(compiled[i]);
+    
+    if (!hasSource || (hash == _hashOf(source))) {
+      const std::string chunkName = "@" + path;
+      int result = luaL_loadbuffer(L, compiled.data() + headerSize,
+                                   compiled.size() - headerSize, chunkName.c_str());
+      
+      // Most likely compiled by a different build of Lua
+      if ((result == 0) || !hasSource)
+        return result;
+      lua_pop(L, 1);
+    }
+  }
+  
+  if (!hasSource) {
+    lua_pushfstring(L, "cannot open %s", path.c_str());
+    return LUA_ERRFILE;
+  }
+  
+  return _loadSource(L, source, path);
+}
+
 void Script::_loadRoomFile(lua_State *L, const char *module) {
   char line[kMaxLogLength], script[kMaxFileLength];
 
@@ -303,7 +556,7 @@ void Script::_loadRoomFile(lua_State *L, const char *module) {
   // Load the corresponding Lua file
   snprintf(script, kMaxFileLength, "%s.lua", module);
 
-  int s = luaL_loadfile(L, config.path(kPathApp, script, kObjectRoom).c_str());
+  int s = _loadFile(L, config.path(kPathApp, script, kObjectRoom));
   if (s == 0) {
     setModule(module);
     s = lua_pcall(L, 0, 0, 0);
@@ -316,6 +569,13 @@ void Script::_loadRoomFile(lua_State *L, const char *module) {
   }
 }
   
+// Errors outside of a protected call, which Lua can't recover from
+int Script::_panic(lua_State *L) {
+  const char *message = lua_tostring(L, -1);
+  Log::instance().error(kModScript, "%s: %s", kString14010, message ? message : "?");
+  return 0;
+}
+  
 int Script::_globalCopy(lua_State *L) {
   luaL_checkudata(L, 1, "EffectsLib");
   
@@ -380,6 +640,19 @@ int Script::_globalHotkey(lua_State *L) {
   return 0;
 }
 
+// Calls pairs or ipairs, whichever is the upvalue, on the data if given
+// dgPersistence, so that iterating isn't any slower
+int Script::_globalIterate(lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_settop(L, 1);
+  lua_pushvalue(L, lua_upvalueindex(1));
+  if (!_pushPersistenceField(L, 1, "data"))
+    lua_pushvalue(L, 1);
+  lua_call(L, 1, 3);
+  
+  return 3;
+}
+
 int Script::_globalLookAt(lua_State *L) {
   // NOTE: The user cannot use a custom angle between 0 and 5
   
@@ -624,6 +897,7 @@ int Script::_globalVersion(lua_State *L) {
 }
 
 int Script::_globalPersist(lua_State *L) {
+  bool delta = false;
   bool overwrite = false;
   char name[kMaxFileLength];
   snprintf(name, kMaxFileLength, "%s.%s", luaL_checkstring(L, 1), kDefSaveExtension);
@@ -639,51 +913,68 @@ int Script::_globalPersist(lua_State *L) {
       lua_pushvalue(L, -2);
       if (strcmp(lua_tostring(L, -1), "overwrite") == 0)
         overwrite = lua_toboolean(L, -2);
+      else if (strcmp(lua_tostring(L, -1), "delta") == 0)
+        delta = lua_toboolean(L, -2);
       lua_pop(L, 2);
     }
   }
 
-  SDL_RWops* file;
   const std::string path = Config::instance().path(kPathUserData, name, kObjectSave);
-  if ((file = SDL_RWFromFile(path.c_str(), "rb"))) { // Check if file exists
-    SDL_RWclose(file);
-
-    if (!overwrite) {
+  SaveManager& saveManager = SaveManager::instance();
+  if (!overwrite) {
+    // A save still being written counts as existing
+    bool exists = saveManager.isPending(path);
+    SDL_RWops* file;
+    if (!exists && (file = SDL_RWFromFile(path.c_str(), "rb"))) {
+      SDL_RWclose(file);
+      exists = true;
+    }
+    
+    if (exists) {
       lua_pushboolean(L, false);
       return 1;
     }
   }
 
-  if (!(file = SDL_RWFromFile(path.c_str(), "wb"))) {
-    Log::instance().error(kModScript, "Can't open save file for writing: %s", SDL_GetError());
+  if (Control::instance().currentRoom()->hasPersistEvent())
+    Script::instance().processCallback(Control::instance().currentRoom()->persistEvent(), 0);
+
+  if (Control::instance().currentNode()->hasPersistEvent())
+    Script::instance().processCallback(Control::instance().currentNode()->persistEvent(), 0);
+  
+  // With delta, only what changed since the last save to the same file is
+  // written, until it's time for a full save again
+  Serializer* save = new Serializer(L);
+  bool isDelta = delta && saveManager.canAppend(path);
+  if (isDelta && !save->writeDelta(saveManager.spotLocations())) {
+    delete save;
+    save = new Serializer(L);
+    isDelta = false;
+  }
+  
+  // Otherwise the whole state is captured here, then compressed and
+  // written to disk in the background
+  SpotLocations spotLocations;
+  errno = 0;
+  if (!isDelta && !(save->writeHeader() && save->writeScriptData() &&
+                    save->writeRoomData(&spotLocations))) {
+    Log::instance().error(kModScript, "Error while saving: %s", strerror(errno));
+    delete save;
     lua_pushboolean(L, false);
     return 1;
   }
-
-  { // Scope to ensure file is closed before going to SAVE_ERROR
-    Serializer save(L, file);
-
-    if (!save.writeHeader())
-      goto SAVE_ERROR;
-    
-    if (Control::instance().currentRoom()->hasPersistEvent())
-      Script::instance().processCallback(Control::instance().currentRoom()->persistEvent(), 0);
-
-    if (Control::instance().currentNode()->hasPersistEvent())
-      Script::instance().processCallback(Control::instance().currentNode()->persistEvent(), 0);
-    
-    if (!save.writeScriptData() || !save.writeRoomData())
-      goto SAVE_ERROR;
-  }
-
+  
+  // Changes from now on go to the next delta save
+  clearPersistenceChanges(L);
+  Object::clearChangedObjects();
+  
+  if (isDelta)
+    saveManager.append(path, save);
+  else
+    saveManager.save(path, save, &spotLocations);
+  
   lua_pushboolean(L, true);
   return 1;
-
-SAVE_ERROR:
-  Log::instance().error(kModScript, "Error while saving: %s", SDL_GetError());
-  remove(path.c_str());
-  lua_pushboolean(L, false);
-  return 1;
 }
 
 int Script::_globalUnpersist(lua_State *L) {
@@ -692,6 +983,8 @@ int Script::_globalUnpersist(lua_State *L) {
 
   SDL_RWops *file;
   const std::string filePath = Config::instance().path(kPathUserData, fileName, kObjectSave);
+  SaveManager::instance().wait(filePath);
+  SaveManager::instance().resetJournal();
   if (!(file = SDL_RWFromFile(filePath.c_str(), "rb"))) {
     Log::instance().error(kModScript, "Error opening save game file: %s", SDL_GetError());
     lua_pushboolean(L, false);
@@ -705,6 +998,15 @@ int Script::_globalUnpersist(lua_State *L) {
     return 1;
   }
 
+  // Delta saves written since, if any
+  const std::string journalPath = filePath + kSaveJournalExtension;
+  SDL_RWops *journal = SDL_RWFromFile(journalPath.c_str(), "rb");
+  if (journal && !loader.readJournal(journal)) {
+    Log::instance().error(kModScript, "Error reading journal: %s", SDL_GetError());
+    lua_pushboolean(L, false);
+    return 1;
+  }
+
   if (loader.version() != DAGON_VERSION_STRING) {
     Log::instance().info(kModScript,
                          "Version mismatch. Save file was created in %s attempting to load in %s",
@@ -768,41 +1070,110 @@ int Script::_globalUnpersist(lua_State *L) {
 }
 
 int Script::_globalGetSaves(lua_State *L) {
-  const std::string dirPath = Config::instance().path(kPathUserData, "", kObjectSave);
-  DIR *dir = opendir(dirPath.c_str());
-  if (!dir) {
-    // TODO: More specific error message (what does the errno mean?)
-    Log::instance().error(kModScript, "Couldn't open directory \"%s\". Errno: %d",
-                          dirPath.c_str(), errno);
+  // Optionally, each save comes with its room, version and time too
+  bool hasDetails = lua_toboolean(L, 1);
+  const SaveInfos saveInfos = SaveManager::instance().saveInfos();
+
+  lua_newtable(L);
+  for (SaveInfos::const_iterator it = saveInfos.begin(); it != saveInfos.end(); ++it) {
+    lua_pushstring(L, it->first.c_str());
+    if (hasDetails) {
+      lua_newtable(L);
+      lua_pushstring(L, it->second.preview.c_str());
+      lua_setfield(L, -2, "preview");
+      lua_pushstring(L, it->second.roomName.c_str());
+      lua_setfield(L, -2, "room");
+      lua_pushstring(L, it->second.version.c_str());
+      lua_setfield(L, -2, "version");
+      lua_pushnumber(L, static_cast<lua_Number>(it->second.time));
+      lua_setfield(L, -2, "time");
+    }
+    else {
+      lua_pushstring(L, it->second.preview.c_str());
+    }
+    lua_settable(L, -3);
+  }
+
+  return 1;
+}
+
+int Script::_globalDeleteSave(lua_State *L) {
+  char fileName[kMaxFileLength];
+  snprintf(fileName, kMaxFileLength, "%s.%s", luaL_checkstring(L, 1), kDefSaveExtension);
+
+  const std::string filePath = Config::instance().path(kPathUserData, fileName, kObjectSave);
+  lua_pushboolean(L, SaveManager::instance().erase(filePath));
+  return 1;
+}
+
+int Script::_globalSnapshot(lua_State *L) {
+  Script& script = Script::instance();
+
+  // Taken on the main state, which outlives the caller
+  Snapshot* snapshot = new Snapshot(script._L, script._numOfSnapshots + 1);
+  if (!snapshot->capture()) {
+    Log::instance().error(kModScript, "%s", kString14019);
+    delete snapshot;
     return 0;
   }
 
-  lua_newtable(L);
-  dirent *entry;
-  while ((entry = readdir(dir)) != nullptr) {
-    const char *dot = strrchr(entry->d_name, '.');
-    if (dot && strcmp(dot + 1, kDefSaveExtension) == 0) {
-      char name[kMaxFileLength];
-      size_t len = strlen(entry->d_name) - strlen(kDefSaveExtension) - 1; // - 1 because of .
-      strncpy(name, entry->d_name, len); // Cut off extension
-      name[len] = '\0';
-
-      const std::string path = Config::instance().path(kPathUserData, entry->d_name, kObjectSave);
-      SDL_RWops *file;
-      if (!(file = SDL_RWFromFile(path.c_str(), "rb")))
-        continue;
+  script._numOfSnapshots++;
+  script._snapshots.push_back(snapshot);
+  while (script._snapshots.size() > 1 &&
+         script._snapshots.size() > static_cast<size_t>(script.config.snapshots)) {
+    delete script._snapshots.front();
+    script._snapshots.pop_front();
+  }
 
-      Deserializer loader(L, file);
-      if (!loader.readHeader())
-        continue;
+  lua_pushnumber(L, snapshot->id());
+  return 1;
+}
+
+int Script::_globalRestore(lua_State *L) {
+  Script& script = Script::instance();
 
-      lua_pushstring(L, name);
-      lua_pushstring(L, loader.preview().c_str());
-      lua_settable(L, -3);
+  // The latest one, unless told which
+  Snapshot* snapshot = nullptr;
+  if (lua_isnoneornil(L, 1)) {
+    if (!script._snapshots.empty())
+      snapshot = script._snapshots.back();
+  }
+  else {
+    int id = luaL_checkint(L, 1);
+    for (Snapshot* each : script._snapshots) {
+      if (each->id() == id)
+        snapshot = each;
     }
   }
 
-  closedir(dir);
+  if (!snapshot) {
+    lua_pushboolean(L, false);
+    return 1;
+  }
+
+  // Delta saves must follow a full save again
+  SaveManager::instance().resetJournal();
+  lua_pushboolean(L, snapshot->restore());
+  return 1;
+}
+
+int Script::_globalRewind(lua_State *L) {
+  Script& script = Script::instance();
+
+  // Steps back through the snapshots, dropping the ones taken after
+  int steps = luaL_optint(L, 1, 1);
+  if (steps < 1 || static_cast<size_t>(steps) > script._snapshots.size()) {
+    lua_pushboolean(L, false);
+    return 1;
+  }
+
+  while (--steps > 0) {
+    delete script._snapshots.back();
+    script._snapshots.pop_back();
+  }
+
+  SaveManager::instance().resetJournal();
+  lua_pushboolean(L, script._snapshots.back()->restore());
   return 1;
 }
   
@@ -836,6 +1207,104 @@ int Script::_globalZoomOut(lua_State *L) {
   return 0;
 }
   
+bool Script::_isPersistence(lua_State *L, int index) {
+  if (!lua_getmetatable(L, index))
+    return false;
+  
+  luaL_getmetatable(L, kScriptPersistence);
+  bool isPersistence = lua_rawequal(L, -1, -2);
+  lua_pop(L, 2);
+  
+  return isPersistence;
+}
+
+void Script::_markPersistenceChange(lua_State *L, int index, int key) {
+  if (_pushPersistenceField(L, index, "changes")) {
+    lua_pushvalue(L, key);
+    lua_pushboolean(L, true);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+  }
+}
+
+int Script::_persistenceIndex(lua_State *L) {
+  _pushPersistenceField(L, 1, "data");
+  lua_pushvalue(L, 2);
+  lua_rawget(L, -2);
+  
+  return 1;
+}
+
+// The proxy itself is always empty, so every assignment ends up here
+int Script::_persistenceNewIndex(lua_State *L) {
+  _markPersistenceChange(L, 1, 2);
+  
+  _pushPersistenceField(L, 1, "data");
+  lua_pushvalue(L, 2);
+  lua_pushvalue(L, 3);
+  lua_rawset(L, -3);
+  
+  return 0;
+}
+
+bool Script::_pushPersistenceField(lua_State *L, int index, const char *field) {
+  if (!_isPersistence(L, index))
+    return false;
+  
+  lua_getmetatable(L, index);
+  lua_getfield(L, -1, field);
+  lua_remove(L, -2);
+  
+  return true;
+}
+
+// Takes the place of the Lua loader in package.loaders, finding modules
+// along package.path the same way but loading them with _loadFile()
+int Script::_searchModule(lua_State *L) {
+  std::string name = luaL_checkstring(L, 1);
+  std::replace(name.begin(), name.end(), '.', '/');
+  
+  lua_getglobal(L, "package");
+  lua_getfield(L, -1, "path");
+  const std::string templates = lua_isstring(L, -1) ? lua_tostring(L, -1) : "";
+  lua_pop(L, 2);
+  
+  std::string notFound;
+  size_t start = 0;
+  while (start < templates.length()) {
+    size_t end = templates.find(';', start);
+    if (end == std::string::npos)
+      end = templates.length();
+    
+    std::string path = templates.substr(start, end - start);
+    start = end + 1;
+    if (path.empty())
+      continue;
+    
+    size_t mark;
+    while ((mark = path.find('?')) != std::string::npos)
+      path.replace(mark, 1, name);
+    
+    SDL_RWops *rw = SDL_RWFromFile(path.c_str(), "rb");
+    if (!rw)
+      rw = SDL_RWFromFile((path + kScriptCompiledSuffix).c_str(), "rb");
+    if (!rw) {
+      notFound += "\n\tno file '" + path + "'";
+      continue;
+    }
+    SDL_RWclose(rw);
+    
+    if (_loadFile(L, path) != 0) {
+      return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s",
+                        lua_tostring(L, 1), path.c_str(), lua_tostring(L, -1));
+    }
+    return 1;
+  }
+  
+  lua_pushstring(L, notFound.c_str());
+  return 1;
+}
+
 void Script::_registerEnums() {
   // Push all enum values
   DGLuaEnum(_L, AUDIO, kObjectAudio);
@@ -951,6 +1420,10 @@ void Script::_registerGlobals() {
     {"persist", _globalPersist},
     {"unpersist", _globalUnpersist},
     {"getSaves", _globalGetSaves},
+    {"deleteSave", _globalDeleteSave},
+    {"snapshot", _globalSnapshot},
+    {"restore", _globalRestore},
+    {"rewind", _globalRewind},
     {"walkTo", _globalWalkTo},
     {"whichRoom", _globalWhichRoom},
     {"zoomOut", _globalZoomOut},
@@ -960,6 +1433,15 @@ void Script::_registerGlobals() {
   lua_getglobal(_L, "_G");
   luaL_register(_L, NULL, globalLibs);
   lua_pop(_L, 1);
+  
+  // These wrap the ones in Lua so that dgPersistence can be iterated
+  lua_getglobal(_L, "pairs");
+  lua_pushcclosure(_L, _globalIterate, 1);
+  lua_setglobal(_L, "pairs");
+  
+  lua_getglobal(_L, "ipairs");
+  lua_pushcclosure(_L, _globalIterate, 1);
+  lua_setglobal(_L, "ipairs");
 }
   
 }
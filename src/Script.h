@@ -24,6 +24,9 @@
 
 #include "lua.hpp"
 
+#include <deque>
+#include <string>
+
 namespace dagon {
 
 ////////////////////////////////////////////////////////////
@@ -44,8 +47,25 @@ enum DGAttachTypes {
 lua_pushnumber(L, val); \
 lua_setfield(L, -2, #name);
 
+// Metatable of dgPersistence, which holds the data and changed keys
+#define kScriptPersistence "Persistence"
+
+// Compiled scripts are kept next to their source, named after it with
+// this appended. They begin with this, then the hash of the source.
+#define kScriptCompiledSuffix "c"
+const char LUCIdent[] = { '\x44', '\x41', '\x47', '\x4F', '\x4E', '\x4C', '\x55', '\x43' };
+
+// While collecting per frame, Lua's own collector waits for the heap to
+// grow this many times the pause. With a memory limit, it starts by this
+// percentage of the limit at the latest.
+#define kScriptCollectBackstop 2
+#define kScriptCollectHeadroom 90
+
 class Config;
 class Log;
+class ScriptAllocator;
+class ScriptProfiler;
+class Snapshot;
 
 ////////////////////////////////////////////////////////////
 // Interface - Singleton class
@@ -54,22 +74,34 @@ class Log;
 class Script {
   Config& config;
   Log& log;
+  ScriptAllocator& scriptAllocator;
+  ScriptProfiler& scriptProfiler;
   
   std::vector<std::string> _arrayOfModuleNames;
+  int _collectThreshold; // Heap in KB from which to collect again
+  int _gcPause; // As last set in Lua
+  int _gcStepMultiplier;
   bool _isInitialized;
   bool _isSuspended;
   lua_State* _L;
   lua_State* _thread;
   
+  // Taken by snapshot(), oldest first
+  std::deque<Snapshot*> _snapshots;
+  int _numOfSnapshots;
+  
   int _ref;
   void _error(int result);
+  static int _loadFile(lua_State *L, const std::string &path);
   void _loadRoomFile(lua_State *L, const char *module);
+  static int _panic(lua_State *L);
   static int _globalCopy(lua_State *L);
   static int _globalCurrentNode(lua_State *L);
   static int _globalCurrentRoom(lua_State *L);
   static int _globalCutscene(lua_State *L);
   static int _globalFeed(lua_State *L);
   static int _globalHotkey(lua_State *L);
+  static int _globalIterate(lua_State *L);
   static int _globalLookAt(lua_State *L);
   static int _globalPlay(lua_State *L);
   static int _globalPrint(lua_State *L);
@@ -87,9 +119,20 @@ class Script {
   static int _globalPersist(lua_State *L);
   static int _globalUnpersist(lua_State *L);
   static int _globalGetSaves(lua_State *L);
+  static int _globalDeleteSave(lua_State *L);
+  static int _globalSnapshot(lua_State *L);
+  static int _globalRestore(lua_State *L);
+  static int _globalRewind(lua_State *L);
   static int _globalWalkTo(lua_State *L);
   static int _globalWhichRoom(lua_State *L);
   static int _globalZoomOut(lua_State *L);
+  
+  static bool _isPersistence(lua_State *L, int index);
+  static void _markPersistenceChange(lua_State *L, int index, int key);
+  static int _persistenceIndex(lua_State *L);
+  static int _persistenceNewIndex(lua_State *L);
+  static bool _pushPersistenceField(lua_State *L, int index, const char *field);
+  static int _searchModule(lua_State *L);
   void _registerEnums();
   void _registerGlobals();
   
@@ -104,11 +147,28 @@ public:
     return script;
   }
   
+  // Writes the compiled script next to the source, for _loadFile() to
+  // prefer while the source stays the same
+  static bool compile(const std::string &path, std::string *error);
+  // Steps the collector for about this many milliseconds, once at least
+  void collect(double budget);
   void init();
   const char* module();
+  
+  // dgPersistence stays empty and forwards to another table, so that saves
+  // can tell which keys were assigned. Tables are compared with how they
+  // were last saved instead. Changes are unknown if the game replaces it.
+  // NOTE: Since it's empty, #, next, rawget, rawset and table functions
+  // see nothing in dgPersistence itself, unlike before. Only indexing it,
+  // pairs and ipairs reach the data. Nested tables aren't affected.
+  static void clearPersistenceChanges(lua_State *L);
+  static void pushPersistence(lua_State *L);
+  static bool pushPersistenceChanges(lua_State *L);
   bool isExecutingModule();
   void processCallback(int handler, int object);
   void processCommand(const char* command);
+  // Frees a reference taken for a callback, once nothing will run it again
+  void releaseCallback(int handler);
   void resume();
   void run();
   void setModule(const char* theModule);
@@ -0,0 +1,194 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <SDL2/SDL_timer.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include "Config.h"
+#include "ScriptAllocator.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Pool serving the size, or -1 if too large for any
+static inline int _poolOf(size_t size) {
+  if (size > kScriptPoolMaxSize)
+    return -1;
+  
+  return static_cast<int>((size - 1) / kScriptPoolGranularity);
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Constructor
+////////////////////////////////////////////////////////////
+
+ScriptAllocator::ScriptAllocator() :
+config(Config::instance())
+{
+  for (int i = 0; i < kScriptNumOfPools; i++)
+    _freeBlocks[i] = NULL;
+  
+  _liveBytes = 0;
+  _peakBytes = 0;
+  _pooledBytes = 0;
+  _numOfAllocations = 0;
+  _rate = 0.0;
+  _rateCount = 0;
+  _rateTime = 0;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Destructor
+////////////////////////////////////////////////////////////
+
+ScriptAllocator::~ScriptAllocator() {
+  // Lua is closed by then
+  for (void* chunk : _chunks)
+    free(chunk);
+}
+
+////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////
+
+void* ScriptAllocator::allocate(void* ud, void* ptr, size_t osize, size_t nsize) {
+  ScriptAllocator* allocator = static_cast<ScriptAllocator*>(ud);
+  if (nsize == 0) {
+    if (ptr)
+      allocator->_free(ptr, osize);
+    return NULL;
+  }
+  
+  // Shrinking must never fail, so only growing is limited
+  size_t oldSize = ptr ? osize : 0;
+  int limit = allocator->config.scriptMemoryLimit;
+  if ((nsize > oldSize) && (limit > 0) &&
+      (allocator->_liveBytes + (nsize - oldSize) > static_cast<size_t>(limit)))
+    return NULL;
+  
+  if (!ptr)
+    return allocator->_allocate(nsize);
+  
+  int oldPool = _poolOf(osize);
+  int newPool = _poolOf(nsize);
+  if ((oldPool == newPool) && (oldPool != -1)) {
+    // Still fits the same block
+    allocator->_liveBytes = allocator->_liveBytes - osize + nsize;
+  }
+  else if ((oldPool == -1) && (newPool == -1)) {
+    void* block = realloc(ptr, nsize);
+    if (!block)
+      return NULL;
+    
+    allocator->_liveBytes = allocator->_liveBytes - osize + nsize;
+    ptr = block;
+  }
+  else {
+    void* block = allocator->_allocate(nsize);
+    if (!block)
+      return NULL;
+    
+    memcpy(block, ptr, osize < nsize ? osize : nsize);
+    allocator->_free(ptr, osize);
+    ptr = block;
+  }
+  
+  if (allocator->_liveBytes > allocator->_peakBytes)
+    allocator->_peakBytes = allocator->_liveBytes;
+  return ptr;
+}
+
+double ScriptAllocator::allocationRate() {
+  Uint32 now = SDL_GetTicks();
+  if (now - _rateTime >= 1000) {
+    _rate = (_numOfAllocations - _rateCount) * 1000.0 / (now - _rateTime);
+    _rateCount = _numOfAllocations;
+    _rateTime = now;
+  }
+  
+  return _rate;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+void* ScriptAllocator::_allocate(size_t size) {
+  void* block;
+  int pool = _poolOf(size);
+  if (pool == -1) {
+    block = malloc(size);
+  }
+  else {
+    if (!_freeBlocks[pool] && !_grow(pool))
+      return NULL;
+    
+    block = _freeBlocks[pool];
+    _freeBlocks[pool] = _freeBlocks[pool]->next;
+  }
+  
+  if (block) {
+    _liveBytes += size;
+    if (_liveBytes > _peakBytes)
+      _peakBytes = _liveBytes;
+    _numOfAllocations++;
+  }
+  
+  return block;
+}
+
+void ScriptAllocator::_free(void* ptr, size_t size) {
+  int pool = _poolOf(size);
+  if (pool == -1) {
+    free(ptr);
+  }
+  else {
+    ScriptBlock* block = static_cast<ScriptBlock*>(ptr);
+    block->next = _freeBlocks[pool];
+    _freeBlocks[pool] = block;
+  }
+  
+  _liveBytes -= size;
+}
+
+// Blocks of the same size come from the same chunks, so that small
+// tables and strings don't fragment the heap
+bool ScriptAllocator::_grow(int pool) {
+  char* chunk = static_cast<char*>(malloc(kScriptPoolChunkSize));
+  if (!chunk)
+    return false;
+  
+  _chunks.push_back(chunk);
+  _pooledBytes += kScriptPoolChunkSize;
+  
+  size_t blockSize = (pool + 1) * kScriptPoolGranularity;
+  size_t numOfBlocks = kScriptPoolChunkSize / blockSize;
+  for (size_t i = 0; i < numOfBlocks; i++) {
+    ScriptBlock* block = reinterpret_cast<ScriptBlock*>(chunk + (i * blockSize));
+    block->next = _freeBlocks[pool];
+    _freeBlocks[pool] = block;
+  }
+  
+  return true;
+}
+
+}
@@ -0,0 +1,100 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef DAGON_SCRIPTALLOCATOR_H_
+#define DAGON_SCRIPTALLOCATOR_H_
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <SDL2/SDL_stdinc.h>
+
+#include <vector>
+
+#include "lua.hpp"
+
+#include "Platform.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Blocks up to the largest size are served from pools, one for each
+// multiple of the granularity. Larger ones come from the system.
+#define kScriptPoolGranularity 8
+#define kScriptPoolMaxSize 256
+#define kScriptNumOfPools (kScriptPoolMaxSize / kScriptPoolGranularity)
+
+// Pools grow by this many bytes at a time, and never shrink
+#define kScriptPoolChunkSize 16384
+
+class Config;
+
+// Free blocks are linked through their first bytes
+typedef struct ScriptBlock {
+  struct ScriptBlock* next;
+} ScriptBlock;
+
+////////////////////////////////////////////////////////////
+// Interface - Singleton class
+////////////////////////////////////////////////////////////
+
+// Allocates for Lua, which only runs on the main thread, so there's no
+// locking. Sizes are those Lua gives, so blocks carry no header.
+class ScriptAllocator {
+  Config& config;
+  
+  ScriptBlock* _freeBlocks[kScriptNumOfPools];
+  std::vector<void*> _chunks;
+  size_t _liveBytes;
+  size_t _peakBytes;
+  size_t _pooledBytes;
+  Uint64 _numOfAllocations;
+  
+  // Allocations per second, measured over a second at least
+  double _rate;
+  Uint64 _rateCount;
+  Uint32 _rateTime;
+  
+  void* _allocate(size_t size);
+  void _free(void* ptr, size_t size);
+  bool _grow(int pool);
+  
+  ScriptAllocator();
+  ScriptAllocator(ScriptAllocator const&);
+  ScriptAllocator& operator=(ScriptAllocator const&);
+  ~ScriptAllocator();
+  
+public:
+  static ScriptAllocator& instance() {
+    static ScriptAllocator scriptAllocator;
+    return scriptAllocator;
+  }
+  
+  // The lua_Alloc, with the allocator as user data. Growing fails past the
+  // memory limit in the configuration, if any.
+  static void* allocate(void* ud, void* ptr, size_t osize, size_t nsize);
+  
+  double allocationRate();
+  size_t liveBytes() { return _liveBytes; }
+  Uint64 numOfAllocations() { return _numOfAllocations; }
+  size_t peakBytes() { return _peakBytes; }
+  size_t pooledBytes() { return _pooledBytes; } // Including free blocks
+};
+
+}
+
+#endif // DAGON_SCRIPTALLOCATOR_H_
@@ -0,0 +1,283 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <SDL2/SDL_timer.h>
+
+#include <algorithm>
+#include <cstdio>
+
+#include "Log.h"
+#include "ScriptProfiler.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+static bool _isSlower(const ScriptProfile* a, const ScriptProfile* b) {
+  return a->time > b->time;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Constructor
+////////////////////////////////////////////////////////////
+
+ScriptProfiler::ScriptProfiler() :
+log(Log::instance())
+{
+  _L = NULL;
+  _thread = NULL;
+  _allocator = NULL;
+  _allocatorData = NULL;
+  _numOfAllocations = 0;
+  _allocated = 0;
+  _isEnabled = false;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Destructor
+////////////////////////////////////////////////////////////
+
+ScriptProfiler::~ScriptProfiler() {
+  // The Lua state is closed by then
+}
+
+////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////
+
+void ScriptProfiler::beginCallback(lua_State* L, int handler) {
+  ScriptProfile* profile = &_callbacks[handler];
+  if (profile->name.empty()) {
+    lua_Debug ar;
+    lua_pushvalue(L, -1);
+    lua_getinfo(L, ">S", &ar);
+    
+    char name[kMaxLogLength];
+    snprintf(name, kMaxLogLength, "Callback %d (%s:%d)", handler, ar.short_src,
+             ar.linedefined);
+    profile->name = name;
+  }
+  
+  _begin(&_callbackFrames, profile, L);
+}
+
+void ScriptProfiler::endCallback() {
+  // Gone if disabled meanwhile
+  if (_callbackFrames.empty())
+    return;
+  
+  // Functions interrupted by errors never returned
+  const ScriptFrame& callback = _callbackFrames.back();
+  std::unordered_map<lua_State*, std::vector<ScriptFrame>>::iterator it =
+    _frames.find(callback.state);
+  if (it != _frames.end()) {
+    _end(&it->second, callback.depth);
+    if (it->second.empty())
+      _frames.erase(it);
+  }
+  _end(&_callbackFrames, _callbackFrames.size() - 1);
+}
+
+void ScriptProfiler::init(lua_State* L, lua_State* thread) {
+  _L = L;
+  _thread = thread;
+}
+
+void ScriptProfiler::print(int count) {
+  const char* titles[] = { "Callbacks", "Functions" };
+  for (int i = 0; i < 2; i++) {
+    std::vector<ScriptProfile*> profiles = _sorted(i == 0);
+    log.info(kModScript, "%s:", titles[i]);
+    
+    for (int j = 0; (j < count) && (j < static_cast<int>(profiles.size())); j++) {
+      ScriptProfile* profile = profiles[j];
+      log.info(kModScript, "%s: %d calls, %.2f ms, %d allocations, %lu bytes",
+               profile->name.c_str(), profile->numOfCalls, profile->time,
+               profile->numOfAllocations, static_cast<unsigned long>(profile->allocated));
+    }
+  }
+}
+
+void ScriptProfiler::push(lua_State* L, int count) {
+  std::vector<ScriptProfile*> profiles = _sorted(true);
+  lua_newtable(L);
+  _pushProfiles(L, profiles, count);
+  lua_setfield(L, -2, "callbacks");
+  
+  profiles = _sorted(false);
+  _pushProfiles(L, profiles, count);
+  lua_setfield(L, -2, "functions");
+}
+
+void ScriptProfiler::reset() {
+  _callbacks.clear();
+  _functions.clear();
+  _callbackFrames.clear();
+  _frames.clear();
+  _numOfAllocations = 0;
+  _allocated = 0;
+}
+
+void ScriptProfiler::setEnabled(bool enabled) {
+  if (!_L || (enabled == _isEnabled))
+    return;
+  
+  if (enabled) {
+    reset();
+    _allocator = lua_getallocf(_L, &_allocatorData);
+    lua_setallocf(_L, _allocate, this);
+    
+    // Coroutines created from now on inherit the hook
+    lua_sethook(_L, _hook, LUA_MASKCALL | LUA_MASKRET, 0);
+    lua_sethook(_thread, _hook, LUA_MASKCALL | LUA_MASKRET, 0);
+  }
+  else {
+    lua_setallocf(_L, _allocator, _allocatorData);
+    lua_sethook(_L, NULL, 0, 0);
+    lua_sethook(_thread, NULL, 0, 0);
+    _callbackFrames.clear();
+    _frames.clear();
+  }
+  
+  _isEnabled = enabled;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+void* ScriptProfiler::_allocate(void* ud, void* ptr, size_t osize, size_t nsize) {
+  ScriptProfiler* scriptProfiler = static_cast<ScriptProfiler*>(ud);
+  if (nsize > osize) {
+    scriptProfiler->_allocated += nsize - osize;
+    if (!ptr)
+      scriptProfiler->_numOfAllocations++;
+  }
+  
+  return scriptProfiler->_allocator(scriptProfiler->_allocatorData, ptr, osize, nsize);
+}
+
+void ScriptProfiler::_begin(std::vector<ScriptFrame>* frames, ScriptProfile* profile,
+                            lua_State* L) {
+  ScriptFrame frame;
+  frame.profile = profile;
+  frame.begin = SDL_GetPerformanceCounter();
+  frame.numOfAllocations = _numOfAllocations;
+  frame.allocated = _allocated;
+  frame.state = L;
+  frame.depth = _frames[L].size();
+  frames->push_back(frame);
+}
+
+void ScriptProfiler::_end(std::vector<ScriptFrame>* frames, size_t depth) {
+  Uint64 now = SDL_GetPerformanceCounter();
+  double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+  while (frames->size() > depth) {
+    const ScriptFrame& frame = frames->back();
+    ScriptProfile* profile = frame.profile;
+    profile->numOfCalls++;
+    profile->time += (now - frame.begin) * 1000.0 / frequency;
+    profile->numOfAllocations += _numOfAllocations - frame.numOfAllocations;
+    profile->allocated += _allocated - frame.allocated;
+    frames->pop_back();
+  }
+}
+
+void ScriptProfiler::_hook(lua_State* L, lua_Debug* ar) {
+  // Coroutines created while enabled keep the hook
+  ScriptProfiler& scriptProfiler = ScriptProfiler::instance();
+  if (!scriptProfiler._isEnabled)
+    return;
+  
+  if (ar->event != LUA_HOOKCALL) {
+    // Returns, including those of tail calls. A coroutine's functions stay
+    // open while it's suspended, so their time includes the wait.
+    std::unordered_map<lua_State*, std::vector<ScriptFrame>>::iterator it =
+      scriptProfiler._frames.find(L);
+    if (it != scriptProfiler._frames.end()) {
+      scriptProfiler._end(&it->second, it->second.size() - 1);
+      
+      // Finished coroutines leave nothing behind
+      if (it->second.empty())
+        scriptProfiler._frames.erase(it);
+    }
+    return;
+  }
+  
+  // Lua functions are told apart by where they're defined, and C ones by
+  // the name they were called with
+  lua_getinfo(L, "Sn", ar);
+  char key[kMaxLogLength];
+  if (ar->linedefined >= 0)
+    snprintf(key, kMaxLogLength, "%s:%d", ar->short_src, ar->linedefined);
+  else
+    snprintf(key, kMaxLogLength, "[C] %s", ar->name ? ar->name : "?");
+  
+  ScriptProfile* profile = &scriptProfiler._functions[key];
+  if (profile->name.empty()) {
+    if (ar->name && (ar->linedefined >= 0))
+      profile->name = std::string(ar->name) + " (" + key + ")";
+    else
+      profile->name = key;
+  }
+  
+  scriptProfiler._begin(&scriptProfiler._frames[L], profile, L);
+}
+
+void ScriptProfiler::_pushProfiles(lua_State* L, std::vector<ScriptProfile*>& profiles,
+                                   int count) {
+  // All of them, unless told how many
+  int numOfProfiles = static_cast<int>(profiles.size());
+  if ((count > 0) && (count < numOfProfiles))
+    numOfProfiles = count;
+  
+  lua_newtable(L);
+  for (int i = 0; i < numOfProfiles; i++) {
+    ScriptProfile* profile = profiles[i];
+    lua_newtable(L);
+    lua_pushstring(L, profile->name.c_str());
+    lua_setfield(L, -2, "name");
+    lua_pushnumber(L, profile->numOfCalls);
+    lua_setfield(L, -2, "calls");
+    lua_pushnumber(L, profile->time);
+    lua_setfield(L, -2, "time");
+    lua_pushnumber(L, profile->numOfAllocations);
+    lua_setfield(L, -2, "allocations");
+    lua_pushnumber(L, static_cast<lua_Number>(profile->allocated));
+    lua_setfield(L, -2, "bytes");
+    lua_rawseti(L, -2, i + 1);
+  }
+}
+
+std::vector<ScriptProfile*> ScriptProfiler::_sorted(bool ofCallbacks) {
+  std::vector<ScriptProfile*> profiles;
+  if (ofCallbacks) {
+    for (auto& callback : _callbacks)
+      profiles.push_back(&callback.second);
+  }
+  else {
+    for (auto& function : _functions)
+      profiles.push_back(&function.second);
+  }
+  
+  std::sort(profiles.begin(), profiles.end(), _isSlower);
+  return profiles;
+}
+
+}
@@ -0,0 +1,117 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef DAGON_SCRIPTPROFILER_H_
+#define DAGON_SCRIPTPROFILER_H_
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <SDL2/SDL_stdinc.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "lua.hpp"
+
+#include "Platform.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Entries listed by printScriptProfile() unless told otherwise
+#define kScriptProfilerReportSize 10
+
+class Log;
+
+// Measured for a callback or a function. Time and allocations include
+// everything it called.
+typedef struct {
+  std::string name;
+  int numOfCalls;
+  double time; // Milliseconds
+  int numOfAllocations;
+  size_t allocated; // Bytes
+} ScriptProfile;
+
+typedef struct {
+  ScriptProfile* profile;
+  Uint64 begin;
+  int numOfAllocations; // Counted so far when it began
+  size_t allocated;
+  lua_State* state; // Where the functions it calls run, for callbacks
+  size_t depth; // Functions called there when it began
+} ScriptFrame;
+
+////////////////////////////////////////////////////////////
+// Interface - Singleton class
+////////////////////////////////////////////////////////////
+
+class ScriptProfiler {
+  Log& log;
+  
+  lua_State* _L;
+  lua_State* _thread;
+  lua_Alloc _allocator; // Wrapped while enabled to count allocations
+  void* _allocatorData;
+  
+  std::unordered_map<int, ScriptProfile> _callbacks; // By reference
+  std::unordered_map<std::string, ScriptProfile> _functions; // By source and line
+  std::vector<ScriptFrame> _callbackFrames;
+  // Coroutines call and return apart from each other, so each has its own
+  std::unordered_map<lua_State*, std::vector<ScriptFrame>> _frames;
+  int _numOfAllocations;
+  size_t _allocated;
+  bool _isEnabled;
+  
+  static void* _allocate(void* ud, void* ptr, size_t osize, size_t nsize);
+  void _begin(std::vector<ScriptFrame>* frames, ScriptProfile* profile, lua_State* L);
+  void _end(std::vector<ScriptFrame>* frames, size_t depth);
+  static void _hook(lua_State* L, lua_Debug* ar);
+  static void _pushProfiles(lua_State* L, std::vector<ScriptProfile*>& profiles, int count);
+  std::vector<ScriptProfile*> _sorted(bool ofCallbacks);
+  
+  ScriptProfiler();
+  ScriptProfiler(ScriptProfiler const&);
+  ScriptProfiler& operator=(ScriptProfiler const&);
+  ~ScriptProfiler();
+
+public:
+  static ScriptProfiler& instance() {
+    static ScriptProfiler scriptProfiler;
+    return scriptProfiler;
+  }
+  
+  // Callbacks are measured by the caller, with the function on top of
+  // the stack when beginning
+  void beginCallback(lua_State* L, int handler);
+  void endCallback();
+  
+  void init(lua_State* L, lua_State* thread);
+  bool isEnabled() { return _isEnabled; }
+  void print(int count);
+  // Pushes a table of callbacks and functions, slowest first
+  void push(lua_State* L, int count);
+  void reset();
+  // Hooks every call and return while enabled, which slows Lua down
+  void setEnabled(bool enabled);
+};
+
+}
+
+#endif // DAGON_SCRIPTPROFILER_H_
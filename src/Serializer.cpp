@@ -21,6 +21,8 @@
 #include "Control.h"
 #include "Node.h"
 #include "Room.h"
+#include "SaveManager.h"
+#include "Script.h"
 #include "Spot.h"
 #include "TimerManager.h"
 #include "Version.h"
@@ -30,327 +32,535 @@
 
 namespace dagon {
 
-const char SAVIdent[] = { '\x44', '\x41', '\x47', '\x4F', '\x4E', '\x53', '\x41', '\x56', '\x45' };
-
 ////////////////////////////////////////////////////////////
 // Implementation - Constructor & Destructor
 ////////////////////////////////////////////////////////////
 
-Serializer::Serializer(lua_State *L, SDL_RWops *rw) : _L(L), _rw(rw) {}
+Serializer::Serializer(lua_State *L) : _L(L), _headerSize(0) {}
 
-Serializer::~Serializer() {
-  SDL_RWclose(_rw);
-}
+Serializer::~Serializer() {}
 
 ////////////////////////////////////////////////////////////
 // Implementation - Private
 ////////////////////////////////////////////////////////////
 
-bool Serializer::writeField(const std::string &key, const std::string &val) {
-  return SDL_WriteBE16(_rw, key.length() + val.length() + 1) && // +1 because of =
-         SDL_RWwrite(_rw, key.c_str(), key.length(), 1) &&
-         SDL_WriteU8(_rw, '=') &&
-         SDL_RWwrite(_rw, val.c_str(), val.length(), 1);
-}
+bool Serializer::writeChangedKeys() {
+  if (!Script::pushPersistenceChanges(_L))
+    return false;
 
-int32_t Serializer::writeTable(const std::string parentKey) {
-  // Handle cycles
-  for (const auto &table : _tblMap) {
-    lua_rawgeti(_L, LUA_REGISTRYINDEX, table.first);
+  Script::pushPersistence(_L);
+  int changes = lua_gettop(_L) - 1;
+  int data = lua_gettop(_L);
 
-    if (lua_equal(_L, -1, -2)) { // Maybe a cycle...
-      lua_pop(_L, 1);
-      if (!writeField(parentKey, table.second))
-        return -1;
-      return 1;
+  lua_pushnil(_L);
+  while (lua_next(_L, changes) != 0) {
+    lua_pop(_L, 1);
+    if (!_writeKey(data, nullptr)) {
+      lua_pop(_L, 3);
+      return false;
     }
-    else
-      lua_pop(_L, 1);
-  }
-
-  { // Store this table
-    lua_pushvalue(_L, -1);
-    int ref = luaL_ref(_L, LUA_REGISTRYINDEX);
-    _tblMap[ref] = parentKey;
   }
 
+  // Then the tables of the other keys, which are skipped if unchanged
+  const SavedTables &savedTables = SaveManager::instance().savedTables();
   lua_pushnil(_L);
-  int32_t numFields = 0;
-  while (lua_next(_L, -2) != 0) {
-    if (!lua_isstring(_L, -2)) {
+  while (lua_next(_L, data) != 0) {
+    bool isTable = lua_istable(_L, -1);
+    lua_pop(_L, 1);
+    if (isTable) {
+      lua_pushvalue(_L, -1);
+      lua_rawget(_L, changes);
+      bool isChanged = !lua_isnil(_L, -1);
       lua_pop(_L, 1);
-      continue;
+      if (!isChanged && !_writeKey(data, &savedTables)) {
+        lua_pop(_L, 3);
+        return false;
+      }
     }
+  }
 
-    std::string val;
-    std::string fullKey = parentKey + '[';
-    if (lua_type(_L, -2) == LUA_TSTRING)
-      fullKey += '"';
-    lua_pushvalue(_L, -2);
-    fullKey += lua_tostring(_L, -1);
-    lua_pop(_L, 1);
-    if (lua_type(_L, -2) == LUA_TSTRING)
-      fullKey += '"';
-    fullKey += ']';
+  lua_pop(_L, 2);
+  return true;
+}
 
-    switch (lua_type(_L, -1)) {
-    case LUA_TTABLE: {
-      int32_t numNewFields = writeTable(fullKey);
-      if (numNewFields < 0)
-        return -1;
-      numFields += numNewFields;
+bool Serializer::writeChangedSpots(const SpotLocations &locations) {
+  for (Object *object : Object::arrayOfChangedObjects()) {
+    if (!object->isType(kObjectSpot))
+      continue;
 
-      lua_pop(_L, 1);
+    SpotLocations::const_iterator it = locations.find(object);
+    if (it == locations.end())
+      return false;
+
+    _writeBE16(it->second.room);
+    _writeBE16(it->second.node);
+    _writeBE16(it->second.spot);
+    _writeU8(object->isEnabled());
+  }
+
+  return true;
+}
+
+bool Serializer::writeRoomState() {
+  Room *room = Control::instance().currentRoom();
+
+  // Write node number
+  uint16_t nodeIdx = 0;
+  if (room->hasNodes()) {
+    room->beginIteratingNodes();
+    do {
+      if (room->iterator() == room->currentNode())
+        break;
+
+      nodeIdx++;
+    } while (room->iterateNodes());
+  }
+
+  _writeBE16(nodeIdx);
+
+  // Write camera angles
+  _writeBE32(static_cast<uint32_t>(CameraManager::instance().angleHorizontal()));
+  _writeBE32(static_cast<uint32_t>(CameraManager::instance().angleVertical()));
+  _writeDouble(CameraManager::instance().fieldOfView());
+
+  // Write audio states
+  _writeBE16(room->arrayOfAudios().size());
+
+  for (Audio *audio : room->arrayOfAudios()) {
+    _writeU8(audio->state());
+  }
+
+  // Write timers
+  size_t timersPtr = _buffer.size();
+  _writeBE16(0); // 2 placeholder bytes for the actual number of timers
+
+  uint16_t numTimers = 0;
+  for (const auto &timer : TimerManager::instance().timers()) {
+    if (timer.type != DGTimerNormal || !timer.isEnabled ||
+        (!timer.isLoopable && timer.hasTriggered))
       continue;
-    }
-    case LUA_TBOOLEAN: {
-      val = lua_toboolean(_L, -1) ? "true" : "false";
-      break;
-    }
-    case LUA_TSTRING:
-      val += '"';
-      // Fallthrough
-    case LUA_TNUMBER: {
-      val += lua_tostring(_L, -1);
-      if (val[0] == '"')
-        val += '"';
-      break;
-    }
-    default: {
+
+    double elapsed = TimerManager::instance().timeElapsed(timer);
+    if (timer.trigger - elapsed > 0) {
+      _writeU8(timer.isLoopable);
+      _writeDouble(timer.trigger);
+      _writeDouble(elapsed);
+
+      lua_rawgeti(_L, LUA_REGISTRYINDEX, timer.luaHandler); // Push timer function to top of stack
+
+      size_t funcSizePtr = _buffer.size();
+      _writeBE32(0); // 4 placeholder bytes for the actual function size
+
+      size_t beforeFuncPtr = _buffer.size();
+      int errCode = lua_dump(_L, writeFunction, this);
       lua_pop(_L, 1);
-      continue;
+      if (errCode != 0)
+        return false;
+
+      _patchBE32(funcSizePtr, static_cast<uint32_t>(_buffer.size() - beforeFuncPtr));
+      numTimers++;
     }
+  }
+
+  _patchBE16(timersPtr, numTimers);
+
+  // Write control mode
+  _writeU8(Config::instance().controlMode);
+
+  return true;
+}
+
+bool Serializer::writeTable(int seen, uint32_t *numTables) {
+  int table = lua_gettop(_L);
+
+  // Tables are found by identity, so shared and cyclic ones cost the same
+  lua_pushvalue(_L, table);
+  lua_rawget(_L, seen);
+  if (lua_isnumber(_L, -1)) {
+    uint32_t id = static_cast<uint32_t>(lua_tonumber(_L, -1));
+    lua_pop(_L, 1);
+    _writeU8(kSaveTagReference);
+    _writeBE32(id);
+    return true;
+  }
+  lua_pop(_L, 1);
+
+  lua_pushvalue(_L, table);
+  lua_pushnumber(_L, (*numTables)++);
+  lua_rawset(_L, seen);
+
+  if (!lua_checkstack(_L, 4))
+    return false;
+
+  _writeU8(kSaveTagTable);
+  lua_pushnil(_L);
+  while (lua_next(_L, table) != 0) {
+    int keyType = lua_type(_L, -2);
+    int valueType = lua_type(_L, -1);
+
+    // Same as text saves: only string and number keys, and no functions
+    // or userdata as values
+    if ((keyType == LUA_TSTRING || keyType == LUA_TNUMBER) &&
+        (valueType == LUA_TBOOLEAN || valueType == LUA_TNUMBER ||
+         valueType == LUA_TSTRING || valueType == LUA_TTABLE)) {
+      if (!writeValue(lua_gettop(_L) - 1, seen, numTables) ||
+          !writeValue(lua_gettop(_L), seen, numTables))
+        return false;
     }
 
-    if (!writeField(fullKey, val))
-      return -1;
+    lua_pop(_L, 1);
+  }
+  _writeU8(kSaveTagEnd);
+
+  return true;
+}
 
-    numFields++;
+bool Serializer::writeValue(int index, int seen, uint32_t *numTables) {
+  switch (lua_type(_L, index)) {
+  case LUA_TBOOLEAN: {
+    _writeU8(lua_toboolean(_L, index) ? kSaveTagTrue : kSaveTagFalse);
+    break;
+  }
+  case LUA_TNUMBER: {
+    _writeU8(kSaveTagNumber);
+    _writeDouble(lua_tonumber(_L, index));
+    break;
+  }
+  case LUA_TSTRING: {
+    size_t len;
+    const char *str = lua_tolstring(_L, index, &len);
+    _writeU8(kSaveTagString);
+    _writeBE32(static_cast<uint32_t>(len));
+    _write(str, len);
+    break;
+  }
+  case LUA_TTABLE: {
+    lua_pushvalue(_L, index);
+    bool result = writeTable(seen, numTables);
     lua_pop(_L, 1);
+    return result;
+  }
+  default:
+    return false;
   }
 
-  return numFields;
+  return true;
 }
 
 int Serializer::writeFunction(lua_State *L, const void *p, size_t sz, void *ud) {
-  SDL_RWops *rw = reinterpret_cast<SDL_RWops*>(ud);
-  if (!SDL_RWwrite(rw, p, sz, 1))
-    return 1;
+  Serializer *serializer = reinterpret_cast<Serializer*>(ud);
+  serializer->_write(p, sz);
   return 0;
 }
 
-////////////////////////////////////////////////////////////
-// Implementation - Public
-////////////////////////////////////////////////////////////
+void Serializer::_patchBE16(size_t offset, uint16_t value) {
+  _buffer[offset] = static_cast<uint8_t>(value >> 8);
+  _buffer[offset + 1] = static_cast<uint8_t>(value);
+}
 
-bool Serializer::writeHeader() {
-  // Write magic number
-  if (!SDL_RWwrite(_rw, SAVIdent, sizeof(SAVIdent), 1))
-    return false;
+void Serializer::_patchBE32(size_t offset, uint32_t value) {
+  _patchBE16(offset, static_cast<uint16_t>(value >> 16));
+  _patchBE16(offset + 2, static_cast<uint16_t>(value));
+}
 
-  // Write version information
-  {
-    const size_t len = UCHAR_MAX > strlen(DAGON_VERSION_STRING) ? strlen(DAGON_VERSION_STRING) :
-                                                                  UCHAR_MAX;
-    if (!SDL_WriteU8(_rw, len))
-      return false;
-    if (!SDL_RWwrite(_rw, DAGON_VERSION_STRING, len, 1))
-      return false;
-  }
+void Serializer::_write(const void *data, size_t size) {
+  const uint8_t *bytes = static_cast<const uint8_t*>(data);
+  _buffer.insert(_buffer.end(), bytes, bytes + size);
+}
 
-  // Write preview
-  {
-    const std::string desc = Control::instance().currentNode()->description();
-    const size_t len = UCHAR_MAX > desc.length() ? desc.length() : UCHAR_MAX;
+void Serializer::_writeBE16(uint16_t value) {
+  _buffer.push_back(static_cast<uint8_t>(value >> 8));
+  _buffer.push_back(static_cast<uint8_t>(value));
+}
 
-    if (!SDL_WriteU8(_rw, len))
-      return false;
-    if (len > 0 && !SDL_RWwrite(_rw, desc.c_str(), len, 1))
-      return false;
+void Serializer::_writeBE32(uint32_t value) {
+  _writeBE16(static_cast<uint16_t>(value >> 16));
+  _writeBE16(static_cast<uint16_t>(value));
+}
+
+void Serializer::_writeDouble(double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  _writeBE32(static_cast<uint32_t>(bits >> 32));
+  _writeBE32(static_cast<uint32_t>(bits));
+}
+
+// Writes the key on top of the stack, and its value in data. Tables are
+// skipped if written the same in the last save.
+bool Serializer::_writeKey(int data, const SavedTables *savedTables) {
+  int key = lua_gettop(_L);
+  int keyType = lua_type(_L, key);
+  if (keyType != LUA_TSTRING && keyType != LUA_TNUMBER)
+    return true;
+
+  lua_pushvalue(_L, key);
+  lua_rawget(_L, data);
+  int valueType = lua_type(_L, -1);
+
+  // Each key is written on its own, so tables shared with other keys
+  // are written again
+  lua_newtable(_L);
+  int seen = lua_gettop(_L);
+  uint32_t numTables = 0;
+  size_t keyPtr = _buffer.size();
+  bool result = writeValue(key, seen, &numTables);
+  size_t valuePtr = _buffer.size();
+  if (result) {
+    // Anything a full save would skip is removed instead
+    if (valueType == LUA_TBOOLEAN || valueType == LUA_TNUMBER ||
+        valueType == LUA_TSTRING || valueType == LUA_TTABLE)
+      result = writeValue(seen - 1, seen, &numTables);
+    else
+      _writeU8(kSaveTagNil);
   }
 
-  // Write current room name
-  const std::string name = Control::instance().currentRoom()->name();
-  if (!SDL_WriteU8(_rw, name.length()))
-    return false;
-  if (!SDL_RWwrite(_rw, name.c_str(), name.length(), 1))
+  lua_pop(_L, 2);
+  if (!result)
     return false;
 
+  std::string keyBytes(_buffer.begin() + keyPtr, _buffer.begin() + valuePtr);
+  std::string valueBytes;
+  if (valueType == LUA_TTABLE) {
+    valueBytes.assign(_buffer.begin() + valuePtr, _buffer.end());
+    if (savedTables) {
+      SavedTables::const_iterator it = savedTables->find(keyBytes);
+      if ((it != savedTables->end()) && (it->second == valueBytes)) {
+        _buffer.resize(keyPtr);
+        return true;
+      }
+    }
+  }
+
+  _savedTables[keyBytes].swap(valueBytes);
   return true;
 }
 
-bool Serializer::writeScriptData() {
-  int64_t fieldsPtr = SDL_RWtell(_rw);
-  if (fieldsPtr < 0)
-    return false;
-  if (!SDL_WriteBE32(_rw, 0)) // 4 placeholder bytes for the actual number of fields
-    return false;
+void Serializer::_writeLength(size_t length) {
+  // Lengths that don't fit in the token continue in bytes of up to 255
+  while (length >= 255) {
+    _writeU8(255);
+    length -= 255;
+  }
+  _writeU8(static_cast<uint8_t>(length));
+}
 
-  lua_getglobal(_L, "dgPersistence");
-  int32_t numFields = writeTable("dgPersistence");
-  if (numFields < 0)
-    return false;
+void Serializer::_writeSequence(const uint8_t *literals, size_t numLiterals,
+                                size_t offset, size_t matchLength) {
+  size_t extraLength = matchLength ? matchLength - kSaveMinMatch : 0;
+  _writeU8(static_cast<uint8_t>(((numLiterals < 15 ? numLiterals : 15) << 4) |
+                                (extraLength < 15 ? extraLength : 15)));
+  if (numLiterals >= 15)
+    _writeLength(numLiterals - 15);
+  _write(literals, numLiterals);
+
+  // The last sequence has no match
+  if (matchLength) {
+    _writeU8(static_cast<uint8_t>(offset));
+    _writeU8(static_cast<uint8_t>(offset >> 8));
+    if (extraLength >= 15)
+      _writeLength(extraLength - 15);
+  }
+}
 
-  if (SDL_RWseek(_rw, fieldsPtr, RW_SEEK_SET) < 0) // Restore file pointer to 4 placeholder bytes
-    return false;
-  if (!SDL_WriteBE32(_rw, numFields))
-    return false;
-  if (SDL_RWseek(_rw, 0, RW_SEEK_END) < 0) // Restore file pointer to end
-    return false;
+void Serializer::_writeString8(const std::string &str) {
+  const size_t len = UCHAR_MAX > str.length() ? str.length() : UCHAR_MAX;
+  _writeU8(static_cast<uint8_t>(len));
+  _write(str.c_str(), len);
+}
 
-  return true;
+void Serializer::_writeU8(uint8_t value) {
+  _buffer.push_back(value);
 }
 
-bool Serializer::writeRoomData() {
-  // Write the enable status for the spots of all nodes of all rooms
-  if (!SDL_WriteBE16(_rw, Control::instance().numRooms()))
-    return false;
+////////////////////////////////////////////////////////////
+// Implementation - Public
+////////////////////////////////////////////////////////////
 
-  for (Room *room : Control::instance().rooms()) {
-    if (!SDL_WriteBE16(_rw, room->numNodes()))
-      return false;
+bool Serializer::writeHeader() {
+  // Write magic number and format
+  _write(SAVIdent, sizeof(SAVIdent));
+  _writeU8(kSaveFormatCurrent);
 
-    if (room->hasNodes()) {
-      room->beginIteratingNodes();
+  // Write version information
+  _writeString8(DAGON_VERSION_STRING);
 
-      do {
-        Node *node = room->iterator();
+  // Write preview
+  _preview = Control::instance().currentNode()->description();
+  _writeString8(_preview);
 
-        if (!SDL_WriteBE16(_rw, node->numSpots()))
-          return false;
+  // Write current room name
+  _roomName = Control::instance().currentRoom()->name();
+  _writeString8(_roomName);
 
-        if (node->hasSpots()) {
-          node->beginIteratingSpots();
+  _headerSize = _buffer.size();
+  return true;
+}
 
-          do {
-            if (!SDL_WriteU8(_rw, node->currentSpot()->isEnabled()))
-              return false;
-          } while (node->iterateSpots());
-        }
-      } while (room->iterateNodes());
-    }
+bool Serializer::writeScriptData() {
+  Script::pushPersistence(_L);
+  if (!lua_istable(_L, -1)) {
+    lua_pop(_L, 1);
+    lua_newtable(_L);
   }
 
-  Room *room = Control::instance().currentRoom();
+  lua_newtable(_L); // Ids of the tables written so far
+  lua_insert(_L, -2);
 
-  // Write node number
-  uint16_t nodeIdx = 0;
-  if (room->hasNodes()) {
-    room->beginIteratingNodes();
-    do {
-      if (room->iterator() == room->currentNode())
-        break;
+  uint32_t numTables = 0;
+  bool result = writeTable(lua_gettop(_L) - 1, &numTables);
 
-      nodeIdx++;
-    } while (room->iterateNodes());
+  // Delta saves tell which tables changed by comparing them with how each
+  // is written on its own, which is kept but not part of this save
+  int data = lua_gettop(_L);
+  lua_pushnil(_L);
+  while (result && lua_next(_L, data) != 0) {
+    bool isTable = lua_istable(_L, -1);
+    lua_pop(_L, 1);
+    if (isTable) {
+      size_t size = _buffer.size();
+      result = _writeKey(data, nullptr);
+      _buffer.resize(size);
+    }
   }
+  lua_settop(_L, data - 2);
 
-  if (!SDL_WriteBE16(_rw, nodeIdx))
-    return false;
+  return result;
+}
 
-  // Write camera angles
-  int hAngle = CameraManager::instance().angleHorizontal();
-  const std::string hAngleStr = std::to_string(hAngle);
-  if (!SDL_WriteU8(_rw, hAngleStr.length()))
-    return false;
-  if (!SDL_RWwrite(_rw, hAngleStr.c_str(), hAngleStr.length(), 1))
-    return false;
+bool Serializer::writeRoomData(SpotLocations *locations) {
+  // Write the enable status for the spots of all nodes of all rooms
+  _writeBE16(Control::instance().numRooms());
 
-  int vAngle = CameraManager::instance().angleVertical();
-  const std::string vAngleStr = std::to_string(vAngle);
-  if (!SDL_WriteU8(_rw, vAngleStr.length()))
-    return false;
-  if (!SDL_RWwrite(_rw, vAngleStr.c_str(), vAngleStr.length(), 1))
-    return false;
+  SpotLocation location = { 0, 0, 0 };
+  for (Room *room : Control::instance().rooms()) {
+    _writeBE16(room->numNodes());
+
+    location.node = 0;
+    for (Node *node : room->arrayOfNodes()) {
+      _writeBE16(node->numSpots());
+
+      location.spot = 0;
+      for (Spot *spot : node->arrayOfSpots()) {
+        _writeU8(spot->isEnabled());
+        if (locations)
+          (*locations)[spot] = location;
+        location.spot++;
+      }
+      location.node++;
+    }
+    location.room++;
+  }
 
-  float fov = CameraManager::instance().fieldOfView();
-  const std::string fovStr = std::to_string(fov);
-  if (!SDL_WriteU8(_rw, fovStr.length()))
-    return false;
-  if (!SDL_RWwrite(_rw, fovStr.c_str(), fovStr.length(), 1))
-    return false;
+  return writeRoomState();
+}
 
-  // Write audio states
-  if (!SDL_WriteBE16(_rw, room->arrayOfAudios().size()))
-    return false;
+bool Serializer::writeDelta(const SpotLocations &locations) {
+  size_t recordPtr = _buffer.size();
+  _writeBE32(0); // 4 placeholder bytes for the length
+  _writeBE32(0); // 4 placeholder bytes for the checksum
 
-  for (Audio *audio : room->arrayOfAudios()) {
-    if (!SDL_WriteU8(_rw, audio->state()))
-      return false;
-  }
+  _preview = Control::instance().currentNode()->description();
+  _roomName = Control::instance().currentRoom()->name();
+  _writeString8(DAGON_VERSION_STRING);
+  _writeString8(_preview);
+  _writeString8(_roomName);
 
-  // Write timers
-  int64_t timersPtr = SDL_RWtell(_rw);
-  if (timersPtr < 0)
+  size_t keysPtr = _buffer.size();
+  _writeBE32(0); // 4 placeholder bytes for the size of the keys
+  if (!writeChangedKeys())
     return false;
-  if (!SDL_WriteBE16(_rw, 0)) // 2 placeholder bytes for the actual number of timers
+  _patchBE32(keysPtr, static_cast<uint32_t>(_buffer.size() - keysPtr - 4));
+
+  size_t spotsPtr = _buffer.size();
+  _writeBE32(0); // 4 placeholder bytes for the size of the spots
+  if (!writeChangedSpots(locations))
     return false;
+  _patchBE32(spotsPtr, static_cast<uint32_t>(_buffer.size() - spotsPtr - 4));
 
-  uint16_t numTimers = 0;
-  for (const auto &timer : TimerManager::instance().timers()) {
-    if (timer.type != DGTimerNormal || !timer.isEnabled ||
-        (!timer.isLoopable && timer.hasTriggered))
-      continue;
+  if (!writeRoomState())
+    return false;
 
-    double elapsed = TimerManager::instance().timeElapsed(timer);
-    if (timer.trigger - elapsed > 0) {
-      const std::string triggerStr = std::to_string(timer.trigger);
-      if (!SDL_WriteU8(_rw, timer.isLoopable))
-        return false;
-      if (!SDL_WriteU8(_rw, triggerStr.length()))
-        return false;
-      if (!SDL_RWwrite(_rw, triggerStr.c_str(), triggerStr.length(), 1))
-        return false;
+  size_t bodyPtr = recordPtr + 8;
+  _patchBE32(recordPtr, static_cast<uint32_t>(_buffer.size() - bodyPtr));
+  _patchBE32(recordPtr + 4, checksum(&_buffer[bodyPtr], _buffer.size() - bodyPtr));
+  return true;
+}
 
-      const std::string elapsedStr = std::to_string(elapsed);
-      if (!SDL_WriteU8(_rw, elapsedStr.length()))
-        return false;
-      if (!SDL_RWwrite(_rw, elapsedStr.c_str(), elapsedStr.length(), 1))
-        return false;
+// Adler-32, enough to tell a record cut short by a crash
+uint32_t Serializer::checksum(const void *data, size_t size) {
+  const uint8_t *bytes = static_cast<const uint8_t*>(data);
+  uint32_t a = 1;
+  uint32_t b = 0;
+
+  while (size > 0) {
+    // Largest run before the sums may overflow
+    size_t len = size < 5552 ? size : 5552;
+    size -= len;
+    while (len--) {
+      a += *bytes++;
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
 
-      lua_rawgeti(_L, LUA_REGISTRYINDEX, timer.luaHandler); // Push timer function to top of stack
+  return (b << 16) | a;
+}
 
-      int64_t funcSizePtr = SDL_RWtell(_rw);
-      if (funcSizePtr < 0)
-        return false;
-      if (!SDL_WriteBE16(_rw, 0)) // 2 placeholder bytes for the actual function size
-        return false;
+void Serializer::compress() {
+  std::vector<uint8_t> body(_buffer.begin() + _headerSize, _buffer.end());
+  _buffer.resize(_headerSize);
+
+  size_t sizePtr = _buffer.size();
+  _writeBE32(static_cast<uint32_t>(body.size()));
+  _writeBE32(0); // 4 placeholder bytes for the compressed size
+
+  const uint8_t *src = body.data();
+  const size_t size = body.size();
+  const size_t limit = size > 12 ? size - 12 : 0; // The tail is always literal
+  std::vector<int> table(1 << 14, -1);
+  size_t anchor = 0;
+  size_t i = 0;
+
+  while (i < limit) {
+    uint32_t seq;
+    std::memcpy(&seq, src + i, sizeof(seq));
+    uint32_t hash = (seq * 2654435761U) >> 18;
+    int ref = table[hash];
+    table[hash] = static_cast<int>(i);
+
+    if (ref < 0 || i - ref > kSaveWindowSize || std::memcmp(src + ref, src + i, kSaveMinMatch) != 0) {
+      i++;
+      continue;
+    }
 
-      int64_t beforeFuncPtr = SDL_RWtell(_rw);
-      if (beforeFuncPtr < 0)
-        return false;
-      int errCode = lua_dump(_L, writeFunction, _rw);
-      if (errCode != 0)
-        return false;
-      int64_t afterFuncPtr = SDL_RWtell(_rw);
-      if (afterFuncPtr < 0)
-        return false;
+    size_t len = kSaveMinMatch;
+    while (i + len < size && src[ref + len] == src[i + len])
+      len++;
 
-      uint16_t numBytesWritten = afterFuncPtr - beforeFuncPtr;
-      if (SDL_RWseek(_rw, funcSizePtr, RW_SEEK_SET) < 0)
-        return false;
-      if (!SDL_WriteBE16(_rw, numBytesWritten))
-        return false;
+    _writeSequence(src + anchor, i - anchor, i - ref, len);
+    i += len;
+    anchor = i;
+  }
 
-      if (SDL_RWseek(_rw, 0, RW_SEEK_END) < 0) // Restore file pointer to end
-        return false;
+  _writeSequence(src + anchor, size - anchor, 0, 0);
+  _patchBE32(sizePtr + 4, static_cast<uint32_t>(_buffer.size() - sizePtr - 8));
+}
 
-      numTimers++;
-    }
-  }
+const std::vector<uint8_t> &Serializer::data() {
+  return _buffer;
+}
 
-  if (SDL_RWseek(_rw, timersPtr, RW_SEEK_SET) < 0)
-    return false;
-  if (!SDL_WriteBE16(_rw, numTimers))
-    return false;
-  if (SDL_RWseek(_rw, 0, RW_SEEK_END) < 0) // Restore file pointer to end
-    return false;
+SavedTables &Serializer::savedTables() {
+  return _savedTables;
+}
 
-  // Write control mode
-  if (!SDL_WriteU8(_rw, Config::instance().controlMode))
-    return false;
+std::string Serializer::preview() {
+  return _preview;
+}
 
-  return true;
+std::string Serializer::roomName() {
+  return _roomName;
 }
 
 }
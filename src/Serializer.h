@@ -19,32 +19,132 @@
 ////////////////////////////////////////////////////////////
 
 #include <lua.hpp>
-#include <SDL2/SDL_rwops.h>
 
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace dagon {
 
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Saves begin with this, followed by the format. Text saves predate the
+// format byte and have an 'E' there instead ("DAGONSAVE").
+const char SAVIdent[] = { '\x44', '\x41', '\x47', '\x4F', '\x4E', '\x53', '\x41', '\x56' };
+
+enum SaveFormats {
+  kSaveFormatText = 1, // One Lua assignment per field
+  kSaveFormatBinary,   // Type-tagged values
+  kSaveFormatCompressed, // Binary numbers, and everything after the header compressed
+  kSaveFormatCurrent = kSaveFormatCompressed
+};
+
+// Every value in dgPersistence is written as one of these, followed by
+// its data. Tables list their key and value pairs until kSaveTagEnd.
+// Each table gets the next id the first time it's written, and later
+// occurrences (shared or cyclic) are written as references to that id.
+enum SaveTags {
+  kSaveTagEnd,
+  kSaveTagFalse,
+  kSaveTagTrue,
+  kSaveTagNumber,    // 64-bit double
+  kSaveTagString,    // 32-bit length and bytes
+  kSaveTagTable,
+  kSaveTagReference, // 32-bit id
+  kSaveTagNil        // Only in delta saves, for removed keys
+};
+
+// Saves are read in chunks of this size
+#define kSaveBufferSize 65536
+
+// Compressed data refers back at most this far, and matches are at least
+// this long. Sequences follow the LZ4 block layout: a token with the
+// literal and match lengths, the literals, and a 16-bit match offset.
+#define kSaveWindowSize 65535
+#define kSaveMinMatch 4
+
+// Anything larger is considered corrupt
+#define kSaveMaxSize (256 * 1024 * 1024)
+
+class Object;
+
+// Where a spot was found when walking rooms, nodes and spots in order,
+// so that delta saves can refer to it
+typedef struct {
+  uint16_t room;
+  uint16_t node;
+  uint16_t spot;
+} SpotLocation;
+
+typedef std::unordered_map<Object*, SpotLocation> SpotLocations;
+
+// Bytes each table of dgPersistence was written as, by those of its key.
+// Empty once a key no longer holds a table.
+typedef std::unordered_map<std::string, std::string> SavedTables;
+
+// Saves are written entirely to memory, so that the state is captured
+// at once and the file can be written later, on any thread
 class Serializer {
   lua_State *_L;
-  SDL_RWops *_rw;
 
-  std::unordered_map<int, std::string> _tblMap;
+  std::vector<uint8_t> _buffer;
+  size_t _headerSize;
+  std::string _preview;
+  std::string _roomName;
+  SavedTables _savedTables;
 
-  bool writeField(const std::string &key, const std::string &val);
   // This assumes a table is at stack position -1
-  int32_t writeTable(const std::string parentKey);
+  bool writeChangedKeys();
+  bool writeChangedSpots(const SpotLocations &locations);
+  bool writeRoomState();
+  bool writeTable(int seen, uint32_t *numTables);
+  bool writeValue(int index, int seen, uint32_t *numTables);
   // Callback for Lua when dumping a function
   static int writeFunction(lua_State *L, const void *p, size_t sz, void *ud);
 
+  void _patchBE16(size_t offset, uint16_t value);
+  void _patchBE32(size_t offset, uint32_t value);
+  void _write(const void *data, size_t size);
+  void _writeBE16(uint16_t value);
+  void _writeBE32(uint32_t value);
+  void _writeDouble(double value);
+  bool _writeKey(int data, const SavedTables *savedTables);
+  void _writeLength(size_t length);
+  void _writeSequence(const uint8_t *literals, size_t numLiterals,
+                      size_t offset, size_t matchLength);
+  void _writeString8(const std::string &str);
+  void _writeU8(uint8_t value);
+
 public:
-  Serializer(lua_State *L, SDL_RWops *rw);
+  Serializer(lua_State *L);
   ~Serializer();
 
+  const std::vector<uint8_t> &data();
+  // Tables written, for the next delta save to compare with
+  SavedTables &savedTables();
+  // As written in the header
+  std::string preview();
+  std::string roomName();
+
   bool writeHeader();
   bool writeScriptData();
-  bool writeRoomData();
+  // Locations of the spots may be recorded along the way
+  bool writeRoomData(SpotLocations *locations = nullptr);
+
+  // Delta saves are records appended to a journal next to a full save.
+  // Each has its length, checksum, the header strings, the dgPersistence
+  // keys and spots that changed, and the rest of the room data. Tables may
+  // change without dgPersistence knowing, so those are written if their
+  // bytes differ from the last save. Fails if a spot isn't in the full
+  // save, which then has to be written again.
+  bool writeDelta(const SpotLocations &locations);
+  static uint32_t checksum(const void *data, size_t size);
+
+  // Compresses everything after the header, which stays readable. Doesn't
+  // touch Lua, so it's safe to call from any thread once writing is done.
+  void compress();
 };
 
 }
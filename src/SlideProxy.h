@@ -38,6 +38,7 @@ namespace dagon {
 class SlideProxy : public ObjectProxy {
 public:
   static const char className[];
+  static const int objectType = kObjectSlide;
   static Luna<SlideProxy>::RegType methods[];
   
   // Constructor
@@ -0,0 +1,338 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include "Snapshot.h"
+#include "Audio.h"
+#include "CameraManager.h"
+#include "Config.h"
+#include "Control.h"
+#include "Node.h"
+#include "Room.h"
+#include "Script.h"
+#include "Spot.h"
+#include "TimerManager.h"
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+// Same as saves: only string and number keys, and no functions or
+// userdata as values
+static bool _isKept(lua_State *L, int key, int value) {
+  int keyType = lua_type(L, key);
+  int valueType = lua_type(L, value);
+  return (keyType == LUA_TSTRING || keyType == LUA_TNUMBER) &&
+         (valueType == LUA_TBOOLEAN || valueType == LUA_TNUMBER ||
+          valueType == LUA_TSTRING || valueType == LUA_TTABLE);
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Constructor
+////////////////////////////////////////////////////////////
+
+Snapshot::Snapshot(lua_State *L, int id) {
+  _L = L;
+  _id = id;
+  _data = LUA_NOREF;
+  _room = nullptr;
+  _node = nullptr;
+  _angleHorizontal = 0;
+  _angleVertical = 0;
+  _fieldOfView = 0.0f;
+  _controlMode = 0;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Destructor
+////////////////////////////////////////////////////////////
+
+Snapshot::~Snapshot() {
+  luaL_unref(_L, LUA_REGISTRYINDEX, _data);
+  for (const SnapshotTimer &timer : _timers)
+    luaL_unref(_L, LUA_REGISTRYINDEX, timer.luaHandler);
+}
+
+////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////
+
+int Snapshot::id() {
+  return _id;
+}
+
+bool Snapshot::capture() {
+  // Nothing to restore to before the first room
+  Control &control = Control::instance();
+  _room = control.currentRoom();
+  _node = _room ? _room->currentNode() : nullptr;
+  if (!_node)
+    return false;
+
+  // Copy dgPersistence
+  int top = lua_gettop(_L);
+  Script::pushPersistence(_L);
+  if (!lua_istable(_L, -1)) {
+    lua_pop(_L, 1);
+    lua_newtable(_L);
+  }
+
+  lua_newtable(_L); // Copies of the tables copied so far
+  lua_insert(_L, -2);
+
+  if (!_copyTable(top + 1)) {
+    lua_settop(_L, top);
+    return false;
+  }
+  _data = luaL_ref(_L, LUA_REGISTRYINDEX);
+  lua_settop(_L, top);
+
+  // Enable status for the spots of all nodes of all rooms
+  for (Room *room : control.rooms()) {
+    for (Node *node : room->arrayOfNodes()) {
+      for (Spot *spot : node->arrayOfSpots()) {
+        SnapshotSpot snapshotSpot = { spot, spot->isEnabled() };
+        _spots.push_back(snapshotSpot);
+      }
+    }
+  }
+
+  _angleHorizontal = CameraManager::instance().angleHorizontal();
+  _angleVertical = CameraManager::instance().angleVertical();
+  _fieldOfView = CameraManager::instance().fieldOfView();
+
+  for (Audio *audio : _room->arrayOfAudios()) {
+    SnapshotAudio snapshotAudio = { audio, audio->state() };
+    _audios.push_back(snapshotAudio);
+  }
+
+  // Timers a save would keep
+  for (const auto &timer : TimerManager::instance().timers()) {
+    if (timer.type != DGTimerNormal || !timer.isEnabled ||
+        (!timer.isLoopable && timer.hasTriggered))
+      continue;
+
+    double elapsed = TimerManager::instance().timeElapsed(timer);
+    if (timer.trigger - elapsed > 0) {
+      lua_rawgeti(_L, LUA_REGISTRYINDEX, timer.luaHandler);
+      SnapshotTimer snapshotTimer = { timer.isLoopable, timer.trigger, elapsed,
+                                      luaL_ref(_L, LUA_REGISTRYINDEX) };
+      _timers.push_back(snapshotTimer);
+    }
+  }
+
+  _controlMode = Config::instance().controlMode;
+
+  return true;
+}
+
+bool Snapshot::restore() {
+  // Restore dgPersistence first, as the events below may check it
+  int top = lua_gettop(_L);
+  Script::pushPersistence(_L);
+  if (!lua_istable(_L, -1)) {
+    lua_pop(_L, 1);
+    lua_newtable(_L);
+    lua_pushvalue(_L, -1);
+    lua_setglobal(_L, "dgPersistence");
+  }
+
+  lua_newtable(_L); // Tables filled so far, by their copy
+  lua_insert(_L, -2);
+  lua_rawgeti(_L, LUA_REGISTRYINDEX, _data);
+
+  bool result = _fillTable(top + 1);
+  lua_settop(_L, top);
+  if (!result)
+    return false;
+
+  // Switching rooms reloads them, so it's only done when needed
+  Control &control = Control::instance();
+  if (_room != control.currentRoom())
+    control.switchTo(_room);
+  if (_room->hasUnpersistEvent())
+    Script::instance().processCallback(_room->unpersistEvent(), 0);
+
+  for (const SnapshotSpot &snapshotSpot : _spots) {
+    if (snapshotSpot.isEnabled)
+      snapshotSpot.spot->enable(true);
+    else
+      snapshotSpot.spot->disable(true);
+  }
+
+  if (_node != _room->currentNode())
+    control.switchTo(_node);
+  if (_node->hasUnpersistEvent())
+    Script::instance().processCallback(_node->unpersistEvent(), 0);
+
+  CameraManager::instance().setAngleHorizontal(_angleHorizontal);
+  CameraManager::instance().setAngleVertical(_angleVertical);
+  _setFieldOfView(_fieldOfView);
+
+  for (const SnapshotAudio &snapshotAudio : _audios) {
+    Audio *audio = snapshotAudio.audio;
+    switch (snapshotAudio.state) {
+    case kAudioPlaying: {
+      if (!audio->isPlaying())
+        audio->play();
+      break;
+    }
+    case kAudioPaused: {
+      audio->pause();
+      break;
+    }
+    case kAudioStopped: {
+      audio->stop();
+      break;
+    }
+    }
+  }
+
+  // Timers started since are dropped, and those running then start again
+  // where they were
+  TimerManager &timerManager = TimerManager::instance();
+  for (const auto &timer : timerManager.timers()) {
+    if (timer.type == DGTimerNormal)
+      timerManager.destroy(timer.handle);
+  }
+
+  for (const SnapshotTimer &snapshotTimer : _timers) {
+    lua_rawgeti(_L, LUA_REGISTRYINDEX, snapshotTimer.luaHandler);
+    int handle = timerManager.create(snapshotTimer.trigger, snapshotTimer.isLoopable,
+                                     luaL_ref(_L, LUA_REGISTRYINDEX));
+    timerManager.rewind(handle, snapshotTimer.elapsed);
+  }
+
+  Config::instance().controlMode = _controlMode;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+// Pushes a copy of the table. Shared and cyclic tables are copied once.
+bool Snapshot::_copyTable(int copies) {
+  int table = lua_gettop(_L);
+
+  lua_pushvalue(_L, table);
+  lua_rawget(_L, copies);
+  if (lua_istable(_L, -1))
+    return true;
+  lua_pop(_L, 1);
+
+  if (!lua_checkstack(_L, 6))
+    return false;
+
+  lua_newtable(_L);
+  int copy = lua_gettop(_L);
+  lua_pushvalue(_L, table);
+  lua_pushvalue(_L, copy);
+  lua_rawset(_L, copies);
+
+  lua_pushnil(_L);
+  while (lua_next(_L, table) != 0) {
+    if (_isKept(_L, -2, -1)) {
+      lua_pushvalue(_L, -2);
+      lua_pushvalue(_L, -2);
+      if (lua_istable(_L, -1)) {
+        if (!_copyTable(copies))
+          return false;
+        lua_remove(_L, -2);
+      }
+      lua_rawset(_L, copy);
+    }
+
+    lua_pop(_L, 1);
+  }
+
+  return true;
+}
+
+// Fills the table below the top with the copy at the top, then pops the
+// copy. Tables are filled in place, so that scripts holding on to them
+// see the restored values.
+bool Snapshot::_fillTable(int filled) {
+  int copy = lua_gettop(_L);
+  int table = copy - 1;
+
+  lua_pushvalue(_L, copy);
+  lua_pushvalue(_L, table);
+  lua_rawset(_L, filled);
+
+  if (!lua_checkstack(_L, 6))
+    return false;
+
+  // Values set since are removed, unless they're of a kind never copied
+  lua_pushnil(_L);
+  while (lua_next(_L, table) != 0) {
+    lua_pushvalue(_L, -2);
+    lua_rawget(_L, copy);
+    bool isRemoved = lua_isnil(_L, -1) && _isKept(_L, -3, -2);
+    lua_pop(_L, 2);
+
+    if (isRemoved) {
+      lua_pushvalue(_L, -1);
+      lua_pushnil(_L);
+      lua_rawset(_L, table);
+    }
+  }
+
+  lua_pushnil(_L);
+  while (lua_next(_L, copy) != 0) {
+    lua_pushvalue(_L, -2);
+    if (lua_istable(_L, -2)) {
+      // Shared and cyclic tables are filled once
+      lua_pushvalue(_L, -2);
+      lua_rawget(_L, filled);
+      if (!lua_istable(_L, -1)) {
+        lua_pop(_L, 1);
+        lua_pushvalue(_L, -1);
+        lua_rawget(_L, table);
+        if (!lua_istable(_L, -1)) {
+          lua_pop(_L, 1);
+          lua_newtable(_L);
+        }
+
+        lua_pushvalue(_L, -3);
+        if (!_fillTable(filled))
+          return false;
+      }
+    } else {
+      lua_pushvalue(_L, -2);
+    }
+    lua_rawset(_L, table);
+
+    lua_pop(_L, 1);
+  }
+
+  lua_pop(_L, 1);
+  return true;
+}
+
+void Snapshot::_setFieldOfView(float fov) {
+  bool lock = CameraManager::instance().isLocked();
+  if (lock)
+    CameraManager::instance().unlock();
+  CameraManager::instance().setFieldOfView(fov);
+  if (lock)
+    CameraManager::instance().lock();
+}
+
+}
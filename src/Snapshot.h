@@ -0,0 +1,93 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2014 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+#ifndef DAGON_SNAPSHOT_H_
+#define DAGON_SNAPSHOT_H_
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include <lua.hpp>
+
+#include <vector>
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+class Audio;
+class Node;
+class Room;
+class Spot;
+
+typedef struct {
+  Spot *spot;
+  bool isEnabled;
+} SnapshotSpot;
+
+typedef struct {
+  Audio *audio;
+  int state;
+} SnapshotAudio;
+
+typedef struct {
+  bool isLoopable;
+  double trigger;
+  double elapsed;
+  int luaHandler; // Same function, not a copy
+} SnapshotTimer;
+
+////////////////////////////////////////////////////////////
+// Interface
+////////////////////////////////////////////////////////////
+
+// The same state a save holds, kept in memory as is. dgPersistence is
+// copied table by table, and objects are referred to directly, so that
+// restoring needs no disk, parsing or loading of rooms already loaded.
+class Snapshot {
+  lua_State *_L;
+  int _id;
+
+  int _data; // Reference to the copy of dgPersistence
+  Room *_room;
+  Node *_node;
+  int _angleHorizontal;
+  int _angleVertical;
+  float _fieldOfView;
+  std::vector<SnapshotSpot> _spots;
+  std::vector<SnapshotAudio> _audios;
+  std::vector<SnapshotTimer> _timers;
+  int _controlMode;
+
+  // These assume tables at the top of the stack
+  bool _copyTable(int copies);
+  bool _fillTable(int filled);
+  void _setFieldOfView(float fov);
+
+public:
+  Snapshot(lua_State *L, int id);
+  ~Snapshot();
+
+  int id();
+
+  bool capture();
+  // Scripts holding on to tables in dgPersistence see the restored values
+  bool restore();
+};
+
+}
+
+#endif // DAGON_SNAPSHOT_H_
@@ -209,7 +209,8 @@ void Spot::play() {
   if (_hasAudio && _attachedAudio->isLoaded())
     _attachedAudio->play();
   
-  if (_hasVideo && _attachedVideo->isLoaded())
+  // Videos still being loaded in the background start once ready
+  if (_hasVideo)
     _attachedVideo->play();
   
   // Hack of sorts but works OK
@@ -37,6 +37,7 @@ namespace dagon {
 class SpotProxy : public ObjectProxy {
 public:
   static const char className[];
+  static const int objectType = kObjectSpot;
   static Luna<SpotProxy>::RegType methods[];
   
   // Constructor
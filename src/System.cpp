@@ -61,7 +61,14 @@ bool System::init() {
   SDL_Init(SDL_INIT_EVENTS | SDL_INIT_VIDEO | SDL_INIT_TIMER);
   Uint32 videoFlags = SDL_WINDOW_OPENGL;
   
-  if (!config.displayWidth || !config.displayHeight) {
+  if (config.headless) {
+    // The context is still real, but nothing is ever shown
+    if (!config.displayWidth || !config.displayHeight) {
+      config.displayWidth = kDefHeadlessWidth;
+      config.displayHeight = kDefHeadlessHeight;
+    }
+    videoFlags = videoFlags | SDL_WINDOW_HIDDEN;
+  } else if (!config.displayWidth || !config.displayHeight) {
     if (config.fullscreen) {
       SDL_DisplayMode displayMode;
       SDL_GetCurrentDisplayMode(0, &displayMode);
@@ -102,9 +109,11 @@ bool System::init() {
   if (!SDL_GL_GetSwapInterval())
     config.frameLimiter = true;
   
-  SDL_WarpMouseInWindow(_window, config.displayWidth >> 1,
-                        config.displayHeight >> 1);
-  SDL_ShowCursor(false);
+  if (!config.headless) {
+    SDL_WarpMouseInWindow(_window, config.displayWidth >> 1,
+                          config.displayHeight >> 1);
+    SDL_ShowCursor(false);
+  }
   
   return true;
 }
@@ -28,6 +28,10 @@ namespace dagon {
 // Definitions
 ////////////////////////////////////////////////////////////
 
+// Used by headless runs when no display size is configured
+#define kDefHeadlessWidth 1280
+#define kDefHeadlessHeight 720
+
 class Config;
 class Log;
 
@@ -24,6 +24,8 @@
 ////////////////////////////////////////////////////////////
 
 #include "Control.h"
+#include "Profiler.h"
+#include "ScriptProfiler.h"
 
 namespace dagon {
 
@@ -42,12 +44,42 @@ static int SystemLibInit(lua_State *L) {
   return 0;
 }
 
+static int SystemLibProfile(lua_State *L) {
+  Profiler::instance().setEnabled(lua_toboolean(L, 1));
+  
+  return 0;
+}
+
+static int SystemLibPrintScriptProfile(lua_State *L) {
+  ScriptProfiler::instance().print(luaL_optint(L, 1, kScriptProfilerReportSize));
+  
+  return 0;
+}
+
+static int SystemLibProfileScripts(lua_State *L) {
+  ScriptProfiler::instance().setEnabled(lua_toboolean(L, 1));
+  
+  return 0;
+}
+
 static int SystemLibRun(lua_State *L) {
   Control::instance().run();
   
   return 0;
 }
 
+static int SystemLibScriptProfile(lua_State *L) {
+  ScriptProfiler::instance().push(L, luaL_optint(L, 1, 0));
+  
+  return 1;
+}
+
+static int SystemLibTrace(lua_State *L) {
+  lua_pushboolean(L, Profiler::instance().saveTrace(luaL_checkstring(L, 1)));
+  
+  return 1;
+}
+
 static int SystemLibUpdate(lua_State *L) {
   // We allow this in case the user wants to implement a loop of some kind.
   // FIXME: Currently has a conflict if there's an event hook registered.
@@ -69,7 +101,12 @@ static int SystemLibTerminate(lua_State *L) {
 static const struct luaL_reg SystemLib [] = {
   {"browse", SystemLibBrowse},
   {"init", SystemLibInit},
+  {"printScriptProfile", SystemLibPrintScriptProfile},
+  {"profile", SystemLibProfile},
+  {"profileScripts", SystemLibProfileScripts},
   {"run", SystemLibRun},
+  {"scriptProfile", SystemLibScriptProfile},
+  {"trace", SystemLibTrace},
   {"update", SystemLibUpdate},
   {"terminate", SystemLibTerminate},
   {NULL, NULL}
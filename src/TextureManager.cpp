@@ -18,6 +18,7 @@
 #include "Config.h"
 #include "Log.h"
 #include "Node.h"
+#include "Profiler.h"
 #include "Room.h"
 #include "Spot.h"
 #include "TextureManager.h"
@@ -38,6 +39,7 @@ TextureManager::TextureManager() :
 config(Config::instance()),
 log(Log::instance())
 {
+  _posterTime = 0;
   _roomToPreload = NULL;
 }
 
@@ -56,6 +58,12 @@ TextureManager::~TextureManager() {
       ++it;
     }
   }
+  
+  std::map<std::string, TexturePoster>::iterator it = _posterFrames.begin();
+  while (it != _posterFrames.end()) {
+    free(it->second.frame.data);
+    ++it;
+  }
 }
 
 ////////////////////////////////////////////////////////////
@@ -98,6 +106,16 @@ void TextureManager::init() {
    });*/
 }
 
+DGFrame* TextureManager::posterFrame(const char* forResource) {
+  std::map<std::string, TexturePoster>::iterator it = _posterFrames.find(forResource);
+  if (it != _posterFrames.end()) {
+    it->second.lastUse = ++_posterTime;
+    return &it->second.frame;
+  }
+  
+  return NULL;
+}
+
 void TextureManager::registerTexture(Texture* target) {
   // FIXME: If the script specifies a file with extension, we should
   // prioritize that and avoid doing any operations here.
@@ -157,7 +175,10 @@ void TextureManager::requestBundle(Node* forNode) {
 
 void TextureManager::requestTexture(Texture* target) {
   if (!target->isLoaded()) {
-    target->load();
+    {
+      ProfilerScope scope(kZoneTextureLoad);
+      target->load();
+    }
     
     _arrayOfActiveTextures.push_back(target);
   }
@@ -171,6 +192,36 @@ void TextureManager::setRoomToPreload(Room* theRoom) {
   _roomToPreload = theRoom;
 }
 
+void TextureManager::storePosterFrame(const char* forResource, const DGFrame* frame) {
+  if (_posterFrames.count(forResource))
+    return;
+  
+  if (_posterFrames.size() >= kMaxPosterFrames) {
+    std::map<std::string, TexturePoster>::iterator oldest = _posterFrames.begin();
+    std::map<std::string, TexturePoster>::iterator it = _posterFrames.begin();
+    while (it != _posterFrames.end()) {
+      if (it->second.lastUse < oldest->second.lastUse)
+        oldest = it;
+      ++it;
+    }
+    
+    free(oldest->second.frame.data);
+    _posterFrames.erase(oldest);
+  }
+  
+  size_t size = (frame->width * frame->height) * 3;
+  
+  TexturePoster poster;
+  poster.frame.width = frame->width;
+  poster.frame.height = frame->height;
+  poster.frame.depth = frame->depth;
+  poster.frame.data = (unsigned char*)malloc(size);
+  memcpy(poster.frame.data, frame->data, size);
+  poster.lastUse = ++_posterTime;
+  
+  _posterFrames[forResource] = poster;
+}
+
 bool TextureManager::updatePreloader() {
   if (_roomToPreload) {
     if (_roomToPreload->hasNodes()) {
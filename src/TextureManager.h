@@ -18,8 +18,12 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <map>
+#include <string>
+
 #include "Platform.h"
 #include "Texture.h"
+#include "Video.h"
 
 namespace dagon {
 
@@ -34,6 +38,16 @@ namespace dagon {
 // before the next switch.
 #define kMaxActiveTextures 18
 
+// First frames of videos kept in memory so that nodes with video spots
+// can be displayed without decoding anything during the switch
+#define kMaxPosterFrames 32
+
+// Poster frame kept by the manager, evicted when least recently used
+struct TexturePoster {
+  DGFrame frame;
+  unsigned int lastUse;
+};
+
 class Config;
 class Log;
 class Node;
@@ -53,6 +67,8 @@ class TextureManager {
   
   std::vector<Texture*> _arrayOfActiveTextures;
   std::vector<Texture*> _arrayOfTextures;
+  std::map<std::string, TexturePoster> _posterFrames;
+  unsigned int _posterTime; // Counts uses, to tell the least recent one
   
   Room* _roomToPreload;
   
@@ -72,10 +88,12 @@ public:
   int itemsInBundle(const char* nameOfBundle);
   void flush();
   void init();
+  DGFrame* posterFrame(const char* forResource);
   void registerTexture(Texture* target);
   void requestBundle(Node* forNode);
   void requestTexture(Texture* target);
   void setRoomToPreload(Room* theRoom);
+  void storePosterFrame(const char* forResource, const DGFrame* frame);
   bool updatePreloader();
 };
   
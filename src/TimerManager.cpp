@@ -15,6 +15,8 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <algorithm>
+
 #include <SDL2/SDL_timer.h>
 
 #include "Script.h"
@@ -32,14 +34,6 @@ TimerManager::TimerManager() {
   _handles = 0;
   _luaObject = 0;
   _mutex = SDL_CreateMutex();
-  if (!_mutex)
-    return;
-  _isRunning = true;
-  
-  _thread = SDL_CreateThread(_runThread, "TimerManager", (void*)NULL);
-  if (!_thread) {
-    _isRunning = false;
-  }
 }
 
 ////////////////////////////////////////////////////////////
@@ -55,18 +49,27 @@ TimerManager::~TimerManager() {
 ////////////////////////////////////////////////////////////
 
 std::vector<DGTimer> TimerManager::timers() {
-  return _arrayOfTimers;
-}
-
-double TimerManager::timeElapsed(const DGTimer &timer) {
+  std::vector<DGTimer> arrayOfTimers;
+  
   if (SDL_LockMutex(_mutex) == 0) {
-    double currentTime = SDL_GetTicks() / 1000;
-    double elapsed = currentTime - timer.lastTime;
+    arrayOfTimers.reserve(_timers.size());
+    std::unordered_map<int, DGTimer>::iterator it = _timers.begin();
+    while (it != _timers.end()) {
+      arrayOfTimers.push_back(it->second);
+      ++it;
+    }
     SDL_UnlockMutex(_mutex);
-    return elapsed;
   }
+  
+  // Handles are given in order
+  std::sort(arrayOfTimers.begin(), arrayOfTimers.end(),
+            [](const DGTimer &a, const DGTimer &b) { return a.handle < b.handle; });
+  
+  return arrayOfTimers;
+}
 
-  return 0;
+double TimerManager::timeElapsed(const DGTimer &timer) {
+  return _now() - timer.lastTime;
 }
 
 ////////////////////////////////////////////////////////////
@@ -74,148 +77,199 @@ double TimerManager::timeElapsed(const DGTimer &timer) {
 ////////////////////////////////////////////////////////////
 
 bool TimerManager::checkManual(int handle, int precision) {
-  DGTimer* timer = _lookUp(handle);
+  bool hasTriggered = false;
   
-  if (timer->isEnabled) {
-    double currentTime = SDL_GetTicks() / precision;
-    double duration = currentTime - timer->lastTime;
+  if (SDL_LockMutex(_mutex) == 0) {
+    DGTimer* timer = _lookUp(handle);
     
-    if (duration > timer->trigger) {
-      timer->lastTime = currentTime;
-      return true;
+    if (timer && timer->isEnabled) {
+      double currentTime = _now();
+      double duration = currentTime - timer->lastTime;
+      
+      if (duration >= timer->trigger) {
+        timer->lastTime = currentTime;
+        hasTriggered = true;
+      }
     }
+    SDL_UnlockMutex(_mutex);
   }
   
-  return false;
+  return hasTriggered;
 }
 
 int TimerManager::create(double trigger, bool shouldLoop, int handlerForLua, int luaObject) {
   DGTimer timer;
   
-  timer.handle = _handles;
   timer.hasTriggered = false;
+  timer.handler = NULL;
   timer.isEnabled = true;
   timer.isLoopable = shouldLoop;
-  timer.lastTime = SDL_GetTicks() / 1000;
   timer.type = DGTimerNormal;
   
   timer.trigger = trigger;
   timer.luaHandler = handlerForLua;
   timer.luaObject = luaObject;
   
-  if (SDL_LockMutex(_mutex) == 0) {
-    _arrayOfTimers.push_back(timer);
-    SDL_UnlockMutex(_mutex);
-  }
-  
-  _handles++;
-  
-  return timer.handle;
+  return _add(timer);
 }
 
 int TimerManager::createInternal(double trigger, void (*callback)()) {
   DGTimer timer;
   
-  timer.handle = _handles;
   timer.hasTriggered = false;
   timer.handler = callback;
   timer.isEnabled = true;
   timer.isLoopable = false;
-  timer.lastTime = SDL_GetTicks() / 1000;
+  timer.luaHandler = 0;
+  timer.luaObject = 0;
   timer.type = DGTimerInternal;
   
   timer.trigger = trigger;
   
-  if (SDL_LockMutex(_mutex) == 0) {
-    _arrayOfTimers.push_back(timer);
-    SDL_UnlockMutex(_mutex);
-  }
-  
-  _handles++;
-  
-  return timer.handle;
+  return _add(timer);
 }
 
 int TimerManager::createManual(double trigger, int precision) {
   DGTimer timer;
   
-  timer.handle = _handles;
   timer.hasTriggered = false;
+  timer.handler = NULL;
   timer.isEnabled = true;
   timer.isLoopable = false;
-  timer.lastTime = SDL_GetTicks() / precision;
+  timer.luaHandler = 0;
+  timer.luaObject = 0;
   timer.type = DGTimerManual;
   
   timer.trigger = trigger;
   
+  return _add(timer);
+}
+
+void TimerManager::destroy(int handle) {
+  // Its entry in the schedule is discarded when reached
+  int luaHandler = 0;
   if (SDL_LockMutex(_mutex) == 0) {
-    _arrayOfTimers.push_back(timer);
+    DGTimer* timer = _lookUp(handle);
+    if (timer) {
+      luaHandler = timer->luaHandler;
+      _timers.erase(handle);
+    }
     SDL_UnlockMutex(_mutex);
   }
   
-  _handles++;
-  
-  return timer.handle;
-}
-
-void TimerManager::destroy(int handle) {
-  // Must implement
+  if (luaHandler)
+    Script::instance().releaseCallback(luaHandler);
 }
 
 void TimerManager::disable(int handle) {
-  DGTimer* timer = _lookUp(handle);
-  timer->isEnabled = false;
+  if (SDL_LockMutex(_mutex) == 0) {
+    DGTimer* timer = _lookUp(handle);
+    if (timer)
+      timer->isEnabled = false;
+    SDL_UnlockMutex(_mutex);
+  }
 }
 
 void TimerManager::enable(int handle) {
-  DGTimer* timer = _lookUp(handle);
-  timer->isEnabled = true;
-  timer->lastTime = SDL_GetTicks() / 1000;
+  if (SDL_LockMutex(_mutex) == 0) {
+    DGTimer* timer = _lookUp(handle);
+    if (timer) {
+      timer->isEnabled = true;
+      timer->hasTriggered = false;
+      timer->lastTime = _now();
+      _enqueue(*timer);
+    }
+    SDL_UnlockMutex(_mutex);
+  }
 }
 
 void TimerManager::process() {
+  double currentTime = _now();
+  
+  // Collect everything that is due first, so that handlers are free
+  // to create or destroy timers
   if (SDL_LockMutex(_mutex) == 0) {
-    std::vector<DGTimer>::iterator it = _arrayOfTimers.begin();
-    while (it != _arrayOfTimers.end()) {
-      if ((*it).isEnabled && ((*it).type != DGTimerManual)) {
-        if ((*it).hasTriggered) {
-          bool keepProcessing = true;
-          switch ((*it).type) {
-            case DGTimerInternal:
-              (*it).handler();
-              keepProcessing = false;
-              break;
-              
-            case DGTimerNormal:
-              if ((*it).luaObject) { // Belongs to a Lua object?
-                if ((*it).luaObject != _luaObject) {
-                  (*it).hasTriggered = false;
-                  (*it).lastTime = SDL_GetTicks() / 1000; // Reset timer
-                  break; // Do not invoke the handler
-                }
-              }
-              
-              if ((*it).isLoopable) {
-                (*it).hasTriggered = false;
-                (*it).lastTime = SDL_GetTicks() / 1000;
-              }
-              else {
-                // Should destroy in reality
-                (*it).isEnabled = false;
-              }
-              
-              // Must unlock here for precaution
-              SDL_UnlockMutex(_mutex);
-              Script::instance().processCallback((*it).luaHandler, 0);
-              keepProcessing = false;
+    while (!_schedule.empty() && (_schedule.top().deadline <= currentTime)) {
+      DGTimerEvent event = _schedule.top();
+      _schedule.pop();
+      
+      DGTimer* timer = _lookUp(event.handle);
+      if (timer && timer->isEnabled && (timer->lastTime == event.lastTime)) {
+        timer->hasTriggered = true;
+        _arrayOfDueTimers.push_back(event.handle);
+      }
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    return;
+  }
+  
+  std::vector<int>::iterator it = _arrayOfDueTimers.begin();
+  while (it != _arrayOfDueTimers.end()) {
+    void (*handler)() = NULL;
+    int luaHandler = 0;
+    bool isReleased = false;
+    
+    if (SDL_LockMutex(_mutex) == 0) {
+      DGTimer* timer = _lookUp(*it);
+      
+      // May have been changed by a previous handler
+      if (timer && timer->isEnabled && timer->hasTriggered) {
+        switch (timer->type) {
+          case DGTimerInternal:
+            handler = timer->handler;
+            _timers.erase(*it);
+            break;
+            
+          case DGTimerNormal:
+            if (timer->luaObject && (timer->luaObject != _luaObject)) {
+              // Belongs to a Lua object which is not current, so
+              // reset the timer and do not invoke the handler
+              timer->hasTriggered = false;
+              timer->lastTime = currentTime;
+              _enqueue(*timer);
               break;
-          }
-          
-          if (!keepProcessing)
-            break; // In case the vector has changed, break the loop
+            }
+            
+            luaHandler = timer->luaHandler;
+            if (timer->isLoopable) {
+              timer->hasTriggered = false;
+              timer->lastTime = currentTime;
+              _enqueue(*timer);
+            }
+            else {
+              _timers.erase(*it);
+              isReleased = true;
+            }
+            break;
         }
       }
-      ++it;
+      SDL_UnlockMutex(_mutex);
+    }
+    
+    if (handler)
+      handler();
+    else if (luaHandler) {
+      Script::instance().processCallback(luaHandler, 0);
+      
+      // Fired for the last time
+      if (isReleased)
+        Script::instance().releaseCallback(luaHandler);
+    }
+    
+    ++it;
+  }
+  
+  _arrayOfDueTimers.clear();
+}
+
+void TimerManager::rewind(int handle, double elapsed) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    DGTimer* timer = _lookUp(handle);
+    if (timer) {
+      timer->lastTime -= elapsed;
+      if (timer->type != DGTimerManual)
+        _enqueue(*timer);
     }
     SDL_UnlockMutex(_mutex);
   }
@@ -230,60 +284,57 @@ void TimerManager::setSystem(System* theSystem) {
 }
 
 void TimerManager::terminate() {
-  _isRunning = false;
-  
-  int threadReturnValue;
-  SDL_WaitThread(_thread, &threadReturnValue);
-}
-
-// FIXME: This is quite sucky. Timers keep looping and being checked even if they
-// were already triggered. Should have different arrays here per each kind of timer.
-bool TimerManager::update() {
-  if (_isRunning) {
-    if (SDL_LockMutex(_mutex) == 0) {
-      std::vector<DGTimer>::iterator it = _arrayOfTimers.begin();
-      while (it != _arrayOfTimers.end()) {
-        double currentTime = SDL_GetTicks() / 1000;
-        double duration = currentTime - (*it).lastTime;
-        DGTimer* timer = &(*it);
-        if (timer->isEnabled && (timer->type != DGTimerManual)) {
-          if ((duration > timer->trigger) && !timer->hasTriggered) {
-            timer->hasTriggered = true;
-          }
-        }
-        ++it;
-      }
-      SDL_UnlockMutex(_mutex);
-    }
-    return true;
+  if (SDL_LockMutex(_mutex) == 0) {
+    _timers.clear();
+    _schedule = std::priority_queue<DGTimerEvent, std::vector<DGTimerEvent>,
+      DGTimerEventCompare>();
+    SDL_UnlockMutex(_mutex);
   }
-  return false;
 }
 
 ////////////////////////////////////////////////////////////
 // Implementation - Private methods
 ////////////////////////////////////////////////////////////
 
-DGTimer* TimerManager::_lookUp(int handle) {
+int TimerManager::_add(DGTimer &timer) {
+  int handle = 0;
+  
   if (SDL_LockMutex(_mutex) == 0) {
-    std::vector<DGTimer>::iterator it = _arrayOfTimers.begin();
-    while (it != _arrayOfTimers.end()) {
-      if ((*it).handle == handle) {
-        SDL_UnlockMutex(_mutex);
-        return &(*it);
-      }
-      ++it;
-    }
+    handle = _handles++;
+    
+    timer.handle = handle;
+    timer.lastTime = _now();
+    _timers[handle] = timer;
+    
+    // Manual timers are only checked on demand
+    if (timer.type != DGTimerManual)
+      _enqueue(timer);
     SDL_UnlockMutex(_mutex);
   }
+  
+  return handle;
+}
+
+void TimerManager::_enqueue(const DGTimer &timer) {
+  DGTimerEvent event;
+  event.deadline = timer.lastTime + timer.trigger;
+  event.lastTime = timer.lastTime;
+  event.handle = timer.handle;
+  _schedule.push(event);
+}
+
+DGTimer* TimerManager::_lookUp(int handle) {
+  // Elements of an unordered map are never moved by insertions
+  std::unordered_map<int, DGTimer>::iterator it = _timers.find(handle);
+  if (it != _timers.end())
+    return &it->second;
+  
   return NULL;
 }
 
-int TimerManager::_runThread(void *ptr) {
-  while (TimerManager::instance().update()) {
-    SDL_Delay(1);
-  }
-  return 0;
+double TimerManager::_now() {
+  static const double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+  return static_cast<double>(SDL_GetPerformanceCounter()) / frequency;
 }
 
 }
@@ -19,7 +19,9 @@
 ////////////////////////////////////////////////////////////
 
 #include <SDL2/SDL_mutex.h>
-#include <SDL2/SDL_thread.h>
+
+#include <queue>
+#include <unordered_map>
 
 #include "Platform.h"
 
@@ -37,6 +39,7 @@ enum DGTimerTypes {
   DGTimerNormal
 };
 
+// NOTE: All times are in seconds
 typedef struct {
   int handle;
   bool isEnabled;
@@ -50,6 +53,20 @@ typedef struct {
   int type;
 } DGTimer;
 
+// Entry of the schedule. Entries are never removed when a timer changes,
+// instead they are discarded if lastTime no longer matches the timer.
+typedef struct {
+  double deadline;
+  double lastTime;
+  int handle;
+} DGTimerEvent;
+
+struct DGTimerEventCompare {
+  bool operator()(const DGTimerEvent &a, const DGTimerEvent &b) const {
+    return a.deadline > b.deadline;
+  }
+};
+
 ////////////////////////////////////////////////////////////
 // Interface - Singleton class
 ////////////////////////////////////////////////////////////
@@ -57,17 +74,19 @@ typedef struct {
 class TimerManager {
   System* system;
   
-  std::vector<DGTimer> _arrayOfTimers;
+  std::unordered_map<int, DGTimer> _timers;
+  std::priority_queue<DGTimerEvent, std::vector<DGTimerEvent>,
+    DGTimerEventCompare> _schedule; // Earliest deadline on top
+  std::vector<int> _arrayOfDueTimers;
   int _handles; // Maintains a count of handles
   int _luaObject;
   
-  bool _isRunning;
-  
   SDL_mutex* _mutex;
-  SDL_Thread* _thread;
-  DGTimer* _lookUp(int handle);
   
-  static int _runThread(void *ptr);
+  int _add(DGTimer &timer);
+  DGTimer* _lookUp(int handle); // Must be called with the mutex locked
+  double _now();
+  void _enqueue(const DGTimer &timer);
   
   TimerManager();
   TimerManager(TimerManager const&);
@@ -81,11 +100,12 @@ public:
   }
 
   // Gets
-  std::vector<DGTimer> timers();
+  std::vector<DGTimer> timers(); // Sorted by creation
   double timeElapsed(const DGTimer &timer); // How long since it was started?
                                             // Caller should ensure it makes sense to query
                                             // this timer for it's elapsed time.
   
+  // Precision is no longer used since time has sub-millisecond resolution
   bool checkManual(int handle, int precision = 1000);
   int create(double trigger, bool shouldLoop, int handlerForLua, int luaObject = 0); // Returns a handle
   int createInternal(double trigger, void (*callback)()); // For timers created by the engine (not Lua)
@@ -93,11 +113,11 @@ public:
   void destroy(int handle);
   void disable(int handle);
   void enable(int handle);
-  void process();
+  void process(); // Fires every due timer, called once per frame
+  void rewind(int handle, double elapsed); // Make the timer start earlier
   void setLuaObject(int luaObject);
   void setSystem(System* theSystem);
   void terminate();
-  bool update();
 };
   
 }
@@ -54,7 +54,11 @@ log(Log::instance())
   _handle = NULL;
   _hasNewFrame = false;
   _hasResource = false;
+  _isActive = false;
   _isLoaded = false;
+  _isPlayPending = false;
+  _isQueued = false;
+  _isVisible = true;
   _state = VideoInitial;
   
   _doesAutoplay = true;
@@ -81,7 +85,11 @@ log(Log::instance())
   this->setType(kObjectVideo);
   
   _hasResource = false;
+  _isActive = false;
   _isLoaded = false;
+  _isPlayPending = false;
+  _isQueued = false;
+  _isVisible = true;
   _state = VideoInitial;
   
   _doesAutoplay = autoplay;
@@ -133,6 +141,10 @@ bool Video::hasResource() {
   return _hasResource;
 }
 
+bool Video::isActive() {
+  return _isActive;
+}
+
 bool Video::isLoaded() {
   return _isLoaded;
 }
@@ -142,13 +154,37 @@ bool Video::isLoopable() {
 }
 
 bool Video::isPlaying() {
-  return (_state == VideoPlaying);
+  // A video waiting to be loaded in the background is considered
+  // to be playing so that synced spots still hold the script
+  bool playing = false;
+  if (SDL_LockMutex(_mutex) == 0) {
+    playing = (_state == VideoPlaying || _isPlayPending);
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModVideo, "%s", kString18002);
+  }
+  return playing;
+}
+
+bool Video::isQueued() {
+  bool queued = false;
+  if (SDL_LockMutex(_mutex) == 0) {
+    queued = _isQueued;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModVideo, "%s", kString18002);
+  }
+  return queued;
 }
 
 bool Video::isSynced() {
   return _isSynced;
 }
 
+bool Video::isVisible() {
+  return _isVisible;
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - Gets
 ////////////////////////////////////////////////////////////
@@ -171,6 +207,10 @@ const char* Video::resource() {
 // Implementation - Sets
 ////////////////////////////////////////////////////////////
 
+void Video::setActive(bool active) {
+  _isActive = active;
+}
+
 void Video::setAutoplay(bool autoplay) {
   _doesAutoplay = autoplay;
 }
@@ -179,6 +219,18 @@ void Video::setLoopable(bool loopable) {
   _isLoopable = loopable;
 }
 
+// Also read by the loading job
+void Video::setQueued(bool queued) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    _isQueued = queued;
+    if (!queued)
+      _isPlayPending = false;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModVideo, "%s", kString18002);
+  }
+}
+
 void Video::setResource(const char* fromFileName) {
   strncpy(_resource, fromFileName, kMaxFileLength);
   _hasResource = true;
@@ -188,6 +240,16 @@ void Video::setSynced(bool synced) {
   _isSynced = synced;
 }
 
+void Video::setVisible(bool visible) {
+  // Read by the decoding job
+  if (SDL_LockMutex(_mutex) == 0) {
+    _isVisible = visible;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModVideo, "%s", kString18002);
+  }
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - State changes
 ////////////////////////////////////////////////////////////
@@ -196,6 +258,17 @@ void Video::load() {
   if (SDL_LockMutex(_mutex) == 0) {
     int stateFlag = 0;
     
+    // Already loaded on request while queued, or the other way around.
+    // Loading again would leak the file and the decoder.
+    if (_isLoaded) {
+      SDL_UnlockMutex(_mutex);
+      return;
+    }
+    
+    // Playback requested while the video was queued starts as soon as it's ready
+    bool shouldPlay = _isPlayPending;
+    _isPlayPending = false;
+    
     if (!_hasResource) {
       log.error(kModVideo, "%s", kString17010);
       //return;
@@ -302,6 +375,11 @@ void Video::load() {
     
     _frameDuration = (double)(1.0/((double)_theoraInfo->ti.fps_numerator / (double)_theoraInfo->ti.fps_denominator)) * 1000.0;
     _isLoaded = true;
+    
+    if (shouldPlay) {
+      _beginPlayback();
+      _hasNewFrame = true;
+    }
     SDL_UnlockMutex(_mutex);
   } else {
     log.error(kModVideo, "%s", kString18002);
@@ -310,15 +388,10 @@ void Video::load() {
 
 void Video::play() {
   if (SDL_LockMutex(_mutex) == 0) {
-    _state = VideoPlaying;
-    yuv_buffer yuv;
-    _prepareFrame();
-    theora_decode_YUVout(&_theoraInfo->td, &yuv);
-    _convertToRGB(yuv.y, yuv.y_stride,
-                  yuv.u, yuv.v, yuv.uv_stride,
-                  _currentFrame.data, _theoraInfo->ti.width, _theoraInfo->ti.height, _theoraInfo->ti.width);
-    
-    _lastTime = SDL_GetTicks();
+    if (_isLoaded)
+      _beginPlayback();
+    else if (_isQueued)
+      _isPlayPending = true;
     SDL_UnlockMutex(_mutex);
   } else {
     log.error(kModVideo, "%s", kString18002);
@@ -327,6 +400,7 @@ void Video::play() {
 
 void Video::pause() {
   if (SDL_LockMutex(_mutex) == 0) {
+    _isPlayPending = false;
     if (_state == VideoPlaying)
       _state = VideoPaused;
     SDL_UnlockMutex(_mutex);
@@ -337,11 +411,13 @@ void Video::pause() {
 
 void Video::stop() {
   if (SDL_LockMutex(_mutex) == 0) {
+    _isPlayPending = false;
     if (_state == VideoPlaying) {
       _state = VideoStopped;
       // Rewind
       fseek(_handle, (long)_theoraInfo->bos * 8, SEEK_SET);
       ogg_stream_reset(&_theoraInfo->to);
+      _heldPackets.clear();
     }
     SDL_UnlockMutex(_mutex);
   } else {
@@ -363,6 +439,7 @@ void Video::unload() {
         // Rewind and reset
         fseek(_handle, (long)_theoraInfo->bos * 8, SEEK_SET);
         ogg_stream_reset(&_theoraInfo->to);
+        _heldPackets.clear();
         ogg_stream_clear(&_theoraInfo->to);
         theora_clear(&_theoraInfo->td);
         theora_comment_clear(&_theoraInfo->tc);
@@ -383,53 +460,69 @@ void Video::unload() {
   }
 }
 
-void Video::update() {
+int Video::update() {
+  int delay = kVideoMaxDelay;
+  
   if (SDL_LockMutex(_mutex) == 0) {
     if (_state == VideoPlaying) {
       double currentTime = SDL_GetTicks();
       double duration = currentTime - _lastTime;
-      if (duration >= _frameDuration) {
+      if (!_isVisible) {
+        // Nobody is looking: keep the stream position in sync with the clock
+        // but skip the conversion so that it resumes at the right frame
+        if (duration >= kVideoHiddenInterval) {
+          _skipFrames(duration);
+          duration = currentTime - _lastTime;
+        }
+        delay = static_cast<int>(kVideoHiddenInterval - duration);
+      }
+      else if (duration >= _frameDuration) {
         yuv_buffer yuv;
         
+        // Just shown again, so catch up with what was skipped
+        _decodeHeld();
+        
         // TODO: Skip frames if required here?
         int frames = (int)floor(duration / _frameDuration);
         for (int i = 0; i < frames; i++)
           _prepareFrame();
         
         theora_decode_YUVout(&_theoraInfo->td, &yuv);
-        _convertToRGB(yuv.y, yuv.y_stride,
-                      yuv.u, yuv.v, yuv.uv_stride,
-                      _currentFrame.data, _theoraInfo->ti.width, _theoraInfo->ti.height, _theoraInfo->ti.width);
+        convertToRGB(yuv.y, yuv.y_stride,
+                     yuv.u, yuv.v, yuv.uv_stride,
+                     _currentFrame.data, _theoraInfo->ti.width, _theoraInfo->ti.height, _theoraInfo->ti.width);
         
         _lastTime = currentTime;
         
         _hasNewFrame = true;
+        delay = static_cast<int>(_frameDuration);
+      }
+      else {
+        delay = static_cast<int>(_frameDuration - duration);
       }
     }
     SDL_UnlockMutex(_mutex);
   } else {
     log.error(kModVideo, "%s", kString18002);
   }
+  
+  if (delay < 1)
+    delay = 1;
+  if (delay > kVideoMaxDelay)
+    delay = kVideoMaxDelay;
+  
+  return delay;
 }
 
 ////////////////////////////////////////////////////////////
-// Implementation - Private methods
+// Implementation - Conversion
 ////////////////////////////////////////////////////////////
 
-std::size_t Video::_bufferData(ogg_sync_state* oy) {
-  char *buffer = ogg_sync_buffer(oy, VideoBuffer);
-  std::size_t bytes = fread(buffer, 1, VideoBuffer, _handle);
-  
-  ogg_sync_wrote(oy, bytes);
-  
-  return(bytes);
-}
-
 // TODO: This method needs a massive overhaul. It's slow and colors aren't accurate.
-void Video::_convertToRGB(uint8_t* puc_y, int stride_y,
-                            uint8_t* puc_u, uint8_t* puc_v, int stride_uv,
-                            uint8_t* puc_out, int width_y, int height_y,
-                            unsigned int _stride_out) {
+void Video::convertToRGB(uint8_t* puc_y, int stride_y,
+                         uint8_t* puc_u, uint8_t* puc_v, int stride_uv,
+                         uint8_t* puc_out, int width_y, int height_y,
+                         unsigned int _stride_out) {
   int x, y;
   int stride_diff = 6 * _stride_out - 3 * width_y;
   
@@ -491,6 +584,65 @@ void Video::_convertToRGB(uint8_t* puc_y, int stride_y,
     puc_out += stride_diff;
   }
 }
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+void Video::_beginPlayback() {
+  _state = VideoPlaying;
+  yuv_buffer yuv;
+  _prepareFrame();
+  theora_decode_YUVout(&_theoraInfo->td, &yuv);
+  convertToRGB(yuv.y, yuv.y_stride,
+               yuv.u, yuv.v, yuv.uv_stride,
+               _currentFrame.data, _theoraInfo->ti.width, _theoraInfo->ti.height, _theoraInfo->ti.width);
+  
+  _lastTime = SDL_GetTicks();
+}
+
+std::size_t Video::_bufferData(ogg_sync_state* oy) {
+  char *buffer = ogg_sync_buffer(oy, VideoBuffer);
+  std::size_t bytes = fread(buffer, 1, VideoBuffer, _handle);
+  
+  ogg_sync_wrote(oy, bytes);
+  
+  return(bytes);
+}
+  
+void Video::_decodeHeld() {
+  if (_heldPackets.empty())
+    return;
+  
+  for (DGVideoPacket& packet : _heldPackets) {
+    packet.op.packet = packet.data.data();
+    theora_decode_packetin(&_theoraInfo->td, &packet.op);
+  }
+  _heldPackets.clear();
+  
+  _theoraInfo->videobuf_granulepos = _theoraInfo->td.granulepos;
+  _theoraInfo->videobuf_time = theora_granule_time(&_theoraInfo->td, _theoraInfo->videobuf_granulepos);
+}
+
+// Frames depend on those before them back to the last keyframe, so hidden
+// videos decode keyframes and hold on to the rest, which is cheap to copy
+void Video::_decodePacket(ogg_packet* op) {
+  if (!_isVisible) {
+    if (theora_packet_iskeyframe(op) != 1) {
+      _heldPackets.push_back(DGVideoPacket());
+      DGVideoPacket& packet = _heldPackets.back();
+      packet.op = *op;
+      packet.data.assign(op->packet, op->packet + op->bytes);
+      return;
+    }
+    
+    _heldPackets.clear();
+  }
+  
+  theora_decode_packetin(&_theoraInfo->td, op);
+  _theoraInfo->videobuf_granulepos = _theoraInfo->td.granulepos;
+  _theoraInfo->videobuf_time = theora_granule_time(&_theoraInfo->td, _theoraInfo->videobuf_granulepos);
+}
   
 void Video::_initConversionToRGB() {
   // Manually tweaked alues from http://www.fourcc.org/fccyvrgb.php
@@ -514,9 +666,7 @@ int Video::_prepareFrame() {
   while (_state == VideoPlaying) {
     while (_theoraInfo->theora_p && !_theoraInfo->videobuf_ready) {
       if (ogg_stream_packetout(&_theoraInfo->to, &_theoraInfo->op) > 0) {
-        theora_decode_packetin(&_theoraInfo->td, &_theoraInfo->op);
-        _theoraInfo->videobuf_granulepos = _theoraInfo->td.granulepos;
-        _theoraInfo->videobuf_time = theora_granule_time(&_theoraInfo->td, _theoraInfo->videobuf_granulepos);
+        _decodePacket(&_theoraInfo->op);
         _theoraInfo->videobuf_ready = 1;
         
         if (!_theoraInfo->bos) {
@@ -531,6 +681,7 @@ int Video::_prepareFrame() {
         // This is the begin of stream (granule position) * 8 bits (in bytes)
         fseek(_handle, (long)_theoraInfo->bos * 8, SEEK_SET);
         ogg_stream_reset(&_theoraInfo->to);
+        _heldPackets.clear();
       }
       else {
         _state = VideoStopped;
@@ -538,6 +689,7 @@ int Video::_prepareFrame() {
         // Rewind
         fseek(_handle, (long)_theoraInfo->bos * 8, SEEK_SET);
         ogg_stream_reset(&_theoraInfo->to);
+        _heldPackets.clear();
       }
       
       break;
@@ -560,6 +712,17 @@ int Video::_prepareFrame() {
   return 0;
 }
 
+void Video::_skipFrames(double duration) {
+  int frames = (int)floor(duration / _frameDuration);
+  for (int i = 0; i < frames; i++) {
+    if (!_prepareFrame())
+      break;
+  }
+  
+  // Keep the remainder so that the clock doesn't drift
+  _lastTime += frames * _frameDuration;
+}
+
 int Video::_queuePage(DGTheoraInfo* theoraInfo, ogg_page *page) {
   if (theoraInfo->theora_p) ogg_stream_pagein(&theoraInfo->to, page);
   
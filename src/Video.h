@@ -21,6 +21,8 @@
 #include <SDL2/SDL_mutex.h>
 #include <theora/theora.h>
 
+#include <vector>
+
 #include "Object.h"
 
 namespace dagon {
@@ -61,8 +63,22 @@ typedef struct {
   double videobuf_time;
 } DGTheoraInfo;
 
+// Packet left undecoded while hidden, with a copy of its data
+typedef struct {
+  ogg_packet op;
+  std::vector<unsigned char> data;
+} DGVideoPacket;
+
 #define VideoBuffer 4096
 
+// Videos out of sight are only kept in sync with their clock, which
+// is done in batches every given milliseconds. They only decode
+// keyframes, holding the packets after the last one until shown.
+#define kVideoHiddenInterval 250
+
+// Longest the decoding job may be delayed when there's nothing to show
+#define kVideoMaxDelay 50
+
 #define DGPutComponent(p, v, i) \
 tmp = (unsigned int)(v); \
 if (tmp < 0x10000) \
@@ -88,11 +104,16 @@ class Video : public Object {
   FILE* _handle;
   bool _hasNewFrame;
   bool _hasResource;
+  bool _isActive;
   bool _isLoaded;
   bool _isLoopable;
+  bool _isPlayPending;
+  bool _isQueued;
   bool _isSynced;
+  bool _isVisible;
   double _lastTime;
   int _state;
+  std::vector<DGVideoPacket> _heldPackets; // Since the last keyframe, while hidden
   
   SDL_mutex* _mutex;
   
@@ -100,13 +121,13 @@ class Video : public Object {
   char _resource[kMaxFileLength];
   
   // Private methods
+  void _beginPlayback();
   std::size_t _bufferData(ogg_sync_state* oy);
-  void _convertToRGB(uint8_t* puc_y, int stride_y,
-                     uint8_t* puc_u, uint8_t* puc_v, int stride_uv,
-                     uint8_t* puc_out, int width_y, int height_y,
-                     unsigned int _stride_out);
+  void _decodeHeld();
+  void _decodePacket(ogg_packet* op);
   void _initConversionToRGB();
   int _prepareFrame();
+  void _skipFrames(double duration);
   static int _queuePage(DGTheoraInfo* theoraInfo, ogg_page *page);
   
 public:
@@ -118,11 +139,14 @@ public:
   
   bool doesAutoplay();
   bool hasNewFrame();
+  bool isActive();
   bool hasResource();
   bool isLoaded();
   bool isLoopable();
   bool isPlaying();
+  bool isQueued();
   bool isSynced();
+  bool isVisible();
   
   // Gets
   
@@ -131,10 +155,13 @@ public:
   
   // Sets
   
+  void setActive(bool active); // Only the manager should set this
   void setAutoplay(bool autoplay);
   void setLoopable(bool loopable);
+  void setQueued(bool queued);
   void setResource(const char* fromFileName);
   void setSynced(bool synced);
+  void setVisible(bool visible);
   
   // State changes
   
@@ -143,7 +170,14 @@ public:
   void pause();
   void stop();
   void unload();
-  void update();
+  int update(); // Returns the milliseconds until the next frame is due
+  
+  // Conversion
+  
+  void convertToRGB(uint8_t* puc_y, int stride_y,
+                    uint8_t* puc_u, uint8_t* puc_v, int stride_uv,
+                    uint8_t* puc_out, int width_y, int height_y,
+                    unsigned int _stride_out);
 };
   
 }
@@ -18,7 +18,9 @@
 #include <SDL2/SDL_timer.h>
 
 #include "Config.h"
+#include "JobManager.h"
 #include "Log.h"
+#include "Profiler.h"
 #include "VideoManager.h"
 
 namespace dagon {
@@ -29,10 +31,14 @@ namespace dagon {
 
 VideoManager::VideoManager() :
 config(Config::instance()),
+jobManager(JobManager::instance()),
 log(Log::instance())
 {
   _isInitialized = false;
   _isRunning = false;
+  _delay = kVideoMaxDelay;
+  _job = 0;
+  _isWakePending = false;
   _mutex = SDL_CreateMutex();
   if (!_mutex)
     log.error(kModVideo, "%s", kString18001);
@@ -51,27 +57,40 @@ VideoManager::~VideoManager() {
 ////////////////////////////////////////////////////////////
 
 void VideoManager::flush() {
-  bool done = false;
   if (_isInitialized) {
+    // Videos still waiting to be loaded belong to the previous node
+    if (!_arrayOfQueuedVideos.empty()) {
+      if (SDL_LockMutex(_mutex) == 0) {
+        std::vector<Video*>::iterator it = _arrayOfQueuedVideos.begin();
+        while (it != _arrayOfQueuedVideos.end()) {
+          (*it)->setQueued(false);
+          ++it;
+        }
+        _arrayOfQueuedVideos.clear();
+        SDL_UnlockMutex(_mutex);
+      } else {
+        log.error(kModVideo, "%s", kString18002);
+      }
+    }
+    
     if (!_arrayOfActiveVideos.empty()) {
-      std::vector<Video*>::iterator it;
-      while (!done) {
-        if (SDL_LockMutex(_mutex) == 0) {
-          it = _arrayOfActiveVideos.begin();
-          done = true;
-          while (it != _arrayOfActiveVideos.end()) {
-            if ((*it)->retainCount() == 0) {
-              (*it)->unload();
-              _arrayOfActiveVideos.erase(it);
-              done = false;
-              break;
-            }
-            else ++it;
+      if (SDL_LockMutex(_mutex) == 0) {
+        std::size_t i = 0;
+        while (i < _arrayOfActiveVideos.size()) {
+          Video* video = _arrayOfActiveVideos[i];
+          if (video->retainCount() == 0) {
+            video->unload();
+            video->setActive(false);
+            
+            // Order doesn't matter, so swap with the last one and check this slot again
+            _arrayOfActiveVideos[i] = _arrayOfActiveVideos.back();
+            _arrayOfActiveVideos.pop_back();
           }
-          SDL_UnlockMutex(_mutex);
-        } else {
-          log.error(kModVideo, "%s", kString18002);
+          else ++i;
         }
+        SDL_UnlockMutex(_mutex);
+      } else {
+        log.error(kModVideo, "%s", kString18002);
       }
     }
   }
@@ -86,52 +105,61 @@ void VideoManager::init() {
   _isInitialized = true;
   _isRunning = true;
   
-  _thread = SDL_CreateThread(_runThread, "VideoManager", (void*)NULL);
-  if (!_thread) {
-    log.error(kModVideo, "%s:%s", kString18003, SDL_GetError());
-  }
+  _job = jobManager.submit(_runJob, NULL);
 }
 
 void VideoManager::registerVideo(Video* target) {
   _arrayOfVideos.push_back(target);
 }
 
-void VideoManager::requestVideo(Video* target) {
+void VideoManager::requestVideo(Video* target, bool inBackground) {
   if (!target->isLoaded()) {
-    target->load();
-  }
-  
-  // If the audio is not active, then it's added to
-  // that vector
-  
-  bool isActive = false;
-  std::vector<Video*>::iterator it;
-  it = _arrayOfActiveVideos.begin();
-  
-  while (it != _arrayOfActiveVideos.end()) {
-    if ((*it) == target) {
-      isActive = true;
-      break;
+    if (inBackground && _isRunning) {
+      // The decoder is started by a job of its own, which also
+      // activates the video once it's ready. Videos of the same node
+      // are thus loaded in parallel.
+      bool shouldSubmit = false;
+      if (SDL_LockMutex(_mutex) == 0) {
+        // Checked under the lock, since the job dequeues it when done
+        if (!target->isQueued()) {
+          target->setQueued(true);
+          _arrayOfQueuedVideos.push_back(target);
+          shouldSubmit = true;
+        }
+        SDL_UnlockMutex(_mutex);
+      } else {
+        log.error(kModVideo, "%s", kString18002);
+      }
+      
+      if (shouldSubmit)
+        jobManager.submit(_runLoadJob, target, kJobPriorityLow);
+      
+      return;
     }
     
-    ++it;
+    target->load();
   }
   
-  if (!isActive) {
-    if (SDL_LockMutex(_mutex) == 0) {
-      _arrayOfActiveVideos.push_back(target);
-      SDL_UnlockMutex(_mutex);
-    } else {
-      log.error(kModVideo, "%s", kString18002);
-    }
+  if (SDL_LockMutex(_mutex) == 0) {
+    _activate(target);
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModVideo, "%s", kString18002);
   }
+  
+  _wake();
 }
 
 void VideoManager::terminate() {
   _isRunning = false;
+  _wake();
   
-  int threadReturnValue;
-  SDL_WaitThread(_thread, &threadReturnValue);
+  // An update already in progress may still submit the job once more
+  int job;
+  do {
+    job = _job;
+    jobManager.wait(job);
+  } while (job != _job);
   
   // WARNING: This code assumes videos are never created
   // directly in the script
@@ -151,11 +179,14 @@ void VideoManager::terminate() {
 
 bool VideoManager::update() {
   if (_isRunning) {
+    int delay = kVideoMaxDelay;
     if (!_arrayOfActiveVideos.empty()) {
       if (SDL_LockMutex(_mutex) == 0) {
         std::vector<Video*>::iterator it = _arrayOfActiveVideos.begin();
         while (it != _arrayOfActiveVideos.end()) {
-          (*it)->update();
+          int videoDelay = (*it)->update();
+          if (videoDelay < delay)
+            delay = videoDelay;
           ++it;
         }
         SDL_UnlockMutex(_mutex);
@@ -163,6 +194,7 @@ bool VideoManager::update() {
         log.error(kModVideo, "%s", kString18002);
       }
     }
+    _delay = delay;
     return true;
   }
   return false;
@@ -172,11 +204,95 @@ bool VideoManager::update() {
 // Implementation - Private methods
 ////////////////////////////////////////////////////////////
 
-int VideoManager::_runThread(void *ptr) {
-  while (VideoManager::instance().update()) {
-    SDL_Delay(1);
+// Must be called with the mutex locked
+void VideoManager::_activate(Video* target) {
+  if (!target->isActive()) {
+    target->setActive(true);
+    _arrayOfActiveVideos.push_back(target);
+  }
+}
+
+// Expedites the decoding job if it's waiting for frames to be due
+void VideoManager::_wake() {
+  // The job may be about to submit itself again with an older delay, which
+  // it does under this same lock
+  if (SDL_LockMutex(_mutex) == 0) {
+    _isWakePending = true;
+    jobManager.expedite(_job);
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModVideo, "%s", kString18002);
+  }
+}
+
+void VideoManager::_runJob(void *ptr) {
+  VideoManager& videoManager = VideoManager::instance();
+  ProfilerScope scope(kZoneVideo);
+  
+  // Only wakes from now on may be missed by this update
+  if (SDL_LockMutex(videoManager._mutex) == 0) {
+    videoManager._isWakePending = false;
+    SDL_UnlockMutex(videoManager._mutex);
+  } else {
+    videoManager.log.error(kModVideo, "%s", kString18002);
+  }
+  
+  if (videoManager.update()) {
+    if (SDL_LockMutex(videoManager._mutex) == 0) {
+      int delay = videoManager._isWakePending ? 0 : videoManager._delay;
+      videoManager._job = videoManager.jobManager.submit(_runJob, NULL, kJobPriorityNormal,
+                                                         0, delay);
+      SDL_UnlockMutex(videoManager._mutex);
+    } else {
+      videoManager.log.error(kModVideo, "%s", kString18002);
+    }
+  }
+}
+
+void VideoManager::_runLoadJob(void *ptr) {
+  VideoManager& videoManager = VideoManager::instance();
+  Video* target = static_cast<Video*>(ptr);
+  
+  // Skip videos no longer wanted since the request
+  bool isWanted = false;
+  if (SDL_LockMutex(videoManager._mutex) == 0) {
+    std::vector<Video*>& queue = videoManager._arrayOfQueuedVideos;
+    if (std::find(queue.begin(), queue.end(), target) != queue.end())
+      isWanted = videoManager._isRunning;
+    SDL_UnlockMutex(videoManager._mutex);
+  } else {
+    videoManager.log.error(kModVideo, "%s", kString18002);
+  }
+  
+  if (!isWanted)
+    return;
+  
+  // Not holding the lock of the manager, so that playback goes on
+  {
+    ProfilerScope scope(kZoneVideoLoad);
+    target->load();
   }
-  return 0;
+  
+  // The video stays queued while loading, so that a flush meanwhile takes
+  // it out. Then it's unloaded instead, unless requested again since.
+  if (SDL_LockMutex(videoManager._mutex) == 0) {
+    std::vector<Video*>& queue = videoManager._arrayOfQueuedVideos;
+    std::vector<Video*>::iterator it = std::find(queue.begin(), queue.end(), target);
+    if (it != queue.end()) {
+      queue.erase(it);
+      target->setQueued(false);
+      if (target->isLoaded() && videoManager._isRunning)
+        videoManager._activate(target);
+    }
+    else if (!target->isActive()) {
+      target->unload();
+    }
+    SDL_UnlockMutex(videoManager._mutex);
+  } else {
+    videoManager.log.error(kModVideo, "%s", kString18002);
+  }
+  
+  videoManager._wake();
 }
   
 }
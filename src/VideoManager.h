@@ -19,7 +19,6 @@
 ////////////////////////////////////////////////////////////
 
 #include <SDL2/SDL_mutex.h>
-#include <SDL2/SDL_thread.h>
 
 #include "Platform.h"
 #include "Video.h"
@@ -31,6 +30,7 @@ namespace dagon {
 ////////////////////////////////////////////////////////////
 
 class Config;
+class JobManager;
 class Log;
 
 ////////////////////////////////////////////////////////////
@@ -39,17 +39,24 @@ class Log;
 
 class VideoManager {
   Config& config;
+  JobManager& jobManager;
   Log& log;
   
   SDL_mutex* _mutex;
-  SDL_Thread* _thread;
+  int _delay;
+  int _job; // Decoding job, submits itself again when frames are due
+  bool _isWakePending; // Woken while updating, so it's due right away
   std::vector<Video*> _arrayOfVideos;
   std::vector<Video*> _arrayOfActiveVideos;
+  std::vector<Video*> _arrayOfQueuedVideos;
   
   bool _isInitialized;
   bool _isRunning;
   
-  static int _runThread(void *ptr);
+  void _activate(Video* target);
+  void _wake();
+  static void _runJob(void *ptr);
+  static void _runLoadJob(void *ptr);
   
   VideoManager();
   VideoManager(VideoManager const&);
@@ -65,7 +72,7 @@ public:
   void init();
   void flush();
   void registerVideo(Video* target);
-  void requestVideo(Video* target);
+  void requestVideo(Video* target, bool inBackground = false);
   void terminate();
   bool update();
 };
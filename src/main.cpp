@@ -11,7 +11,13 @@
 //
 ////////////////////////////////////////////////////////////
 
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <string>
+
 #include "Control.h"
+#include "Script.h"
 #include "Version.h"
 
 bool shouldStartApp(int argc, char *argv[]);
@@ -33,16 +39,64 @@ void displayHelp(char* progName)
 {
     printf("\n"
            "DAGON - An Adventure Game Engine\n\n"
-           "To start a game, run Dagon in a directory containing a config.lua file.\n\n"
+           "To start a game, run Dagon in a directory containing a config.lua file.\n"
+           "To precompile its scripts and modules, run it there with --compile.\n\n"
            "Usage:\n"
            "  %s\n"
+           "  %s [-c|--compile]\n"
            "  %s [-h|--help]\n"
            "  %s [-v|--version]\n",
            progName,
            progName,
+           progName,
            progName);
 }
 
+// Compiles every Lua file in the directory and those below it
+void compileScripts(const std::string& dirPath, int* numOfCompiled, int* numOfFailed)
+{
+    DIR* dir = opendir(dirPath.c_str());
+    if (!dir)
+        return;
+    
+    dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+        
+        const std::string path = dirPath + name;
+        struct stat fileStat;
+        if (stat(path.c_str(), &fileStat) != 0)
+            continue;
+        
+        if ((fileStat.st_mode & S_IFMT) == S_IFDIR) {
+            compileScripts(path + "/", numOfCompiled, numOfFailed);
+        }
+        else if (name.length() > 4 && name.compare(name.length() - 4, 4, ".lua") == 0) {
+            std::string error;
+            if (dagon::Script::compile(path, &error)) {
+                (*numOfCompiled)++;
+            }
+            else {
+                printf("%s\n", error.c_str());
+                (*numOfFailed)++;
+            }
+        }
+    }
+    
+    closedir(dir);
+}
+
+void displayCompile()
+{
+    int numOfCompiled = 0;
+    int numOfFailed = 0;
+    compileScripts("scripts/", &numOfCompiled, &numOfFailed);
+    compileScripts("modules/", &numOfCompiled, &numOfFailed);
+    printf("%d scripts compiled, %d failed\n", numOfCompiled, numOfFailed);
+}
+
 void displayVersion()
 {
     printf(DAGON_VERSION_STRING "\n");
@@ -66,6 +120,11 @@ bool shouldStartApp(int argc, char* argv[])
           return false;
         }
         
+        if (MATCHES_OPT(firstArg, "-c", "--compile")) {
+          displayCompile();
+          return false;
+        }
+        
     }
     return true;
     